@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+// Standalone benchmarks of the simulation and optimization code, without Yosys
+//
+// Usage: moosic-bench [-quick] [-help] [graph files...]
+// Graph files are in the text or binary format of LogicLockingOptimizer::fromFile.
+// Each line reports the wall time and the throughput of one benchmark, to be tracked between releases.
+// A node evaluation is the simulation of one node on one test vector.
+
+#include "corruption_matrix.hpp"
+#include "logic_locking_optimizer.hpp"
+#include "mini_aig.hpp"
+#include "output_corruption_optimizer.hpp"
+#include "test_vectors.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+double elapsed(Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); }
+
+void report(const std::string &name, double seconds, double count, const char *unit)
+{
+	std::printf("%-60s %10.4f s %14.4g %s/s\n", name.c_str(), seconds, seconds > 0.0 ? count / seconds : 0.0, unit);
+}
+
+/**
+ * @brief An AIG with the literals of all its nodes, to pick toggled nodes from
+ */
+struct BenchAIG {
+	MiniAIG aig;
+	std::vector<Lit> nodes;
+};
+
+/**
+ * @brief Random AIG, with fanins biased toward recent nodes to obtain some depth
+ */
+BenchAIG randomAIG(int nbInputs, int nbNodes, int nbOutputs, std::mt19937_64 &rng)
+{
+	BenchAIG ret{MiniAIG(nbInputs), {}};
+	std::vector<Lit> lits;
+	for (int i = 0; i < nbInputs; ++i) {
+		lits.push_back(ret.aig.getInput(i));
+	}
+	for (int i = 0; i < nbNodes; ++i) {
+		auto pick = [&]() {
+			std::size_t window = std::min<std::size_t>(lits.size(), 1000);
+			Lit l = lits[lits.size() - 1 - rng() % window];
+			return rng() % 2 ? l : l.inv();
+		};
+		Lit n = ret.aig.addAnd(pick(), pick());
+		lits.push_back(n);
+		ret.nodes.push_back(n);
+	}
+	for (int i = 0; i < nbOutputs; ++i) {
+		ret.aig.addOutput(lits[lits.size() - 1 - rng() % std::min<std::size_t>(lits.size(), 4 * nbOutputs)]);
+	}
+	return ret;
+}
+
+/**
+ * @brief Array multiplier of two unsigned numbers, with ripple-carry adders
+ */
+BenchAIG multiplierAIG(int width)
+{
+	BenchAIG ret{MiniAIG(2 * width), {}};
+	MiniAIG &aig = ret.aig;
+	auto record = [&](Lit l) {
+		ret.nodes.push_back(l);
+		return l;
+	};
+	std::vector<Lit> acc(2 * width, Lit::zero());
+	for (int i = 0; i < width; ++i) {
+		Lit carry = Lit::zero();
+		for (int j = 0; j < width; ++j) {
+			Lit p = record(aig.addAnd(aig.getInput(i), aig.getInput(width + j)));
+			Lit a = acc[i + j];
+			Lit s = record(aig.addXor(a, p));
+			Lit sum = record(aig.addXor(s, carry));
+			carry = record(aig.addOr(aig.addAnd(a, p), aig.addAnd(s, carry)));
+			acc[i + j] = sum;
+		}
+		acc[i + width] = carry;
+	}
+	for (Lit l : acc) {
+		aig.addOutput(l);
+	}
+	return ret;
+}
+
+void benchSimulation(const std::string &name, BenchAIG &bench, int nbIterations, std::mt19937_64 &rng)
+{
+	MiniAIG &aig = bench.aig;
+	double nbNodes = aig.nbNodes();
+	std::printf("%s: %d inputs, %d nodes, %d outputs\n", name.c_str(), aig.nbInputs(), aig.nbNodes(), aig.nbOutputs());
+	std::vector<std::uint64_t> inputs(aig.nbInputs());
+	for (auto &v : inputs) {
+		v = rng();
+	}
+
+	auto start = Clock::now();
+	for (int i = 0; i < nbIterations; ++i) {
+		aig.simulate(inputs);
+	}
+	report(name + " MiniAIG::simulate", elapsed(start), 64.0 * nbNodes * nbIterations, "node evals");
+
+	start = Clock::now();
+	for (int i = 0; i < nbIterations; ++i) {
+		aig.simulateWithToggling(inputs, {bench.nodes[rng() % bench.nodes.size()]});
+	}
+	report(name + " MiniAIG::simulateWithToggling", elapsed(start), 64.0 * nbNodes * nbIterations, "node evals");
+
+	CompactAIG compact(aig);
+	int nbWords = CompactAIG::preferredNbWords();
+	IncrementalSimulation sim(compact, nbWords);
+	std::vector<std::uint64_t> wideInputs((std::size_t)aig.nbInputs() * nbWords);
+	for (auto &v : wideInputs) {
+		v = rng();
+	}
+	start = Clock::now();
+	for (int i = 0; i < nbIterations; ++i) {
+		sim.simulate(wideInputs);
+	}
+	report(name + " IncrementalSimulation::simulate", elapsed(start), 64.0 * nbWords * nbNodes * nbIterations, "node evals");
+
+	// Sample of nodes spread over the whole AIG
+	std::vector<Lit> toggles;
+	std::size_t step = std::max<std::size_t>(1, bench.nodes.size() / 2000);
+	for (std::size_t i = 0; i < bench.nodes.size(); i += step) {
+		toggles.push_back(compact.getLit(bench.nodes[i]));
+	}
+	start = Clock::now();
+	for (Lit l : toggles) {
+		sim.simulateWithToggling({l});
+	}
+	report(name + " IncrementalSimulation::simulateWithToggling", elapsed(start), toggles.size(), "toggles");
+
+	start = Clock::now();
+	sim.simulateSingleToggles(toggles);
+	report(name + " IncrementalSimulation::simulateSingleToggles", elapsed(start), toggles.size(), "toggles");
+}
+
+/**
+ * @brief Simulation over several cycles, with half of the outputs fed back to inputs as registers
+ */
+void benchSequential(const std::string &name, BenchAIG &bench, int nbCycles, std::mt19937_64 &rng)
+{
+	CompactAIG compact(bench.aig);
+	std::vector<std::pair<int, int>> registers;
+	for (int r = 0; r < std::min(compact.nbInputs(), compact.nbOutputs()) / 2; ++r) {
+		registers.emplace_back(r, r);
+	}
+	int nbWords = CompactAIG::preferredNbWords();
+	SequentialSimulation sim(compact, registers, nbWords);
+	std::vector<std::vector<std::uint64_t>> inputs(nbCycles, std::vector<std::uint64_t>((std::size_t)compact.nbInputs() * nbWords));
+	for (auto &cycle : inputs) {
+		for (auto &v : cycle) {
+			v = rng();
+		}
+	}
+	std::printf("%s: %d registers, %d cycles\n", name.c_str(), (int)registers.size(), nbCycles);
+	auto start = Clock::now();
+	sim.simulate(inputs);
+	report(name + " SequentialSimulation::simulate", elapsed(start), 64.0 * nbWords * compact.nbNodes() * nbCycles, "node evals");
+
+	std::vector<Lit> toggles;
+	std::size_t step = std::max<std::size_t>(1, bench.nodes.size() / 500);
+	for (std::size_t i = 0; i < bench.nodes.size(); i += step) {
+		toggles.push_back(compact.getLit(bench.nodes[i]));
+	}
+	start = Clock::now();
+	for (Lit l : toggles) {
+		sim.simulateCorruption(l);
+	}
+	report(name + " SequentialSimulation::simulateCorruption", elapsed(start), toggles.size(), "toggles");
+}
+
+/**
+ * @brief Random interference graph with planted cliques
+ */
+std::vector<std::vector<int>> randomGraph(int nbNodes, int nbCliques, int cliqueSize, double density, std::mt19937_64 &rng)
+{
+	std::vector<std::vector<int>> gr(nbNodes);
+	auto addEdge = [&](int a, int b) {
+		if (a != b) {
+			gr[a].push_back(b);
+			gr[b].push_back(a);
+		}
+	};
+	std::bernoulli_distribution edge(density);
+	for (int i = 0; i < nbNodes; ++i) {
+		for (int j = i + 1; j < nbNodes; ++j) {
+			if (edge(rng)) {
+				addEdge(i, j);
+			}
+		}
+	}
+	for (int c = 0; c < nbCliques; ++c) {
+		std::vector<int> clique;
+		for (int i = 0; i < cliqueSize; ++i) {
+			clique.push_back(rng() % nbNodes);
+		}
+		for (int i = 0; i < cliqueSize; ++i) {
+			for (int j = i + 1; j < cliqueSize; ++j) {
+				addEdge(clique[i], clique[j]);
+			}
+		}
+	}
+	return gr;
+}
+
+void benchCliques(const std::string &name, const LogicLockingOptimizer &opt)
+{
+	// Same budget as the default of the logic locking pass
+	int budget = std::max(1, opt.nbNodes() / 20);
+	double greedyValue = 0.0;
+	if (opt.cliquesEnumerated()) {
+		std::printf("%s: %d nodes, %d edges, %d maximal cliques\n", name.c_str(), opt.nbNodes(), opt.nbEdges(), opt.nbCliques());
+		auto start = Clock::now();
+		auto cliques = opt.listMaximalCliques();
+		report(name + " listMaximalCliques", elapsed(start), cliques.size(), "cliques");
+
+		start = Clock::now();
+		auto sol = opt.solveGreedy(budget);
+		report(name + " solveGreedy", elapsed(start), opt.nbNodes(), "nodes");
+		greedyValue = opt.value(sol);
+	} else {
+		std::printf("%s: %d nodes, %d edges, too many maximal cliques\n", name.c_str(), opt.nbNodes(), opt.nbEdges());
+	}
+
+	auto start = Clock::now();
+	auto sol = opt.solveHeuristic(budget, 60.0);
+	report(name + " solveHeuristic", elapsed(start), opt.nbNodes(), "nodes");
+	std::printf("%s security with %d locked nodes: %.2f greedy, %.2f heuristic\n", name.c_str(), budget, greedyValue, opt.value(sol));
+}
+
+/**
+ * @brief Synthetic corruption data, where signals corrupt overlapping groups of outputs with varying rates
+ */
+std::shared_ptr<const CorruptionMatrix> randomCorruption(int nbSignals, int nbOutputs, int nbWords, std::mt19937_64 &rng)
+{
+	auto data = std::make_shared<CorruptionMatrix>(nbSignals, nbOutputs, nbWords);
+	for (int i = 0; i < nbSignals; ++i) {
+		if (i > 0 && rng() % 8 == 0) {
+			// Equivalent signal, as in buffer chains
+			std::memcpy(data->row(i), data->row(rng() % i), data->rowSize() * sizeof(std::uint64_t));
+			continue;
+		}
+		int first = rng() % nbOutputs;
+		int span = 1 + rng() % std::max(1, nbOutputs / 4);
+		int sparsity = rng() % 4;
+		for (int o = first; o < std::min(nbOutputs, first + span); ++o) {
+			std::uint64_t *words = data->get(i, o);
+			for (int w = 0; w < nbWords; ++w) {
+				std::uint64_t v = rng();
+				for (int s = 0; s < sparsity; ++s) {
+					v &= rng();
+				}
+				words[w] = v;
+			}
+		}
+	}
+	return data;
+}
+
+void benchCorruption(const std::string &name, int nbSignals, int nbOutputs, int nbWords, std::mt19937_64 &rng)
+{
+	std::printf("%s: %d signals, %d outputs, %d test vectors\n", name.c_str(), nbSignals, nbOutputs, 64 * nbWords);
+	auto data = randomCorruption(nbSignals, nbOutputs, nbWords, rng);
+	double size = (double)nbSignals * data->rowSize() * sizeof(std::uint64_t);
+
+	auto start = Clock::now();
+	OutputCorruptionOptimizer opt(data);
+	report(name + " OutputCorruptionOptimizer construction", elapsed(start), size, "bytes");
+
+	start = Clock::now();
+	auto sol = opt.solveGreedy(nbSignals / 10, std::vector<int>());
+	report(name + " OutputCorruptionOptimizer::solveGreedy", elapsed(start), sol.size(), "nodes");
+}
+
+void benchTestVectors(const std::string &name, int nbInputs, int nbBlocks)
+{
+	TestVectorSource source = TestVectorSource::random(nbInputs, 64 * nbBlocks, 1);
+	std::vector<std::uint64_t> values(nbInputs);
+	std::uint64_t checksum = 0;
+	auto start = Clock::now();
+	for (int b = 0; b < nbBlocks; ++b) {
+		source.getBlock(b, values.data());
+		checksum ^= values[b % nbInputs];
+	}
+	report(name + " TestVectorSource::getBlock", elapsed(start), (double)nbInputs * nbBlocks, "words");
+	if (checksum == 0) {
+		std::printf("Unexpected test vectors\n");
+	}
+}
+
+/**
+ * @brief Run all benchmarks, on generated designs and on the given graph files
+ */
+void runBenchmarks(bool quick, const std::vector<std::string> &graphFiles)
+{
+	int scale = quick ? 1 : 4;
+	// Beyond this, the graph files are only solved with the heuristic
+	const std::size_t maxCliques = 1000000;
+	std::mt19937_64 rng(1);
+
+	BenchAIG random = randomAIG(256, 25000 * scale, 128, rng);
+	benchSimulation("random", random, 200, rng);
+	BenchAIG mult = multiplierAIG(16 * scale);
+	benchSimulation("multiplier", mult, 200, rng);
+	benchSequential("sequential", random, 8, rng);
+
+	LogicLockingOptimizer sparse(randomGraph(1000 * scale, 50 * scale, 12, 0.002, rng));
+	benchCliques("sparse graph", sparse);
+	LogicLockingOptimizer dense(randomGraph(250 * scale, 10 * scale, 20, 0.05, rng));
+	benchCliques("dense graph", dense);
+	for (const std::string &file : graphFiles) {
+		auto start = Clock::now();
+		LogicLockingOptimizer opt = LogicLockingOptimizer::fromFile(file, maxCliques);
+		report(file + " fromFile", elapsed(start), opt.nbEdges(), "edges");
+		benchCliques(file, opt);
+	}
+
+	benchCorruption("corruption", 2000 * scale, 64, 4 * scale, rng);
+	benchTestVectors("random vectors", 1024, 1000 * scale);
+}
+
+void printUsage(std::FILE *f, const char *name)
+{
+	std::fprintf(f, "Usage: %s [-quick] [-help] [graph files...]\n", name);
+	std::fprintf(f, "    -quick    run smaller benchmarks\n");
+	std::fprintf(f, "    -help     print this message\n");
+	std::fprintf(f, "Graph files are in the text or binary format of LogicLockingOptimizer::fromFile.\n");
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	bool quick = false;
+	std::vector<std::string> graphFiles;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "-quick") == 0) {
+			quick = true;
+		} else if (std::strcmp(argv[i], "-help") == 0 || std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+			printUsage(stdout, argv[0]);
+			return 0;
+		} else if (argv[i][0] == '-') {
+			std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+			printUsage(stderr, argv[0]);
+			return 1;
+		} else {
+			graphFiles.push_back(argv[i]);
+		}
+	}
+	try {
+		runBenchmarks(quick, graphFiles);
+	} catch (const std::exception &e) {
+		std::fprintf(stderr, "Error: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
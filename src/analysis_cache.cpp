@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#include "analysis_cache.hpp"
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+USING_YOSYS_NAMESPACE
+
+namespace
+{
+const char cache_magic[8] = {'M', 'O', 'O', 'S', 'I', 'C', 'A', '1'};
+const std::uint64_t output_corruption_kind = 1;
+const std::uint64_t pairwise_security_kind = 2;
+const std::uint64_t shard_kind = 3;
+
+// Bump when the analysis or the file format changes, to invalidate existing caches
+const std::uint64_t cache_version = 2;
+
+/**
+ * @brief Header of a cache file, in the order of the file
+ */
+struct CacheHeader {
+	char magic[8];
+	std::uint64_t kind;
+	std::uint64_t key;
+	std::uint64_t nb_cells;
+	std::uint64_t nb_outputs;
+	std::uint64_t nb_words;
+	std::uint64_t nb_edges;
+	std::uint64_t names_size;
+};
+
+/**
+ * @brief 64-bit FNV-1a hash
+ */
+struct Hasher {
+	std::uint64_t h = 0xcbf29ce484222325ull;
+
+	void add(const void *data, std::size_t size)
+	{
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for (std::size_t i = 0; i < size; ++i) {
+			h ^= p[i];
+			h *= 0x100000001b3ull;
+		}
+	}
+
+	void add(std::uint64_t v) { add(&v, sizeof(v)); }
+
+	void add(const std::string &s)
+	{
+		add(s.size());
+		add(s.data(), s.size());
+	}
+
+	void add(const SigSpec &sig)
+	{
+		add(sig.size());
+		for (SigBit b : sig) {
+			if (b.wire) {
+				add(b.wire->name.str());
+				add(b.offset);
+			} else {
+				add((std::uint64_t)b.data);
+			}
+		}
+	}
+};
+
+std::size_t padded_size(std::size_t size) { return (size + 7) / 8 * 8; }
+
+/**
+ * @brief Build the table of cell names, padded to 64 bits
+ */
+std::string make_name_table(const std::vector<Cell *> &cells)
+{
+	std::string names;
+	for (Cell *c : cells) {
+		names += c->name.str();
+		names.push_back('\0');
+	}
+	names.resize(padded_size(names.size()), '\0');
+	return names;
+}
+
+/**
+ * @brief Check the header and cell names of a cache file, and return its payload
+ *
+ * @return nullptr if the file does not match
+ */
+const char *check_file(const MappedFile &f, std::uint64_t kind, std::uint64_t key, const std::vector<Cell *> &cells, CacheHeader &header)
+{
+	if (!f.valid() || f.size() < sizeof(CacheHeader)) {
+		return nullptr;
+	}
+	std::memcpy(&header, f.data(), sizeof(CacheHeader));
+	if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.kind != kind || header.key != key ||
+	    header.nb_cells != cells.size() || header.names_size % 8 != 0 || f.size() - sizeof(CacheHeader) < header.names_size) {
+		return nullptr;
+	}
+	std::string names = make_name_table(cells);
+	if (names.size() != header.names_size || std::memcmp(names.data(), f.data() + sizeof(CacheHeader), names.size()) != 0) {
+		return nullptr;
+	}
+	return f.data() + sizeof(CacheHeader) + header.names_size;
+}
+
+/**
+ * @brief Encode pairs of cells as pairs of 32-bit cell indices
+ */
+std::vector<std::uint32_t> encode_edges(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairs)
+{
+	dict<Cell *, int> cell_to_ind;
+	for (int i = 0; i < GetSize(cells); ++i) {
+		cell_to_ind[cells[i]] = i;
+	}
+	std::vector<std::uint32_t> edges;
+	edges.reserve(2 * pairs.size());
+	for (auto p : pairs) {
+		edges.push_back(cell_to_ind.at(p.first));
+		edges.push_back(cell_to_ind.at(p.second));
+	}
+	return edges;
+}
+
+/**
+ * @brief Decode pairs of 32-bit cell indices
+ *
+ * @return false if an index is out of range
+ */
+bool decode_edges(const std::vector<Cell *> &cells, const char *data, std::size_t nb_edges, std::vector<std::pair<Cell *, Cell *>> &pairs)
+{
+	std::vector<std::uint32_t> edges(2 * nb_edges);
+	std::memcpy(edges.data(), data, edges.size() * sizeof(std::uint32_t));
+	pairs.clear();
+	for (std::size_t i = 0; i < nb_edges; ++i) {
+		std::uint32_t a = edges[2 * i];
+		std::uint32_t b = edges[2 * i + 1];
+		if (a >= cells.size() || b >= cells.size()) {
+			return false;
+		}
+		pairs.emplace_back(cells[a], cells[b]);
+	}
+	return true;
+}
+} // namespace
+
+AnalysisCache::AnalysisCache(const std::string &cache_dir, Module *module, int nb_test_vectors, std::size_t seed, const std::string &stimulus_file,
+			     int nb_cycles)
+    : cache_dir_(cache_dir), key_(compute_key(module, nb_test_vectors, seed, stimulus_file, nb_cycles))
+{
+#ifdef _WIN32
+	int ret = _mkdir(cache_dir_.c_str());
+#else
+	int ret = mkdir(cache_dir_.c_str(), 0755);
+#endif
+	if (ret != 0 && errno != EEXIST) {
+		log_warning("Could not create cache directory %s: %s\n", cache_dir_.c_str(), std::strerror(errno));
+	}
+}
+
+std::uint64_t AnalysisCache::compute_key(Module *module, int nb_test_vectors, std::size_t seed, const std::string &stimulus_file, int nb_cycles)
+{
+	Hasher h;
+	h.add(cache_version);
+	h.add(hash_module(module));
+	if (stimulus_file.empty()) {
+		h.add(nb_test_vectors);
+		h.add(seed);
+	} else {
+		MappedFile f(stimulus_file);
+		h.add(f.size());
+		h.add(f.data(), f.size());
+	}
+	// Combinational analyses keep the keys of earlier versions
+	if (nb_cycles > 1) {
+		h.add(nb_cycles);
+	}
+	return h.h;
+}
+
+std::uint64_t AnalysisCache::hash_module(Module *module)
+{
+	Hasher h;
+	h.add(module->name.str());
+	for (Wire *w : module->wires()) {
+		h.add(w->name.str());
+		h.add(w->width);
+		h.add(w->start_offset);
+		h.add(w->port_id);
+		h.add(w->port_input);
+		h.add(w->port_output);
+	}
+	for (Cell *c : module->cells()) {
+		h.add(c->name.str());
+		h.add(c->type.str());
+		for (const auto &p : c->parameters) {
+			h.add(p.first.str());
+			h.add(p.second.as_string());
+		}
+		for (const auto &conn : c->connections()) {
+			h.add(conn.first.str());
+			h.add(conn.second);
+		}
+	}
+	for (const auto &conn : module->connections()) {
+		h.add(conn.first);
+		h.add(conn.second);
+	}
+	return h.h;
+}
+
+std::string AnalysisCache::get_path(const char *suffix) const { return stringf("%s/%016llx.%s", cache_dir_.c_str(), (unsigned long long)key_, suffix); }
+
+void AnalysisCache::write_file(const std::string &path, std::uint64_t kind, std::uint64_t key, const std::vector<Cell *> &cells, std::uint64_t nb_outputs,
+			       std::uint64_t nb_words, std::uint64_t nb_edges, const std::function<void(std::ostream &)> &write_payload)
+{
+	std::string names = make_name_table(cells);
+	CacheHeader header;
+	std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.kind = kind;
+	header.key = key;
+	header.nb_cells = cells.size();
+	header.nb_outputs = nb_outputs;
+	header.nb_words = nb_words;
+	header.nb_edges = nb_edges;
+	header.names_size = names.size();
+
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+		f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		f.write(names.data(), names.size());
+		write_payload(f);
+		if (!f) {
+			log_warning("Could not write cache file %s\n", tmp_path.c_str());
+			std::remove(tmp_path.c_str());
+			return;
+		}
+	}
+	if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+		log_warning("Could not write cache file %s\n", path.c_str());
+		std::remove(tmp_path.c_str());
+		return;
+	}
+	log("Saved analysis results to %s\n", path.c_str());
+}
+
+bool AnalysisCache::load_output_corruption_data(const std::vector<Cell *> &cells, const std::string &backing_file, CorruptionMatrix &data) const
+{
+	std::string path = get_path("corruption");
+	MappedFile f(path);
+	CacheHeader header;
+	const char *payload = check_file(f, output_corruption_kind, key_, cells, header);
+	if (payload == nullptr) {
+		return false;
+	}
+	std::size_t row_size = header.nb_outputs * header.nb_words;
+	if ((std::size_t)(f.data() + f.size() - payload) != cells.size() * row_size * sizeof(std::uint64_t)) {
+		return false;
+	}
+	if (backing_file.empty()) {
+		data = CorruptionMatrix(cells.size(), header.nb_outputs, header.nb_words);
+	} else {
+		data = CorruptionMatrix(cells.size(), header.nb_outputs, header.nb_words, backing_file);
+	}
+	for (std::size_t i = 0; i < cells.size(); ++i) {
+		std::memcpy(data.row(i), payload + i * row_size * sizeof(std::uint64_t), row_size * sizeof(std::uint64_t));
+	}
+	log("Loaded output corruption data from %s\n", path.c_str());
+	return true;
+}
+
+void AnalysisCache::save_output_corruption_data(const std::vector<Cell *> &cells, const CorruptionMatrix &data) const
+{
+	log_assert(data.nbSignals() == GetSize(cells));
+	write_file(get_path("corruption"), output_corruption_kind, key_, cells, data.nbOutputs(), data.nbWords(), 0, [&](std::ostream &f) {
+		// Rows are written without their padding
+		for (int i = 0; i < data.nbSignals(); ++i) {
+			f.write(reinterpret_cast<const char *>(data.row(i)), data.rowSize() * sizeof(std::uint64_t));
+		}
+	});
+}
+
+bool AnalysisCache::load_pairwise_secure_graph(const std::vector<Cell *> &cells, std::vector<std::pair<Cell *, Cell *>> &pairs) const
+{
+	std::string path = get_path("pairwise");
+	MappedFile f(path);
+	CacheHeader header;
+	const char *payload = check_file(f, pairwise_security_kind, key_, cells, header);
+	if (payload == nullptr) {
+		return false;
+	}
+	if ((std::size_t)(f.data() + f.size() - payload) != header.nb_edges * 2 * sizeof(std::uint32_t)) {
+		return false;
+	}
+	if (!decode_edges(cells, payload, header.nb_edges, pairs)) {
+		return false;
+	}
+	log("Loaded pairwise security graph from %s\n", path.c_str());
+	return true;
+}
+
+void AnalysisCache::save_pairwise_secure_graph(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairs) const
+{
+	std::vector<std::uint32_t> payload = encode_edges(cells, pairs);
+	write_file(get_path("pairwise"), pairwise_security_kind, key_, cells, 0, 0, pairs.size(),
+		   [&](std::ostream &f) { f.write(reinterpret_cast<const char *>(payload.data()), payload.size() * sizeof(std::uint32_t)); });
+}
+
+void AnalysisCache::save_shard(const std::string &path, std::uint64_t key, const std::vector<Cell *> &cells, const ShardResults &results)
+{
+	std::vector<std::uint32_t> edges = encode_edges(cells, results.pairwise);
+	std::uint64_t nb_outputs = results.has_corruption ? results.corruption->nbOutputs() : 0;
+	std::uint64_t nb_words = results.has_corruption ? results.corruption->nbWords() : 0;
+	write_file(path, shard_kind, key, cells, nb_outputs, nb_words, results.pairwise.size(), [&](std::ostream &f) {
+		std::uint64_t info[4] = {(std::uint64_t)results.shard, (std::uint64_t)results.nb_shards, results.has_pairwise, results.has_corruption};
+		f.write(reinterpret_cast<const char *>(info), sizeof(info));
+		f.write(reinterpret_cast<const char *>(edges.data()), edges.size() * sizeof(std::uint32_t));
+		// Padding, so that the corruption data is aligned
+		std::uint32_t zero = 0;
+		if (edges.size() % 2 != 0) {
+			f.write(reinterpret_cast<const char *>(&zero), sizeof(zero));
+		}
+		if (!results.has_corruption) {
+			return;
+		}
+		const CorruptionMatrix &data = *results.corruption;
+		for (int r = 0; r < data.nbSignals(); ++r) {
+			f.write(reinterpret_cast<const char *>(data.row(r)), data.rowSize() * sizeof(std::uint64_t));
+		}
+	});
+}
+
+bool AnalysisCache::load_shard(const std::string &path, std::uint64_t key, const std::vector<Cell *> &cells, ShardResults &results)
+{
+	MappedFile f(path);
+	CacheHeader header;
+	const char *payload = check_file(f, shard_kind, key, cells, header);
+	if (payload == nullptr) {
+		return false;
+	}
+	std::size_t payload_size = f.data() + f.size() - payload;
+	std::uint64_t info[4];
+	if (payload_size < sizeof(info)) {
+		return false;
+	}
+	std::memcpy(info, payload, sizeof(info));
+	results.shard = info[0];
+	results.nb_shards = info[1];
+	results.has_pairwise = info[2];
+	results.has_corruption = info[3];
+	if (results.nb_shards <= 0 || results.shard < 0 || results.shard >= results.nb_shards) {
+		return false;
+	}
+	std::size_t edges_size = padded_size(header.nb_edges * 2 * sizeof(std::uint32_t));
+	std::size_t nb_rows = results.shard < (int)cells.size() ? (cells.size() - results.shard + results.nb_shards - 1) / results.nb_shards : 0;
+	std::size_t row_size = header.nb_outputs * header.nb_words;
+	if (payload_size != sizeof(info) + edges_size + nb_rows * row_size * sizeof(std::uint64_t)) {
+		return false;
+	}
+	payload += sizeof(info);
+	if (!decode_edges(cells, payload, header.nb_edges, results.pairwise)) {
+		return false;
+	}
+	payload += edges_size;
+	results.corruption.reset();
+	if (results.has_corruption) {
+		auto data = std::make_shared<CorruptionMatrix>(nb_rows, header.nb_outputs, header.nb_words);
+		for (int r = 0; r < data->nbSignals(); ++r) {
+			std::memcpy(data->row(r), payload, row_size * sizeof(std::uint64_t));
+			payload += row_size * sizeof(std::uint64_t);
+		}
+		results.corruption = data;
+	}
+	return true;
+}
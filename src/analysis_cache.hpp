@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#ifndef MOOSIC_ANALYSIS_CACHE_H
+#define MOOSIC_ANALYSIS_CACHE_H
+
+#include "kernel/rtlil.h"
+#include "kernel/yosys.h"
+
+#include "corruption_matrix.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+using Yosys::dict;
+using Yosys::RTLIL::Cell;
+using Yosys::RTLIL::Module;
+using Yosys::RTLIL::SigBit;
+using Yosys::RTLIL::SigSpec;
+using Yosys::RTLIL::Wire;
+
+/**
+ * @brief Partial analysis results of one shard, to be merged with the results of the other shards
+ *
+ * Cell i, in the order of the lockable cells, belongs to shard i % nb_shards (see LogicLockingAnalyzer::set_shard).
+ */
+struct ShardResults {
+	int shard = 0;
+	int nb_shards = 1;
+	bool has_pairwise = false;
+	bool has_corruption = false;
+	// Pairwise secure pairs (a, b), with a in the shard
+	std::vector<std::pair<Cell *, Cell *>> pairwise;
+	// Output corruption data of the cells of the shard only: row r is cell shard + r * nb_shards
+	std::shared_ptr<const CorruptionMatrix> corruption;
+};
+
+/**
+ * @brief Persistent storage of analysis results across pass invocations
+ *
+ * Results are stored in a directory, in one file per kind of result. Files are named after a key
+ * that hashes the module's structure, the number of test vectors and the seed used to generate them,
+ * so that any change to the design or to the analysis parameters results in a cache miss.
+ *
+ * The files use a compact binary format in native byte order, that is memory-mapped when loading:
+ *     - a header of 8 64-bit words: magic, kind, key, number of cells, number of outputs, number of 64-bit test vector words,
+ *       number of edges, size of the name table
+ *     - the name table: null-terminated cell names, padded to 8 bytes
+ *     - for output corruption: the data by cell, then output, then test vector, as 64-bit words
+ *     - for pairwise security: the edges as pairs of 32-bit cell indices
+ *
+ * Shard files use the same format, with the shard index, the number of shards and the analyses present as four 64-bit
+ * words, followed by the edges of the shard and the output corruption data of its cells.
+ */
+class AnalysisCache
+{
+      public:
+	/**
+	 * @brief Initialize for a module and analysis parameters; the directory is created if needed
+	 *
+	 * With a stimulus file, the test vectors are identified by the contents of the file rather than by their number and seed.
+	 * The number of cycles of a sequential analysis is part of the key.
+	 */
+	AnalysisCache(const std::string &cache_dir, Module *module, int nb_test_vectors, std::size_t seed,
+		      const std::string &stimulus_file = std::string(), int nb_cycles = 1);
+
+	/**
+	 * @brief Key identifying the module and analysis parameters
+	 */
+	std::uint64_t key() const { return key_; }
+
+	/**
+	 * @brief Compute the key identifying the module and analysis parameters, without a cache directory
+	 */
+	static std::uint64_t compute_key(Module *module, int nb_test_vectors, std::size_t seed, const std::string &stimulus_file = std::string(),
+					 int nb_cycles = 1);
+
+	/**
+	 * @brief Load the output corruption data for the cells, if present in the cache
+	 *
+	 * The data is loaded in memory, or in a memory-mapped file if backing_file is not empty.
+	 *
+	 * @return false on a cache miss, or if the cached cells do not match
+	 */
+	bool load_output_corruption_data(const std::vector<Cell *> &cells, const std::string &backing_file, CorruptionMatrix &data) const;
+
+	/**
+	 * @brief Store the output corruption data for the cells
+	 */
+	void save_output_corruption_data(const std::vector<Cell *> &cells, const CorruptionMatrix &data) const;
+
+	/**
+	 * @brief Load the pairwise security graph for the cells, if present in the cache
+	 *
+	 * @return false on a cache miss, or if the cached cells do not match
+	 */
+	bool load_pairwise_secure_graph(const std::vector<Cell *> &cells, std::vector<std::pair<Cell *, Cell *>> &pairs) const;
+
+	/**
+	 * @brief Store the pairwise security graph for the cells
+	 */
+	void save_pairwise_secure_graph(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairs) const;
+
+	/**
+	 * @brief Hash the structure of a module: wires, cells with their parameters and connections, in iteration order
+	 */
+	static std::uint64_t hash_module(Module *module);
+
+	/**
+	 * @brief Write the partial results of a shard
+	 */
+	static void save_shard(const std::string &path, std::uint64_t key, const std::vector<Cell *> &cells, const ShardResults &results);
+
+	/**
+	 * @brief Read the partial results of a shard
+	 *
+	 * @return false if the file cannot be read, or if it was written for other cells or analysis parameters
+	 */
+	static bool load_shard(const std::string &path, std::uint64_t key, const std::vector<Cell *> &cells, ShardResults &results);
+
+      private:
+	/**
+	 * @brief Path of the cache file for a kind of result
+	 */
+	std::string get_path(const char *suffix) const;
+
+	/**
+	 * @brief Write a cache file, through a temporary file so that concurrent readers never see partial results
+	 */
+	static void write_file(const std::string &path, std::uint64_t kind, std::uint64_t key, const std::vector<Cell *> &cells, std::uint64_t nb_outputs,
+			       std::uint64_t nb_words, std::uint64_t nb_edges, const std::function<void(std::ostream &)> &write_payload);
+
+      private:
+	std::string cache_dir_;
+	std::uint64_t key_;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#include "corruption_matrix.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const std::size_t alignment = 64;
+const std::size_t wordsPerLine = alignment / sizeof(std::uint64_t);
+
+std::size_t paddedStride(int nbOutputs, int nbWords) { return ((std::size_t)nbOutputs * nbWords + wordsPerLine - 1) / wordsPerLine * wordsPerLine; }
+} // namespace
+
+CorruptionMatrix::CorruptionMatrix() : nbSignals_(0), nbOutputs_(0), nbWords_(0), rowStride_(0), data_(nullptr), mapped_(false) {}
+
+CorruptionMatrix::CorruptionMatrix(int nbSignals, int nbOutputs, int nbWords)
+    : nbSignals_(nbSignals), nbOutputs_(nbOutputs), nbWords_(nbWords), rowStride_(paddedStride(nbOutputs, nbWords)), data_(nullptr),
+      mapped_(false)
+{
+	std::size_t size = nbSignals_ * rowStride_ * sizeof(std::uint64_t);
+	if (size == 0) {
+		return;
+	}
+	data_ = static_cast<std::uint64_t *>(::operator new(size, std::align_val_t(alignment)));
+	std::memset(data_, 0, size);
+}
+
+CorruptionMatrix::CorruptionMatrix(int nbSignals, int nbOutputs, int nbWords, const std::string &backingFile)
+    : nbSignals_(nbSignals), nbOutputs_(nbOutputs), nbWords_(nbWords), rowStride_(paddedStride(nbOutputs, nbWords)), data_(nullptr),
+      mapped_(false)
+{
+	std::size_t size = nbSignals_ * rowStride_ * sizeof(std::uint64_t);
+	if (size == 0) {
+		return;
+	}
+#ifndef _WIN32
+	int fd = open(backingFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		throw std::runtime_error("Could not open the corruption data file " + backingFile);
+	}
+	if (ftruncate(fd, size) != 0) {
+		close(fd);
+		throw std::runtime_error("Could not allocate the corruption data file " + backingFile);
+	}
+	void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	// The mapping stays valid; the file is only freed once unmapped
+	std::remove(backingFile.c_str());
+	if (ptr == MAP_FAILED) {
+		throw std::runtime_error("Could not map the corruption data file " + backingFile);
+	}
+	data_ = static_cast<std::uint64_t *>(ptr);
+	mapped_ = true;
+#else
+	// No file backing on this platform
+	*this = CorruptionMatrix(nbSignals, nbOutputs, nbWords);
+#endif
+}
+
+CorruptionMatrix::~CorruptionMatrix() { release(); }
+
+CorruptionMatrix CorruptionMatrix::copyPrefix(int nbWords, const std::string &backingFile) const
+{
+	if (nbWords > nbWords_) {
+		throw std::runtime_error("Cannot copy more test vectors than the corruption data holds");
+	}
+	CorruptionMatrix ret;
+	if (backingFile.empty()) {
+		ret = CorruptionMatrix(nbSignals_, nbOutputs_, nbWords);
+	} else {
+		ret = CorruptionMatrix(nbSignals_, nbOutputs_, nbWords, backingFile);
+	}
+	for (int i = 0; i < nbSignals_; ++i) {
+		for (int o = 0; o < nbOutputs_; ++o) {
+			std::memcpy(ret.get(i, o), get(i, o), (std::size_t)nbWords * sizeof(std::uint64_t));
+		}
+	}
+	return ret;
+}
+
+CorruptionMatrix::CorruptionMatrix(CorruptionMatrix &&o) noexcept
+    : nbSignals_(o.nbSignals_), nbOutputs_(o.nbOutputs_), nbWords_(o.nbWords_), rowStride_(o.rowStride_), data_(o.data_), mapped_(o.mapped_)
+{
+	o.data_ = nullptr;
+	o.nbSignals_ = 0;
+}
+
+CorruptionMatrix &CorruptionMatrix::operator=(CorruptionMatrix &&o) noexcept
+{
+	if (this != &o) {
+		release();
+		nbSignals_ = o.nbSignals_;
+		nbOutputs_ = o.nbOutputs_;
+		nbWords_ = o.nbWords_;
+		rowStride_ = o.rowStride_;
+		data_ = o.data_;
+		mapped_ = o.mapped_;
+		o.data_ = nullptr;
+		o.nbSignals_ = 0;
+	}
+	return *this;
+}
+
+void CorruptionMatrix::release()
+{
+	if (data_ == nullptr) {
+		return;
+	}
+#ifndef _WIN32
+	if (mapped_) {
+		munmap(data_, nbSignals_ * rowStride_ * sizeof(std::uint64_t));
+		data_ = nullptr;
+		return;
+	}
+#endif
+	::operator delete(data_, std::align_val_t(alignment));
+	data_ = nullptr;
+}
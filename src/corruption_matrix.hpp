@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#ifndef MOOSIC_CORRUPTION_MATRIX_H
+#define MOOSIC_CORRUPTION_MATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Packed output corruption data for all lockable signals
+ *
+ * The bits are stored in a single row-major matrix indexed by signal, then output, then 64-bit
+ * word of test vectors. Each row starts on a 64-byte boundary; the padding is zero.
+ *
+ * The storage is either in memory or, for designs that do not fit in RAM, in a memory-mapped file.
+ */
+class CorruptionMatrix
+{
+      public:
+	/**
+	 * @brief Create an empty matrix
+	 */
+	CorruptionMatrix();
+
+	/**
+	 * @brief Create a zero-initialized matrix in memory
+	 */
+	CorruptionMatrix(int nbSignals, int nbOutputs, int nbWords);
+
+	/**
+	 * @brief Create a zero-initialized matrix backed by a file, that is overwritten and removed once mapped
+	 */
+	CorruptionMatrix(int nbSignals, int nbOutputs, int nbWords, const std::string &backingFile);
+
+	~CorruptionMatrix();
+	CorruptionMatrix(CorruptionMatrix &&o) noexcept;
+	CorruptionMatrix &operator=(CorruptionMatrix &&o) noexcept;
+	CorruptionMatrix(const CorruptionMatrix &) = delete;
+	CorruptionMatrix &operator=(const CorruptionMatrix &) = delete;
+
+	/**
+	 * @brief Number of signals (rows)
+	 */
+	int nbSignals() const { return nbSignals_; }
+
+	/**
+	 * @brief Number of outputs
+	 */
+	int nbOutputs() const { return nbOutputs_; }
+
+	/**
+	 * @brief Number of 64-bit words of test vectors per output
+	 */
+	int nbWords() const { return nbWords_; }
+
+	/**
+	 * @brief Number of meaningful 64-bit words per signal
+	 */
+	int rowSize() const { return nbOutputs_ * nbWords_; }
+
+	/**
+	 * @brief Distance in 64-bit words between two consecutive signals
+	 */
+	std::size_t rowStride() const { return rowStride_; }
+
+	/**
+	 * @brief Query whether the matrix is backed by a file
+	 */
+	bool isMapped() const { return mapped_; }
+
+	/**
+	 * @brief Corruption data of a signal, by output then test vector
+	 */
+	std::uint64_t *row(int signal) { return data_ + signal * rowStride_; }
+	const std::uint64_t *row(int signal) const { return data_ + signal * rowStride_; }
+
+	/**
+	 * @brief Corruption data of a signal for one output, by test vector
+	 */
+	std::uint64_t *get(int signal, int output) { return row(signal) + (std::size_t)output * nbWords_; }
+	const std::uint64_t *get(int signal, int output) const { return row(signal) + (std::size_t)output * nbWords_; }
+
+	/**
+	 * @brief Copy the data of the first test vector words to a new matrix, in memory or backed by a file if given
+	 */
+	CorruptionMatrix copyPrefix(int nbWords, const std::string &backingFile = std::string()) const;
+
+      private:
+	void release();
+
+      private:
+	int nbSignals_;
+	int nbOutputs_;
+	int nbWords_;
+	std::size_t rowStride_;
+	std::uint64_t *data_;
+	bool mapped_;
+};
+
+#endif
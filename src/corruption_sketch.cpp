@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#include "corruption_sketch.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+/**
+ * @brief Finalizer from splitmix64
+ */
+std::uint64_t mix(std::uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+} // namespace
+
+CorruptionSketch::CorruptionSketch(int nbSignals, int nbOutputs, int sketchSize)
+    : nbSignals_(nbSignals), nbOutputs_(nbOutputs), nbWords_(0), sketchSize_(sketchSize), finished_(false), counts_(nbSignals),
+      fingerprints_(nbSignals), hashes_((std::size_t)nbSignals * sketchSize), lengths_(nbSignals)
+{
+	if (sketchSize < 2) {
+		throw std::runtime_error("Sketch size should be at least 2");
+	}
+}
+
+void CorruptionSketch::addRow(int signal, int firstWord, int nbWords, const std::uint64_t *data)
+{
+	assert(!finished_);
+	std::uint64_t *heap = hashes_.data() + (std::size_t)signal * sketchSize_;
+	int &length = lengths_[signal];
+	for (int o = 0; o < nbOutputs_; ++o) {
+		for (int w = 0; w < nbWords; ++w) {
+			std::uint64_t v = data[(std::size_t)o * nbWords + w];
+			if (v == 0) {
+				continue;
+			}
+			std::uint64_t word = firstWord + w;
+			std::uint64_t pos = ((std::uint64_t)o << 40) | (word << 6);
+			fingerprints_[signal] += mix(mix(pos) ^ v);
+			counts_[signal] += std::bitset<64>(v).count();
+			while (v) {
+				std::uint64_t h = mix(pos | __builtin_ctzll(v));
+				v &= v - 1;
+				if (length < sketchSize_) {
+					heap[length++] = h;
+					std::push_heap(heap, heap + length);
+				} else if (h < heap[0]) {
+					std::pop_heap(heap, heap + length);
+					heap[length - 1] = h;
+					std::push_heap(heap, heap + length);
+				}
+			}
+		}
+	}
+}
+
+void CorruptionSketch::finish(int nbWords)
+{
+	nbWords_ = nbWords;
+	if (finished_) {
+		return;
+	}
+	for (int i = 0; i < nbSignals_; ++i) {
+		std::uint64_t *heap = hashes_.data() + (std::size_t)i * sketchSize_;
+		std::sort_heap(heap, heap + lengths_[i]);
+	}
+	finished_ = true;
+}
+
+void CorruptionSketch::resume()
+{
+	if (!finished_) {
+		return;
+	}
+	for (int i = 0; i < nbSignals_; ++i) {
+		std::uint64_t *heap = hashes_.data() + (std::size_t)i * sketchSize_;
+		std::make_heap(heap, heap + lengths_[i]);
+	}
+	finished_ = false;
+}
+
+double CorruptionSketch::estimateCount(const std::vector<std::uint64_t> &merged) const
+{
+	if ((int)merged.size() < sketchSize_) {
+		// No sketch was truncated: the count is exact
+		return merged.size();
+	}
+	// The k-th smallest of n uniform hashes is close to k / n
+	double kth = (merged[sketchSize_ - 1] + 1.0) / 18446744073709551616.0;
+	return (sketchSize_ - 1) / kth;
+}
+
+void CorruptionSketch::merge(std::vector<std::uint64_t> &merged, const std::uint64_t *sketch, int length) const
+{
+	std::vector<std::uint64_t> ret;
+	ret.reserve(std::min((int)merged.size() + length, sketchSize_));
+	auto it = merged.begin();
+	const std::uint64_t *jt = sketch;
+	while ((int)ret.size() < sketchSize_ && (it != merged.end() || jt != sketch + length)) {
+		std::uint64_t v;
+		if (jt == sketch + length || (it != merged.end() && *it < *jt)) {
+			v = *it++;
+		} else if (it == merged.end() || *jt < *it) {
+			v = *jt++;
+		} else {
+			// Same element in both
+			v = *it++;
+			++jt;
+		}
+		ret.push_back(v);
+	}
+	merged = std::move(ret);
+}
+
+SketchCorruptionOptimizer::SketchCorruptionOptimizer(std::shared_ptr<const CorruptionSketch> sketch) : sketch_(std::move(sketch))
+{
+	// Candidate representatives by fingerprint; the counts are compared as well
+	std::unordered_map<std::uint64_t, std::vector<int>> byFingerprint;
+	representative_.resize(nbNodes());
+	for (int i = 0; i < nbNodes(); ++i) {
+		std::vector<int> &candidates = byFingerprint[sketch_->fingerprint(i)];
+		representative_[i] = i;
+		for (int j : candidates) {
+			if (sketch_->count(i) == sketch_->count(j)) {
+				representative_[i] = j;
+				break;
+			}
+		}
+		if (representative_[i] == i) {
+			candidates.push_back(i);
+			uniqueNodes_.push_back(i);
+		}
+	}
+}
+
+std::vector<int> SketchCorruptionOptimizer::getUniqueNodes(const std::vector<int> &preLocked) const
+{
+	if (preLocked.empty()) {
+		return uniqueNodes_;
+	}
+	std::unordered_set<int> lockedRepresentatives;
+	for (int n : preLocked) {
+		lockedRepresentatives.insert(representative_[n]);
+	}
+	std::vector<int> nodes;
+	for (int i : uniqueNodes_) {
+		if (!lockedRepresentatives.count(i)) {
+			nodes.push_back(i);
+		}
+	}
+	return nodes;
+}
+
+float SketchCorruptionOptimizer::corruptionCover(const Solution &solution) const
+{
+	std::vector<std::uint64_t> merged;
+	for (int k : solution) {
+		sketch_->merge(merged, sketch_->getSketch(k), sketch_->getSketchLength(k));
+	}
+	double total = 64.0 * nbData();
+	return std::min(sketch_->estimateCount(merged), total) / total;
+}
+
+float SketchCorruptionOptimizer::corruptionRate(const Solution &solution) const
+{
+	long long count = 0;
+	for (int k : solution) {
+		count += sketch_->count(k);
+	}
+	return ((float)count) / (64 * nbData());
+}
+
+void SketchCorruptionOptimizer::corruptionCurve(const Solution &solution, std::vector<float> &cover, std::vector<float> &rate) const
+{
+	cover.clear();
+	rate.clear();
+	std::vector<std::uint64_t> merged;
+	long long count = 0;
+	double total = 64.0 * nbData();
+	for (int k : solution) {
+		sketch_->merge(merged, sketch_->getSketch(k), sketch_->getSketchLength(k));
+		count += sketch_->count(k);
+		cover.push_back(std::min(sketch_->estimateCount(merged), total) / total);
+		rate.push_back(count / total);
+	}
+}
+
+double SketchCorruptionOptimizer::estimateAdditionalCorruption(const std::vector<std::uint64_t> &merged, int node) const
+{
+	// The merged sketch holds exactly the elements of the solution below its largest hash: the hashes of the
+	// node below this threshold are a uniform sample of the node's elements, whose coverage is known
+	const std::uint64_t *sketch = sketch_->getSketch(node);
+	int length = sketch_->getSketchLength(node);
+	bool complete = (int)merged.size() < sketch_->sketchSize();
+	std::uint64_t threshold = complete || merged.empty() ? ~(std::uint64_t)0 : merged.back();
+	int nbSampled = 0;
+	int nbUncovered = 0;
+	for (int i = 0; i < length && sketch[i] <= threshold; ++i) {
+		++nbSampled;
+		if (!std::binary_search(merged.begin(), merged.end(), sketch[i])) {
+			++nbUncovered;
+		}
+	}
+	double count = sketch_->count(node);
+	if (nbSampled == 0) {
+		// No sample: assume the node is independent from the solution
+		double total = 64.0 * nbData();
+		return count * std::max(0.0, 1.0 - sketch_->estimateCount(merged) / total);
+	}
+	return count * nbUncovered / nbSampled;
+}
+
+SketchCorruptionOptimizer::Solution SketchCorruptionOptimizer::solveGreedy(int maxNumber, const Solution &preLocked) const
+{
+	// Lazy greedy, as in OutputCorruptionOptimizer; the estimated coverage is only approximately submodular
+	struct Entry {
+		double cover;
+		long long rate;
+		int node;
+		int iteration;
+
+		bool operator<(const Entry &o) const
+		{
+			if (cover != o.cover) {
+				return cover < o.cover;
+			}
+			if (rate != o.rate) {
+				return rate < o.rate;
+			}
+			return node > o.node;
+		}
+	};
+
+	std::vector<int> sol = preLocked;
+	std::vector<std::uint64_t> merged;
+	for (int k : preLocked) {
+		sketch_->merge(merged, sketch_->getSketch(k), sketch_->getSketchLength(k));
+	}
+	int firstIteration = preLocked.size();
+	// With an empty cover, the coverage of a node is its count; otherwise it is recomputed when on top
+	int initialIteration = preLocked.empty() ? firstIteration : -1;
+	std::vector<Entry> entries;
+	for (int k : getUniqueNodes(preLocked)) {
+		entries.push_back(Entry{(double)sketch_->count(k), sketch_->count(k), k, initialIteration});
+	}
+	std::priority_queue<Entry> heap(std::less<Entry>(), std::move(entries));
+
+	for (int i = firstIteration; i < std::min(nbNodes(), maxNumber); ++i) {
+		if (heap.empty())
+			break;
+		// Update the coverage of the top node until it is up-to-date
+		while (heap.top().iteration != i) {
+			Entry e = heap.top();
+			heap.pop();
+			e.cover = estimateAdditionalCorruption(merged, e.node);
+			e.iteration = i;
+			heap.push(e);
+		}
+		// Pick the best gate and remove it
+		int bestK = heap.top().node;
+		heap.pop();
+		sol.push_back(bestK);
+		sketch_->merge(merged, sketch_->getSketch(bestK), sketch_->getSketchLength(bestK));
+	}
+	return sol;
+}
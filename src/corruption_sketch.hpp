@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#ifndef MOOSIC_CORRUPTION_SKETCH_H
+#define MOOSIC_CORRUPTION_SKETCH_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Summary of the output corruption data of all lockable signals, built from a stream of test vector blocks
+ *
+ * For each signal, it keeps the exact number of corrupted (output, test vector) pairs, a fingerprint of the
+ * corruption data to detect equivalent signals, and a bottom-k sketch of the corrupted pairs:
+ * the k smallest hashes of the pairs. The union of several sketches estimates the size of the union of the
+ * corresponding sets, which is what the greedy optimization of corruption cover needs.
+ *
+ * Memory usage only depends on the number of signals and the sketch size, not on the number of test vectors.
+ */
+class CorruptionSketch
+{
+      public:
+	/**
+	 * @brief Initialize an empty sketch
+	 */
+	CorruptionSketch(int nbSignals, int nbOutputs, int sketchSize);
+
+	/**
+	 * @brief Add the corruption data of a signal for a block of test vectors
+	 *
+	 * The data is indexed by output then by test vector word, with nbWords words per output.
+	 * Calls for different signals may run concurrently.
+	 */
+	void addRow(int signal, int firstWord, int nbWords, const std::uint64_t *data);
+
+	/**
+	 * @brief Record the total number of 64-bit test vector words, once all blocks are added, and sort the sketches
+	 */
+	void finish(int nbWords);
+
+	/**
+	 * @brief Allow more blocks to be added after finish, putting the sketches back in heaps
+	 *
+	 * Together with finish, this gives intermediate results without copying the sketch.
+	 */
+	void resume();
+
+	/**
+	 * @brief Number of signals
+	 */
+	int nbSignals() const { return nbSignals_; }
+
+	/**
+	 * @brief Number of outputs
+	 */
+	int nbOutputs() const { return nbOutputs_; }
+
+	/**
+	 * @brief Number of 64-bit test vector words per output
+	 */
+	int nbWords() const { return nbWords_; }
+
+	/**
+	 * @brief Maximum number of hashes kept per signal
+	 */
+	int sketchSize() const { return sketchSize_; }
+
+	/**
+	 * @brief Exact number of corrupted (output, test vector) pairs for a signal
+	 */
+	long long count(int signal) const { return counts_[signal]; }
+
+	/**
+	 * @brief Order-independent fingerprint of the corruption data of a signal
+	 */
+	std::uint64_t fingerprint(int signal) const { return fingerprints_[signal]; }
+
+	/**
+	 * @brief Smallest hashes of the corrupted pairs of a signal, in increasing order once finished
+	 */
+	const std::uint64_t *getSketch(int signal) const { return hashes_.data() + (std::size_t)signal * sketchSize_; }
+
+	/**
+	 * @brief Number of hashes in the sketch of a signal
+	 */
+	int getSketchLength(int signal) const { return lengths_[signal]; }
+
+	/**
+	 * @brief Estimate the number of distinct elements from a union of sketches (sorted and truncated to sketchSize)
+	 */
+	double estimateCount(const std::vector<std::uint64_t> &merged) const;
+
+	/**
+	 * @brief Merge a sorted sketch into another, keeping the sketchSize smallest hashes
+	 */
+	void merge(std::vector<std::uint64_t> &merged, const std::uint64_t *sketch, int length) const;
+
+      private:
+	int nbSignals_;
+	int nbOutputs_;
+	int nbWords_;
+	int sketchSize_;
+	bool finished_;
+	std::vector<long long> counts_;
+	std::vector<std::uint64_t> fingerprints_;
+	// Per-signal max-heap of the smallest hashes, sorted when finished
+	std::vector<std::uint64_t> hashes_;
+	std::vector<int> lengths_;
+};
+
+/**
+ * @brief Variant of OutputCorruptionOptimizer that works on sketches
+ *
+ * The corruption cover is estimated from the sketches, while the corruption rate is exact.
+ * Equivalent signals are detected with their fingerprint.
+ */
+class SketchCorruptionOptimizer
+{
+      public:
+	/**
+	 * @brief Solution of the optimization: list of nodes
+	 */
+	using Solution = std::vector<int>;
+
+	/**
+	 * @brief Initialize the optimizer from a finished sketch, shared without copy
+	 */
+	SketchCorruptionOptimizer(std::shared_ptr<const CorruptionSketch> sketch);
+
+	/**
+	 * @brief Number of lockable signals
+	 */
+	int nbNodes() const { return sketch_->nbSignals(); }
+
+	/**
+	 * @brief Number of 64-bit output corruption data
+	 */
+	int nbData() const { return sketch_->nbOutputs() * sketch_->nbWords(); }
+
+	/**
+	 * @brief Get nodes with unique corruption patterns
+	 *
+	 * @param preLocked Nodes considered already locked, which will be removed as well as their equivalents
+	 */
+	std::vector<int> getUniqueNodes(const std::vector<int> &preLocked = std::vector<int>()) const;
+
+	/**
+	 * @brief Estimate the proportion of signals corrupted at least once
+	 */
+	float corruptionCover(const Solution &solution) const;
+
+	/**
+	 * @brief Obtain the proportion of signals corrupted (one signal may be corrupted more than once)
+	 */
+	float corruptionRate(const Solution &solution) const;
+
+	/**
+	 * @brief Obtain the estimated corruption cover and the corruption rate of every prefix of a solution, in a single pass
+	 */
+	void corruptionCurve(const Solution &solution, std::vector<float> &cover, std::vector<float> &rate) const;
+
+	/**
+	 * @brief Maximize the estimated output corruption by picking one best gate to lock at a time
+	 *
+	 * Same ordering as OutputCorruptionOptimizer::solveGreedy, with estimated coverage.
+	 */
+	Solution solveGreedy(int maxNumber, const Solution &preLocked) const;
+
+      private:
+	/**
+	 * @brief Estimate the number of corrupted pairs that a node adds to a solution, given the merged sketch of the solution
+	 */
+	double estimateAdditionalCorruption(const std::vector<std::uint64_t> &merged, int node) const;
+
+      private:
+	std::shared_ptr<const CorruptionSketch> sketch_;
+	// Lowest index of a node with the same corruption data
+	std::vector<int> representative_;
+	std::vector<int> uniqueNodes_;
+};
+
+#endif
@@ -102,9 +102,9 @@ static IdString get_output_portname(Cell *cell)
 }
 
 /**
- * @brief Lock the gates in the module given a key bit value; return the input key wires
+ * @brief Lock the gates in the module given a key bit value; return the locking gates
  */
-void lock_gates(Module *module, const std::vector<Cell *> &cells, SigSpec key, const std::vector<bool> &key_values)
+std::vector<Cell *> lock_gates(Module *module, const std::vector<Cell *> &cells, SigSpec key, const std::vector<bool> &key_values)
 {
 
 	if (GetSize(cells) != GetSize(key_values)) {
@@ -113,11 +113,13 @@ void lock_gates(Module *module, const std::vector<Cell *> &cells, SigSpec key, c
 	if (GetSize(cells) != GetSize(key)) {
 		log_error("Number of cells to lock %d does not match the key length %d\n", GetSize(cells), GetSize(key));
 	}
+	std::vector<Cell *> gates;
 	for (int i = 0; i < GetSize(cells); ++i) {
 		bool key_value = key_values[i];
 		IdString port = get_output_portname(cells[i]);
-		insert_xor_locking_gate(module, cells[i], port, key[i], key_value);
+		gates.push_back(insert_xor_locking_gate(module, cells[i], port, key[i], key_value));
 	}
+	return gates;
 }
 
 /**
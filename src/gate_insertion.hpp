@@ -27,9 +27,9 @@ Wire *add_key_input(Module *module, int width);
 void lock_gates(Module *module, const std::vector<IdString> &names, SigSpec key, const std::vector<bool> &key_values);
 
 /**
- * @brief Lock the gates in the module by object and key bit value
+ * @brief Lock the gates in the module by object and key bit value; return the Xor/Xnor locking gates, in the same order
  */
-void lock_gates(Module *module, const std::vector<Cell *> &names, SigSpec key, const std::vector<bool> &key_values);
+std::vector<Cell *> lock_gates(Module *module, const std::vector<Cell *> &names, SigSpec key, const std::vector<bool> &key_values);
 
 /**
  * @brief Mix the gates in the module by name and key bit value
@@ -3,11 +3,12 @@
  */
 
 #include "logic_locking_analyzer.hpp"
+#include "parallel.hpp"
 
 #include "kernel/celltypes.h"
 
 #include <bitset>
-#include <random>
+#include <stdexcept>
 
 #ifdef DEBUG_LOGIC_SIMULATION
 constexpr bool check_sim = true;
@@ -17,13 +18,34 @@ constexpr bool check_sim = false;
 
 USING_YOSYS_NAMESPACE
 
-LogicLockingAnalyzer::LogicLockingAnalyzer(RTLIL::Module *module) : module_(module)
+LogicLockingAnalyzer::LogicLockingAnalyzer(RTLIL::Module *module, bool strashing)
+    : module_(module), strashing_(strashing), sim_tv_(-1), nb_threads_(1), nb_cycles_(1), shard_(0), nb_shards_(1), nb_simulated_nodes_(0),
+      nb_simulated_pairs_(0), log_buffer_(nullptr)
 {
 	comb_inputs_ = get_comb_inputs();
 	comb_outputs_ = get_comb_outputs();
-	init_wire_to_cells();
-	init_wire_to_wires();
 	init_aig();
+	compact_aig_ = CompactAIG(aig_);
+	output_support_ = OutputSupport(compact_aig_);
+	sim_ = IncrementalSimulation(compact_aig_);
+}
+
+/**
+ * @brief Sort bits by wire name and offset, so that their order does not depend on the hashing of the module
+ */
+static pool<SigBit> sort_bits(const pool<SigBit> &bits)
+{
+	std::vector<SigBit> sorted(bits.begin(), bits.end());
+	std::sort(sorted.begin(), sorted.end(), [](SigBit a, SigBit b) {
+		if (!a.wire || !b.wire) {
+			return a.wire == nullptr && (b.wire != nullptr || a.data < b.data);
+		}
+		if (a.wire != b.wire) {
+			return a.wire->name.str() < b.wire->name.str();
+		}
+		return a.offset < b.offset;
+	});
+	return pool<SigBit>(sorted.begin(), sorted.end());
 }
 
 pool<SigBit> LogicLockingAnalyzer::get_comb_inputs() const
@@ -49,7 +71,7 @@ pool<SigBit> LogicLockingAnalyzer::get_comb_inputs() const
 			}
 		}
 	}
-	return ret;
+	return sort_bits(ret);
 }
 
 pool<SigBit> LogicLockingAnalyzer::get_comb_outputs() const
@@ -75,14 +97,39 @@ pool<SigBit> LogicLockingAnalyzer::get_comb_outputs() const
 			}
 		}
 	}
+	return sort_bits(ret);
+}
+
+std::vector<std::pair<int, int>> LogicLockingAnalyzer::get_registers() const
+{
+	dict<SigBit, int> input_index;
+	for (SigBit b : comb_inputs_) {
+		input_index.emplace(b, GetSize(input_index));
+	}
+	dict<SigBit, int> output_index;
+	for (SigBit b : comb_outputs_) {
+		output_index.emplace(b, GetSize(output_index));
+	}
+	std::vector<std::pair<int, int>> ret;
+	for (Cell *cell : module_->cells()) {
+		if (!RTLIL::builtin_ff_cell_types().count(cell->type) || !cell->hasPort(ID::D) || !cell->hasPort(ID::Q)) {
+			continue;
+		}
+		SigSpec d = cell->getPort(ID::D);
+		SigSpec q = cell->getPort(ID::Q);
+		for (int i = 0; i < std::min(GetSize(d), GetSize(q)); ++i) {
+			ret.emplace_back(output_index.at(d[i]), input_index.at(q[i]));
+		}
+	}
+	// Same order in every process
+	std::sort(ret.begin(), ret.end());
 	return ret;
 }
 
 std::vector<SigBit> LogicLockingAnalyzer::get_lockable_signals() const
 {
 	std::vector<SigBit> signals;
-	for (auto it : module_->cells_) {
-		Cell *cell = it.second;
+	for (Cell *cell : get_lockable_cells()) {
 		for (auto conn : cell->connections()) {
 			if (cell->output(conn.first) && conn.second.size() == 1) {
 				signals.emplace_back(conn.second);
@@ -94,9 +141,18 @@ std::vector<SigBit> LogicLockingAnalyzer::get_lockable_signals() const
 }
 
 std::vector<Cell *> LogicLockingAnalyzer::get_lockable_cells() const
+{
+	std::vector<Cell *> cells = get_lockable_cells(module_);
+	if (!locking_gate_set_.empty()) {
+		cells.erase(std::remove_if(cells.begin(), cells.end(), [&](Cell *c) { return locking_gate_set_.count(c) != 0; }), cells.end());
+	}
+	return cells;
+}
+
+std::vector<Cell *> LogicLockingAnalyzer::get_lockable_cells(Module *module)
 {
 	std::vector<Cell *> cells;
-	for (auto it : module_->cells_) {
+	for (auto it : module->cells_) {
 		Cell *cell = it.second;
 		for (auto conn : cell->connections()) {
 			if (cell->output(conn.first) && conn.second.size() == 1) {
@@ -105,137 +161,209 @@ std::vector<Cell *> LogicLockingAnalyzer::get_lockable_cells() const
 			}
 		}
 	}
+	// Sort by name, so that signal indices are the same in every process working on the design
+	std::sort(cells.begin(), cells.end(), [](Cell *a, Cell *b) { return a->name.str() < b->name.str(); });
 	return cells;
 }
 
 void LogicLockingAnalyzer::gen_test_vectors(int nb, size_t seed)
 {
-	std::mt19937 rgen(seed);
-	std::uniform_int_distribution<std::uint64_t> dist;
-	test_vectors_.clear();
-	for (int i = 0; i < (nb + 63) / 64; ++i) {
-		std::vector<std::uint64_t> tv;
-		std::uint64_t mask = -1;
-		if (nb - 64 * i < 64) {
-			mask = (((std::uint64_t)1) << (nb - 64 * i)) - 1;
-		}
-		for (SigBit b : comb_inputs_) {
-			tv.push_back(dist(rgen) & mask);
-		}
-		test_vectors_.push_back(tv);
+	test_vectors_ = TestVectorSource::random(GetSize(comb_inputs_), nb, seed);
+	clear_simulation_cache();
+}
+
+void LogicLockingAnalyzer::load_test_vectors(const std::string &filename)
+{
+	log_stimulus_columns(filename);
+	try {
+		test_vectors_ = TestVectorSource::fromFile(filename, GetSize(comb_inputs_));
+	} catch (const std::runtime_error &e) {
+		log_error("%s\n", e.what());
 	}
+	clear_simulation_cache();
 }
 
-void LogicLockingAnalyzer::init_wire_to_cells()
+void LogicLockingAnalyzer::log_stimulus_columns(const std::string &filename) const
 {
-	wire_to_cells_.clear();
-	for (RTLIL::Cell *cell : module_->cells()) {
-		for (auto it : cell->connections()) {
-			if (cell->input(it.first)) {
-				for (SigBit b : it.second) {
-					auto it = wire_to_cells_.insert(b).first;
-					it->second.insert(cell);
+	// Consecutive bits of a wire are grouped in a single range
+	std::vector<SigBit> bits(comb_inputs_.begin(), comb_inputs_.end());
+	std::string message = stringf("Columns of the %d inputs of module %s in %s:\n", GetSize(bits), RTLIL::unescape_id(module_->name).c_str(),
+				      filename.c_str());
+	for (int i = 0; i < GetSize(bits);) {
+		int j = i + 1;
+		if (bits[i].wire) {
+			int step = 0;
+			while (j < GetSize(bits) && bits[j].wire == bits[i].wire) {
+				int d = bits[j].offset - bits[j - 1].offset;
+				if ((d != 1 && d != -1) || (step != 0 && d != step)) {
+					break;
 				}
+				step = d;
+				++j;
 			}
 		}
+		std::string columns = j == i + 1 ? stringf("%d", i) : stringf("%d-%d", i, j - 1);
+		std::string name;
+		if (!bits[i].wire) {
+			name = bits[i].data == State::S1 ? "1'1" : "1'0";
+		} else if (j == i + 1) {
+			name = stringf("%s[%d]", RTLIL::unescape_id(bits[i].wire->name).c_str(), bits[i].offset);
+		} else {
+			name = stringf("%s[%d:%d]", RTLIL::unescape_id(bits[i].wire->name).c_str(), bits[i].offset, bits[j - 1].offset);
+		}
+		message += stringf("\t%s: %s\n", columns.c_str(), name.c_str());
+		i = j;
 	}
+	log_message(message);
 }
 
-void LogicLockingAnalyzer::init_wire_to_wires()
+void LogicLockingAnalyzer::clear_simulation_cache()
 {
-	wire_to_wires_.clear();
-	for (auto it : module_->connections()) {
-		SigSpec a = it.first;
-		SigSpec b = it.second;
-		if (GetSize(a) != GetSize(b)) {
-			log_error("A connection doesn't have same-size signals on both sides");
-			continue;
-		}
-		for (int i = 0; i < GetSize(a); ++i) {
-			SigBit sig_a = a[i];
-			SigBit sig_b = b[i];
-			if (!sig_a.is_wire() || !sig_b.is_wire()) {
-				continue;
-			}
-			if (!wire_to_wires_.count(sig_b)) {
-				wire_to_wires_[sig_b] = pool<SigBit>();
-			}
-			wire_to_wires_[sig_b].emplace(sig_a);
-		}
-	}
+	sim_tv_ = -1;
+	golden_outputs_.clear();
+	golden_outputs_.resize(nb_test_vectors());
+	toggled_outputs_.clear();
+	toggled_outputs_.resize(compact_aig_.nbVariables());
+	nb_toggled_outputs_.assign(compact_aig_.nbVariables(), 0);
 }
 
 void LogicLockingAnalyzer::init_aig()
 {
+	sigmap_.set(module_);
 	wire_to_aig_.clear();
-	dirty_bits_.clear();
+	topo_cells_.clear();
 	aig_ = MiniAIG(comb_inputs_.size());
+	aig_.setStrashing(strashing_);
 	int i = 0;
 	for (SigBit bit : comb_inputs_) {
-		wire_to_aig_.emplace(bit, aig_.getInput(i));
+		wire_to_aig_.emplace(sigmap_(bit), aig_.getInput(i));
 		log_debug("Adding input %s --> %d\n", log_id(bit.wire->name), aig_.getInput(i).variable());
 		++i;
-		dirty_bits_.insert(bit);
-	}
-
-	// Handle direct connections to constants
-	for (auto it : module_->connections()) {
-		SigSpec a(it.first);
-		SigSpec b(it.second);
-		for (int i = 0; i < GetSize(a); ++i) {
-			SigBit sig_a = a[i];
-			SigBit sig_b = b[i];
-			if (sig_a.is_wire() && !sig_b.is_wire()) {
-				log_debug("Adding constant wire %s\n", log_id(sig_a.wire->name));
-				wire_to_aig_[sig_a] = sig_b.data == State::S0 ? Lit::zero() : Lit::one();
-				dirty_bits_.emplace(sig_a);
+	}
+
+	// Index the combinatorial cells and the bits they drive
+	std::vector<Cell *> cells;
+	idict<SigBit> bit_index;
+	std::vector<std::uint8_t> driven;
+	for (Cell *cell : module_->cells()) {
+		if (!yosys_celltypes.cell_evaluable(cell->type)) {
+			continue;
+		}
+		cells.push_back(cell);
+		for (auto it : cell->connections()) {
+			if (!cell->output(it.first)) {
+				continue;
 			}
-			if (sig_b.is_wire() && !sig_a.is_wire()) {
-				log_debug("Adding constant wire %s\n", log_id(sig_b.wire->name));
-				wire_to_aig_[sig_b] = sig_a.data == State::S0 ? Lit::zero() : Lit::one();
-				dirty_bits_.emplace(sig_b);
+			for (SigBit b : sigmap_(it.second)) {
+				if (b.wire) {
+					int ind = bit_index(b);
+					driven.resize(bit_index.size());
+					driven[ind] = 1;
+				}
 			}
 		}
 	}
 
-	// TODO: unify traversal with a single topo sort
-	while (1) {
-		if (dirty_bits_.empty()) {
-			break;
-		}
-		pool<SigBit> next_dirty;
-		pool<RTLIL::Cell *> dirty_cells;
-		for (SigBit b : dirty_bits_) {
-			for (RTLIL::Cell *cell : wire_to_cells_[b]) {
-				dirty_cells.insert(cell);
+	// Count the inputs of each cell that are driven by another combinatorial cell
+	std::vector<int> nb_pending(cells.size(), 0);
+	std::vector<std::vector<int>> readers(bit_index.size());
+	for (int c = 0; c < GetSize(cells); ++c) {
+		Cell *cell = cells[c];
+		pool<int> pending;
+		for (auto it : cell->connections()) {
+			if (!cell->input(it.first)) {
+				continue;
 			}
-			// Handle direct connections by adding the connected wires to the dirty list
-			if (wire_to_wires_.count(b)) {
-				for (SigBit c : wire_to_wires_[b]) {
-					if (!state_.count(c)) {
-						wire_to_aig_[c] = aig_.addBuffer(wire_to_aig_[b]);
-						next_dirty.emplace(c);
+			for (SigBit b : sigmap_(it.second)) {
+				if (b.wire && bit_index.count(b)) {
+					int ind = bit_index.at(b);
+					if (driven[ind] && pending.insert(ind).second) {
+						readers[ind].push_back(c);
 					}
 				}
 			}
 		}
-		dirty_bits_ = next_dirty;
-		for (RTLIL::Cell *cell : dirty_cells) {
-			cell_to_aig(cell);
+		nb_pending[c] = GetSize(pending);
+	}
+
+	// Single topological traversal: convert a cell once all its inputs are available
+	for (int c = 0; c < GetSize(cells); ++c) {
+		if (nb_pending[c] == 0) {
+			topo_cells_.push_back(cells[c]);
+		}
+	}
+	for (int k = 0; k < GetSize(topo_cells_); ++k) {
+		Cell *cell = topo_cells_[k];
+		cell_to_aig(cell);
+		for (auto it : cell->connections()) {
+			if (!cell->output(it.first)) {
+				continue;
+			}
+			for (SigBit b : sigmap_(it.second)) {
+				if (!b.wire) {
+					continue;
+				}
+				for (int r : readers[bit_index.at(b)]) {
+					if (--nb_pending[r] == 0) {
+						topo_cells_.push_back(cells[r]);
+					}
+				}
+			}
 		}
 	}
-	dirty_bits_.clear();
+	if (GetSize(topo_cells_) != GetSize(cells)) {
+		log_error("Combinatorial loop detected: %d cells could not be ordered\n", GetSize(cells) - GetSize(topo_cells_));
+	}
 
 	for (SigBit bit : comb_outputs_) {
 		if (bit.wire) {
-			log_debug("Adding output %s --> %d\n", log_id(bit.wire->name), wire_to_aig_.at(bit).variable());
+			if (!has_aig_lit(bit)) {
+				log_error("Output %s is not driven by a supported combinatorial cell\n", log_signal(bit));
+			}
+			log_debug("Adding output %s --> %d\n", log_id(bit.wire->name), get_aig_lit(bit).variable());
 		} else {
 			log_debug("Adding constant output\n");
 		}
-		aig_.addOutput(wire_to_aig_.at(bit));
+		aig_.addOutput(get_aig_lit(bit));
 	}
 }
 
+void LogicLockingAnalyzer::add_locking_gates(const std::vector<Cell *> &locked_cells, const std::vector<Cell *> &gates)
+{
+	log_assert(GetSize(locked_cells) == GetSize(gates));
+	for (int i = 0; i < GetSize(gates); ++i) {
+		Cell *gate = gates[i];
+		if (!gate->type.in(ID($xor), ID($xnor))) {
+			log_error("Locking gate %s of type %s is not supported by the incremental analysis\n", log_id(gate->name), log_id(gate->type));
+		}
+		SigBit locked_bit(gate->getPort(ID::A));
+		SigBit out_bit(gate->getPort(ID::Y));
+		// Locked wires are new and have no alias in the SigMap
+		set_aig_lit(locked_bit, get_aig_lit(out_bit));
+		// An xnor gate is the identity with a key bit of 1, a xor gate with 0
+		key_values_[SigBit(gate->getPort(ID::B))] = gate->type == ID($xnor);
+		locking_gates_[locked_cells[i]] = gate;
+		locking_gate_set_.insert(gate);
+	}
+}
+
+bool LogicLockingAnalyzer::has_aig_lit(SigBit bit) const
+{
+	SigBit b = sigmap_(bit);
+	return !b.wire || wire_to_aig_.count(b);
+}
+
+Lit LogicLockingAnalyzer::get_aig_lit(SigBit bit) const
+{
+	SigBit b = sigmap_(bit);
+	if (!b.wire) {
+		return b.data == State::S0 ? Lit::zero() : Lit::one();
+	}
+	return wire_to_aig_.at(b);
+}
+
+void LogicLockingAnalyzer::set_aig_lit(SigBit bit, Lit lit) { wire_to_aig_[sigmap_(bit)] = lit; }
+
 bool LogicLockingAnalyzer::has_valid_port(Cell *cell, const IdString &port_name) const
 {
 	if (!cell->hasPort(port_name)) {
@@ -245,7 +373,7 @@ bool LogicLockingAnalyzer::has_valid_port(Cell *cell, const IdString &port_name)
 	if (spec.size() != 1) {
 		return false;
 	}
-	return wire_to_aig_.count(spec);
+	return has_aig_lit(spec);
 }
 
 void LogicLockingAnalyzer::cell_to_aig(Cell *cell)
@@ -264,28 +392,28 @@ void LogicLockingAnalyzer::cell_to_aig(Cell *cell)
 	has_y = has_valid_port(cell, ID::Y);
 
 	if (has_a)
-		sig_a = wire_to_aig_[cell->getPort(ID::A)];
+		sig_a = get_aig_lit(cell->getPort(ID::A));
 	if (has_b)
-		sig_b = wire_to_aig_[cell->getPort(ID::B)];
+		sig_b = get_aig_lit(cell->getPort(ID::B));
 	if (has_c)
-		sig_c = wire_to_aig_[cell->getPort(ID::C)];
+		sig_c = get_aig_lit(cell->getPort(ID::C));
 	if (has_d)
-		sig_d = wire_to_aig_[cell->getPort(ID::D)];
+		sig_d = get_aig_lit(cell->getPort(ID::D));
 	if (has_s)
-		sig_s = wire_to_aig_[cell->getPort(ID::S)];
+		sig_s = get_aig_lit(cell->getPort(ID::S));
 	if (has_y)
-		sig_y = wire_to_aig_[cell->getPort(ID::Y)];
+		sig_y = get_aig_lit(cell->getPort(ID::Y));
 
 	if (has_y) {
 		return;
 	}
 
+	int first_node = aig_.nbNodes();
 	if (cell->type.in(ID($not), ID($_NOT_), ID($pos), ID($_BUF_))) {
 		if (has_a) {
 			bool inv = cell->type.in(ID($not), ID($_NOT_));
 			Lit res = aig_.addBuffer(inv ? sig_a.inv() : sig_a);
-			wire_to_aig_[cell->getPort(ID::Y)] = res;
-			dirty_bits_.insert(cell->getPort(ID::Y));
+			set_aig_lit(cell->getPort(ID::Y), res);
 		}
 	} else if (cell->type.in(ID($and), ID($_AND_), ID($_NAND_), ID($or), ID($_OR_), ID($_NOR_), ID($xor), ID($xnor), ID($_XOR_), ID($_XNOR_),
 				 ID($_ANDNOT_), ID($_ORNOT_))) {
@@ -310,8 +438,7 @@ void LogicLockingAnalyzer::cell_to_aig(Cell *cell)
 			else
 				log_error("Cell type not handled");
 
-			wire_to_aig_[cell->getPort(ID::Y)] = res;
-			dirty_bits_.insert(cell->getPort(ID::Y));
+			set_aig_lit(cell->getPort(ID::Y), res);
 		}
 	} else if (cell->type.in(ID($mux), ID($_MUX_), ID($_NMUX_))) {
 		if (has_a && has_b && has_s) {
@@ -319,220 +446,191 @@ void LogicLockingAnalyzer::cell_to_aig(Cell *cell)
 			if (cell->type.in(ID($_NMUX))) {
 				res = res.inv();
 			}
-			wire_to_aig_[cell->getPort(ID::Y)] = res;
-			dirty_bits_.insert(cell->getPort(ID::Y));
+			set_aig_lit(cell->getPort(ID::Y), res);
 		}
 	} else if (cell->type.in(ID($_AOI3_))) {
 		if (has_a && has_b && has_c) {
 			Lit res = aig_.addNor(aig_.addAnd(sig_a, sig_b), sig_c);
-			wire_to_aig_[cell->getPort(ID::Y)] = res;
-			dirty_bits_.insert(cell->getPort(ID::Y));
+			set_aig_lit(cell->getPort(ID::Y), res);
 		}
 	} else if (cell->type.in(ID($_OAI3_))) {
 		if (has_a && has_b && has_c) {
 			Lit res = aig_.addNand(aig_.addOr(sig_a, sig_b), sig_c);
-			wire_to_aig_[cell->getPort(ID::Y)] = res;
-			dirty_bits_.insert(cell->getPort(ID::Y));
+			set_aig_lit(cell->getPort(ID::Y), res);
 		}
 	} else if (cell->type.in(ID($_AOI4_))) {
 		if (has_a && has_b && has_c && has_d) {
 			Lit res = aig_.addNor(aig_.addAnd(sig_a, sig_b), aig_.addAnd(sig_c, sig_d));
-			wire_to_aig_[cell->getPort(ID::Y)] = res;
-			dirty_bits_.insert(cell->getPort(ID::Y));
+			set_aig_lit(cell->getPort(ID::Y), res);
 		}
 	} else if (cell->type.in(ID($_OAI4_))) {
 		if (has_a && has_b && has_c && has_d) {
 			Lit res = aig_.addNand(aig_.addOr(sig_a, sig_b), aig_.addOr(sig_c, sig_d));
-			wire_to_aig_[cell->getPort(ID::Y)] = res;
-			dirty_bits_.insert(cell->getPort(ID::Y));
+			set_aig_lit(cell->getPort(ID::Y), res);
 		}
 	} else {
 		log_error("Cell %s has type %s which is not supported\n", log_id(cell->name), log_id(cell->type));
 	}
-	log_debug("Converting cell %s of type %s, wire %s--> %d\n", log_id(cell->name), log_id(cell->getPort(ID::Y).as_wire()->name),
-		  log_id(cell->type), wire_to_aig_[cell->getPort(ID::Y)].variable());
-}
-
-RTLIL::State invert_state(RTLIL::State val)
-{
-	if (val == State::S0) {
-		return State::S1;
-	} else if (val == State::S1) {
-		return State::S0;
-	} else {
-		log_error("Invalid state");
+	if (has_valid_port(cell, ID::Y)) {
+		// The output is lockable: it must not be merged with other signals
+		SigBit y = cell->getPort(ID::Y);
+		set_aig_lit(y, aig_.makePrivate(get_aig_lit(y), first_node));
+		log_debug("Converting cell %s of type %s, wire %s--> %d\n", log_id(cell->name), log_id(cell->type), log_signal(cell->getPort(ID::Y)),
+			  get_aig_lit(cell->getPort(ID::Y)).variable());
 	}
 }
 
-void LogicLockingAnalyzer::set_input_state(const dict<SigBit, State> &state)
+/**
+ * @brief Value of a bit of a port for the reference simulation, extended to the output width
+ */
+static std::uint64_t get_extended_value(const dict<SigBit, std::uint64_t> &values, const SigMap &sigmap, const SigSpec &sig, int i, bool is_signed)
 {
-	state_ = state;
-	dirty_bits_.clear();
-	for (auto &it : state_) {
-		if (toggled_bits_.count(it.first)) {
-			it.second = invert_state(it.second);
-		}
-		dirty_bits_.insert(it.first);
+	if (sig.size() == 0) {
+		return 0;
 	}
-
-	// Handle direct connections to constants
-	for (auto it : module_->connections()) {
-		SigBit a(it.first);
-		SigBit b(it.second);
-		if (a.is_wire() && !b.is_wire()) {
-			state_[a] = b.data;
-			dirty_bits_.insert(a);
-		}
-		if (b.is_wire() && !a.is_wire()) {
-			state_[b] = a.data;
-			dirty_bits_.insert(b);
+	if (i >= sig.size()) {
+		if (!is_signed) {
+			return 0;
 		}
+		i = sig.size() - 1;
 	}
-}
-
-dict<SigBit, State> LogicLockingAnalyzer::get_output_state() const
-{
-	dict<SigBit, State> ret;
-	for (RTLIL::Wire *wire : module_->wires()) {
-		if (!wire->port_output) {
-			continue;
-		}
-		SigBit bit(wire);
-		if (state_.count(bit)) {
-			ret[bit] = state_.at(bit);
-		} else {
-			log_error("Signal not found in output %s\n", log_id(wire->name));
-		}
+	SigBit b = sigmap(sig[i]);
+	if (!b.wire) {
+		return b.data == State::S0 ? 0 : ~(std::uint64_t)0;
 	}
-	for (RTLIL::Cell *cell : module_->cells()) {
-		if (!yosys_celltypes.cell_evaluable(cell->type)) {
-			for (auto it : cell->connections()) {
-				if (cell->input(it.first)) {
-					SigBit bit = it.second.as_bit();
-					if (state_.count(bit)) {
-						ret[bit] = state_.at(bit);
-					} else {
-						log_error("Signal not found in cell input %s\n", log_id(cell->name));
-					}
-				}
-			}
-		}
+	auto it = values.find(b);
+	if (it == values.end()) {
+		log_error("Signal %s not simulated\n", log_signal(b));
 	}
-	return ret;
+	return it->second;
 }
 
-bool LogicLockingAnalyzer::has_state(SigSpec sig)
+static bool is_signed_port(Cell *cell, const IdString &param)
 {
-	for (auto bit : sig)
-		if (bit.wire != nullptr && !state_.count(bit))
-			return false;
-	return true;
-}
-
-RTLIL::Const LogicLockingAnalyzer::get_state(SigSpec sig)
-{
-	RTLIL::Const value;
-
-	for (auto bit : sig)
-		if (bit.wire == nullptr)
-			value.bits.push_back(bit.data);
-		else if (state_.count(bit))
-			value.bits.push_back(state_.at(bit));
-		else
-			value.bits.push_back(State::Sz);
-
-	return value;
+	return cell->hasParam(param) && cell->getParam(param).as_bool();
 }
 
-void LogicLockingAnalyzer::set_state(SigSpec sig, RTLIL::Const value)
+void LogicLockingAnalyzer::simulate_cell(Cell *cell, const pool<SigBit> &toggled_bits, dict<SigBit, std::uint64_t> &values) const
 {
-	log_assert(GetSize(sig) <= GetSize(value));
+	if (!cell->hasPort(ID::Y)) {
+		log_error("Cell %s of type %s cannot be evaluated", log_id(cell->name), log_id(cell->type));
+	}
+	SigSpec sig_y = cell->getPort(ID::Y);
+	SigSpec sig_a, sig_b, sig_c, sig_d, sig_s;
+	if (cell->hasPort(ID::A))
+		sig_a = cell->getPort(ID::A);
+	if (cell->hasPort(ID::B))
+		sig_b = cell->getPort(ID::B);
+	if (cell->hasPort(ID::C))
+		sig_c = cell->getPort(ID::C);
+	if (cell->hasPort(ID::D))
+		sig_d = cell->getPort(ID::D);
+	if (cell->hasPort(ID::S))
+		sig_s = cell->getPort(ID::S);
+	bool signed_a = is_signed_port(cell, ID::A_SIGNED);
+	bool signed_b = is_signed_port(cell, ID::B_SIGNED);
 
-	for (int i = 0; i < GetSize(sig); i++)
-		if (value[i] != State::Sa) {
-			State val = value[i];
-			if (toggled_bits_.count(sig[i])) {
-				val = invert_state(val);
+	// Evaluate each output bit on 64 test vectors at once; all supported cells are bitwise
+	for (int i = 0; i < sig_y.size(); ++i) {
+		std::uint64_t a = get_extended_value(values, sigmap_, sig_a, i, signed_a);
+		std::uint64_t b = get_extended_value(values, sigmap_, sig_b, i, signed_b);
+		std::uint64_t y;
+		if (cell->type.in(ID($not), ID($_NOT_))) {
+			y = ~a;
+		} else if (cell->type.in(ID($pos), ID($_BUF_))) {
+			y = a;
+		} else if (cell->type.in(ID($and), ID($_AND_))) {
+			y = a & b;
+		} else if (cell->type.in(ID($_NAND_))) {
+			y = ~(a & b);
+		} else if (cell->type.in(ID($or), ID($_OR_))) {
+			y = a | b;
+		} else if (cell->type.in(ID($_NOR_))) {
+			y = ~(a | b);
+		} else if (cell->type.in(ID($xor), ID($_XOR_))) {
+			y = a ^ b;
+		} else if (cell->type.in(ID($xnor), ID($_XNOR_))) {
+			y = ~(a ^ b);
+		} else if (cell->type.in(ID($_ANDNOT_))) {
+			y = a & ~b;
+		} else if (cell->type.in(ID($_ORNOT_))) {
+			y = a | ~b;
+		} else if (cell->type.in(ID($mux), ID($_MUX_), ID($_NMUX_))) {
+			std::uint64_t s = get_extended_value(values, sigmap_, sig_s, 0, false);
+			y = (a & ~s) | (b & s);
+			if (cell->type == ID($_NMUX_)) {
+				y = ~y;
 			}
-			state_[sig[i]] = val;
-			dirty_bits_.insert(sig[i]);
+		} else if (cell->type.in(ID($_AOI3_), ID($_OAI3_), ID($_AOI4_), ID($_OAI4_))) {
+			std::uint64_t c = get_extended_value(values, sigmap_, sig_c, i, false);
+			std::uint64_t d = get_extended_value(values, sigmap_, sig_d, i, false);
+			if (cell->type == ID($_AOI3_))
+				y = ~((a & b) | c);
+			else if (cell->type == ID($_OAI3_))
+				y = ~((a | b) & c);
+			else if (cell->type == ID($_AOI4_))
+				y = ~((a & b) | (c & d));
+			else
+				y = ~((a | b) & (c | d));
+		} else {
+			log_error("Cell %s of type %s cannot be evaluated", log_id(cell->name), log_id(cell->type));
 		}
+		SigBit out = sigmap_(sig_y[i]);
+		if (out.wire) {
+			values[out] = toggled_bits.count(out) ? ~y : y;
+		}
+	}
 }
 
 std::vector<std::uint64_t> LogicLockingAnalyzer::simulate_basic(int tv, const pool<SigBit> &toggled_bits)
 {
-	aig_.resetState();
-	std::vector<std::uint64_t> ret(comb_outputs_.size());
-	// Execute bit after bit
-	for (int ind = 0; ind < 64; ++ind) {
-		dict<SigBit, State> input_state;
-		int j = 0;
-		for (SigBit inp : comb_inputs_) {
-			bool bit = (test_vectors_[tv][j] >> ind) & 1;
-			input_state[inp] = bit ? State::S1 : State::S0;
-			++j;
-		}
-		toggled_bits_ = toggled_bits;
-		set_input_state(input_state);
-		while (1) {
-			if (dirty_bits_.empty()) {
-				break;
-			}
-			pool<SigBit> next_dirty;
-			pool<RTLIL::Cell *> dirty_cells;
-			for (SigBit b : dirty_bits_) {
-				for (RTLIL::Cell *cell : wire_to_cells_[b]) {
-					dirty_cells.insert(cell);
-				}
-				// Handle direct connections by adding the connected wires to the dirty list
-				if (wire_to_wires_.count(b)) {
-					for (SigBit c : wire_to_wires_[b]) {
-						if (!state_.count(c)) {
-							state_[c] = state_[b];
-							next_dirty.emplace(c);
-						}
-					}
-				}
-			}
-			dirty_bits_ = next_dirty;
-			for (RTLIL::Cell *cell : dirty_cells) {
-				simulate_cell(cell);
-			}
-		}
-		for (RTLIL::Wire *wire : module_->wires()) {
-			SigBit bit(wire);
-			if (!state_.count(bit)) {
-				log_error("\tWire %s not simulated\n", log_id(wire->name));
-			}
-		}
-		for (auto it : wire_to_aig_) {
-			State val = state_[it.first];
-			std::uint64_t aig_val = aig_.getValue(it.second);
-			if (val != State::S0) {
-				aig_val |= ((std::uint64_t)1) << ind;
-			}
-			aig_.setValue(it.second, aig_val);
-		}
-		dict<SigBit, State> output_state = get_output_state();
-		j = 0;
-		for (SigBit outp : comb_outputs_) {
-			State out_val = output_state.at(outp);
-			if (out_val != State::S0) {
-				ret[j] |= ((std::uint64_t)1) << ind;
-			}
-			++j;
+	pool<SigBit> toggled;
+	for (SigBit b : toggled_bits) {
+		toggled.insert(sigmap_(b));
+	}
+	dict<SigBit, std::uint64_t> values;
+	std::vector<std::uint64_t> inputs = test_vectors_.getBlock(tv);
+	int j = 0;
+	for (SigBit inp : comb_inputs_) {
+		SigBit b = sigmap_(inp);
+		std::uint64_t v = inputs[j++];
+		values[b] = toggled.count(b) ? ~v : v;
+	}
+	for (auto it : key_values_) {
+		values[it.first] = it.second ? ~(std::uint64_t)0 : 0;
+	}
+	// Cells are already in topological order; locking gates come right after the cell they lock
+	for (Cell *cell : topo_cells_) {
+		simulate_cell(cell, toggled, values);
+		auto gate = locking_gates_.find(cell);
+		if (gate != locking_gates_.end()) {
+			simulate_cell(gate->second, toggled, values);
 		}
 	}
+	std::vector<std::uint64_t> ret;
+	for (SigBit outp : comb_outputs_) {
+		ret.push_back(get_extended_value(values, sigmap_, outp, 0, false));
+	}
 	return ret;
 }
 
+void LogicLockingAnalyzer::load_test_vector(int tv)
+{
+	if (sim_tv_ == tv) {
+		return;
+	}
+	sim_.simulate(test_vectors_.getBlock(tv));
+	sim_tv_ = tv;
+}
+
 std::vector<std::uint64_t> LogicLockingAnalyzer::simulate_aig(int tv, const pool<SigBit> &toggled_bits)
 {
 	std::vector<Lit> toggling;
 	for (SigBit bit : toggled_bits) {
-		toggling.push_back(wire_to_aig_.at(bit));
+		toggling.push_back(get_simulation_lit(bit));
 	}
-	auto ret = aig_.simulateWithToggling(test_vectors_[tv], toggling);
+	load_test_vector(tv);
+	auto ret = toggling.empty() ? sim_.getOutputValues() : sim_.simulateWithToggling(toggling);
 	if (check_sim) {
 		auto ret_checked = simulate_basic(tv, toggled_bits);
 		if (ret_checked != ret) {
@@ -542,67 +640,29 @@ std::vector<std::uint64_t> LogicLockingAnalyzer::simulate_aig(int tv, const pool
 	return ret;
 }
 
-void LogicLockingAnalyzer::simulate_cell(RTLIL::Cell *cell)
-{
-	// Taken from passes/sat/sim.cc
-	if (yosys_celltypes.cell_evaluable(cell->type)) {
-		RTLIL::SigSpec sig_a, sig_b, sig_c, sig_d, sig_s, sig_y;
-		bool has_a, has_b, has_c, has_d, has_s, has_y;
-
-		has_a = cell->hasPort(ID::A);
-		has_b = cell->hasPort(ID::B);
-		has_c = cell->hasPort(ID::C);
-		has_d = cell->hasPort(ID::D);
-		has_s = cell->hasPort(ID::S);
-		has_y = cell->hasPort(ID::Y);
-
-		if (has_a)
-			sig_a = cell->getPort(ID::A);
-		if (has_b)
-			sig_b = cell->getPort(ID::B);
-		if (has_c)
-			sig_c = cell->getPort(ID::C);
-		if (has_d)
-			sig_d = cell->getPort(ID::D);
-		if (has_s)
-			sig_s = cell->getPort(ID::S);
-		if (has_y)
-			sig_y = cell->getPort(ID::Y);
-
-		// Simple (A -> Y) and (A,B -> Y) cells
-		if (has_a && !has_c && !has_d && !has_s && has_y) {
-			if (!has_state(sig_a) || !has_state(sig_b))
-				return;
-			set_state(sig_y, CellTypes::eval(cell, get_state(sig_a), get_state(sig_b)));
-			return;
-		}
-
-		// (A,B,C -> Y) cells
-		if (has_a && has_b && has_c && !has_d && !has_s && has_y) {
-			if (!has_state(sig_a) || !has_state(sig_b) || !has_state(sig_c))
-				return;
-			set_state(sig_y, CellTypes::eval(cell, get_state(sig_a), get_state(sig_b), get_state(sig_c)));
-			return;
-		}
-
-		// (A,S -> Y) cells
-		if (has_a && !has_b && !has_c && !has_d && has_s && has_y) {
-			if (!has_state(sig_a) || !has_state(sig_s))
-				return;
-			set_state(sig_y, CellTypes::eval(cell, get_state(sig_a), get_state(sig_s)));
-			return;
-		}
-
-		// (A,B,S -> Y) cells
-		if (has_a && has_b && !has_c && !has_d && has_s && has_y) {
-			if (!has_state(sig_a) || !has_state(sig_b) || !has_state(sig_s))
-				return;
-			set_state(sig_y, CellTypes::eval(cell, get_state(sig_a), get_state(sig_b), get_state(sig_s)));
-			return;
-		}
+const std::vector<std::uint64_t> &LogicLockingAnalyzer::get_golden_outputs(int tv)
+{
+	std::vector<std::uint64_t> &ret = golden_outputs_.at(tv);
+	if (ret.empty()) {
+		ret = simulate_aig(tv, {});
+	}
+	return ret;
+}
 
-		log_error("Cell %s of type %s cannot be evaluated", log_id(cell->name), log_id(cell->type));
+const std::vector<std::uint64_t> &LogicLockingAnalyzer::get_toggled_outputs(int tv, SigBit toggled_bit)
+{
+	// Toggling only depends on the AIG variable, so distinct bits mapped to the same variable share results
+	int var = get_simulation_lit(toggled_bit).variable();
+	std::vector<std::vector<std::uint64_t>> &by_tv = toggled_outputs_.at(var);
+	if (by_tv.empty()) {
+		by_tv.resize(nb_test_vectors());
+	}
+	std::vector<std::uint64_t> &ret = by_tv.at(tv);
+	if (ret.empty()) {
+		ret = simulate_aig(tv, {toggled_bit});
+		++nb_toggled_outputs_[var];
 	}
+	return ret;
 }
 
 float LogicLockingAnalyzer::compute_total_output_corruption(SigBit a)
@@ -642,8 +702,8 @@ std::vector<std::vector<std::uint64_t>> LogicLockingAnalyzer::compute_output_cor
 {
 	std::vector<std::vector<std::uint64_t>> ret(comb_outputs_.size());
 	for (int i = 0; i < nb_test_vectors(); ++i) {
-		auto no_toggle = simulate_aig(i, {});
-		auto toggle = simulate_aig(i, {a});
+		const auto &no_toggle = get_golden_outputs(i);
+		const auto &toggle = get_toggled_outputs(i, a);
 
 		for (size_t i = 0; i < no_toggle.size(); ++i) {
 			std::uint64_t t = toggle[i] ^ no_toggle[i];
@@ -653,41 +713,284 @@ std::vector<std::vector<std::uint64_t>> LogicLockingAnalyzer::compute_output_cor
 	return ret;
 }
 
-dict<Cell *, std::vector<std::vector<std::uint64_t>>> LogicLockingAnalyzer::compute_output_corruption_data()
+CorruptionMatrix LogicLockingAnalyzer::compute_output_corruption_data()
 {
+	int nb_signals = GetSize(get_lockable_cells());
+	// Only the rows of the shard are stored: signal shard_ + r * nb_shards_ is row r
+	int nb_rows = shard_ < nb_signals ? (nb_signals - shard_ + nb_shards_ - 1) / nb_shards_ : 0;
+	int nb_outputs = GetSize(comb_outputs_);
+	CorruptionMatrix data;
+	if (corruption_backing_file_.empty()) {
+		data = CorruptionMatrix(nb_rows, nb_outputs, nb_corruption_words());
+	} else {
+		data = CorruptionMatrix(nb_rows, nb_outputs, nb_corruption_words(), corruption_backing_file_);
+	}
+	// The wide simulation results go straight to the rows of the matrix, without the single-toggle cache
+	stream_output_corruption_data([&](int signal, int first_word, int nb_words, const std::uint64_t *block) {
+		int r = signal / nb_shards_;
+		for (int k = 0; k < nb_outputs; ++k) {
+			std::copy(block + (size_t)k * nb_words, block + (size_t)(k + 1) * nb_words, data.get(r, k) + first_word);
+		}
+	});
+	return data;
+}
+
+int LogicLockingAnalyzer::stream_output_corruption_data(
+  const std::function<void(int signal, int first_word, int nb_words, const std::uint64_t *data)> &callback, const std::function<bool(int nb_words)> &stop,
+  int words_per_block)
+{
+	if (nb_cycles_ > 1) {
+		return stream_sequential_output_corruption_data(callback, stop, words_per_block);
+	}
 	std::vector<SigBit> signals = get_lockable_signals();
-	std::vector<Cell *> cells = get_lockable_cells();
-	dict<Cell *, std::vector<std::vector<std::uint64_t>>> ret;
-	for (int i = 0; i < GetSize(signals); ++i) {
-		ret.emplace(cells[i], compute_output_corruption_data(signals[i]));
+	std::vector<Lit> lits;
+	for (SigBit s : signals) {
+		lits.push_back(get_simulation_lit(s));
+	}
+	int nb_outputs = GetSize(comb_outputs_);
+	// Only the signals of the shard are simulated. Process the signals of a fanout-free region together, so that they share
+	// a single toggled simulation
+	std::vector<int> order;
+	for (int j = 0; j < GetSize(signals); ++j) {
+		if (in_shard(j)) {
+			order.push_back(j);
+		}
+	}
+	int nb_signals = GetSize(order);
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return compact_aig_.getFanoutFreeRoot(lits[a].variable()) < compact_aig_.getFanoutFreeRoot(lits[b].variable());
+	});
+	int nb_threads = resolve_nb_threads(nb_threads_);
+	int nb_words = words_per_block > 0 ? words_per_block : nb_simulation_words();
+	std::vector<IncrementalSimulation> sims(nb_threads, IncrementalSimulation(compact_aig_, nb_words));
+	// Golden simulation of the current block, done once per thread
+	std::vector<int> sim_block(nb_threads, -1);
+	std::vector<std::vector<std::uint64_t>> rows(nb_threads);
+	const int chunk_size = 64;
+	int nb_processed = nb_test_vectors();
+	for (int tv = 0; tv < nb_test_vectors(); tv += nb_words) {
+		int block_words = std::min(nb_words, nb_test_vectors() - tv);
+		std::vector<std::uint64_t> inputs = get_wide_inputs(tv, nb_words);
+		parallel_run(nb_threads, (nb_signals + chunk_size - 1) / chunk_size, [&](int thread, int c) {
+			IncrementalSimulation &sim = sims[thread];
+			if (sim_block[thread] != tv) {
+				sim.simulate(inputs);
+				sim_block[thread] = tv;
+			}
+			const std::vector<std::uint64_t> &golden = sim.getOutputValues();
+			std::vector<std::uint64_t> &row = rows[thread];
+			row.resize((size_t)nb_outputs * block_words);
+			std::vector<int> chunk(order.begin() + c * chunk_size, order.begin() + std::min(nb_signals, (c + 1) * chunk_size));
+			std::vector<Lit> chunk_lits;
+			for (int j : chunk) {
+				chunk_lits.push_back(lits[j]);
+			}
+			auto toggles = sim.simulateSingleToggles(chunk_lits);
+			for (int jj = 0; jj < GetSize(chunk); ++jj) {
+				int j = chunk[jj];
+				const auto &toggle = toggles[jj];
+				std::fill(row.begin(), row.end(), 0);
+				for (int k : output_support_.getOutputs(lits[j].variable())) {
+					for (int w = 0; w < block_words; ++w) {
+						size_t ind = (size_t)k * nb_words + w;
+						row[(size_t)k * block_words + w] = toggle[ind] ^ golden[ind];
+					}
+				}
+				callback(j, tv, block_words, row.data());
+			}
+		});
+		if (stop && stop(tv + block_words)) {
+			nb_processed = tv + block_words;
+			break;
+		}
+	}
+	nb_simulated_nodes_ = 0;
+	for (const IncrementalSimulation &sim : sims) {
+		nb_simulated_nodes_ += sim.nbNodeEvaluations();
+	}
+	return nb_processed;
+}
+
+int LogicLockingAnalyzer::stream_sequential_output_corruption_data(
+  const std::function<void(int signal, int first_word, int nb_words, const std::uint64_t *data)> &callback, const std::function<bool(int nb_words)> &stop,
+  int words_per_block)
+{
+	std::vector<SigBit> signals = get_lockable_signals();
+	std::vector<int> simulated;
+	std::vector<Lit> lits;
+	for (int j = 0; j < GetSize(signals); ++j) {
+		lits.push_back(get_simulation_lit(signals[j]));
+		if (in_shard(j)) {
+			simulated.push_back(j);
+		}
+	}
+	int nb_simulated = GetSize(simulated);
+	int nb_outputs = GetSize(comb_outputs_);
+	int nb_sequences = nb_corruption_words();
+	int nb_threads = resolve_nb_threads(nb_threads_);
+	int nb_words = words_per_block > 0 ? words_per_block : std::max(1, std::min(CompactAIG::preferredNbWords(), nb_sequences));
+	std::vector<SequentialSimulation> sims(nb_threads, SequentialSimulation(compact_aig_, get_registers(), nb_words));
+	// Good machine of the current sequences, simulated once per thread
+	std::vector<int> sim_block(nb_threads, -1);
+	std::vector<std::vector<std::uint64_t>> rows(nb_threads);
+	const int chunk_size = 64;
+	int nb_processed = nb_sequences;
+	for (int seq = 0; seq < nb_sequences; seq += nb_words) {
+		int block_words = std::min(nb_words, nb_sequences - seq);
+		// Cycle c of sequence s is the test vector block s * nb_cycles + c
+		std::vector<std::vector<std::uint64_t>> inputs;
+		for (int c = 0; c < nb_cycles_; ++c) {
+			inputs.push_back(get_wide_inputs(seq * nb_cycles_ + c, nb_words, nb_cycles_));
+		}
+		parallel_run(nb_threads, (nb_simulated + chunk_size - 1) / chunk_size, [&](int thread, int c) {
+			SequentialSimulation &sim = sims[thread];
+			if (sim_block[thread] != seq) {
+				sim.simulate(inputs);
+				sim_block[thread] = seq;
+			}
+			std::vector<std::uint64_t> &row = rows[thread];
+			row.resize((size_t)nb_outputs * block_words);
+			for (int s = c * chunk_size; s < std::min(nb_simulated, (c + 1) * chunk_size); ++s) {
+				int j = simulated[s];
+				// Corruption may reach any output through the flip-flops
+				std::vector<std::uint64_t> corrupted = sim.simulateCorruption(lits[j]);
+				for (int k = 0; k < nb_outputs; ++k) {
+					for (int w = 0; w < block_words; ++w) {
+						row[(size_t)k * block_words + w] = corrupted[(size_t)k * nb_words + w];
+					}
+				}
+				callback(j, seq, block_words, row.data());
+			}
+		});
+		if (stop && stop(seq + block_words)) {
+			nb_processed = seq + block_words;
+			break;
+		}
+	}
+	nb_simulated_nodes_ = 0;
+	for (const SequentialSimulation &sim : sims) {
+		nb_simulated_nodes_ += sim.nbNodeEvaluations();
+	}
+	return nb_processed;
+}
+
+void LogicLockingAnalyzer::fill_simulation_cache(const std::vector<SigBit> &signals)
+{
+	wire_to_aig_lits_.clear();
+	for (SigBit s : signals) {
+		wire_to_aig_lits_.push_back(get_simulation_lit(s));
+	}
+	for (int tv = 0; tv < nb_test_vectors(); ++tv) {
+		get_golden_outputs(tv);
+	}
+	if (check_sim) {
+		// The reference simulation is not thread-safe
+		for (int tv = 0; tv < nb_test_vectors(); ++tv) {
+			for (SigBit s : signals) {
+				get_toggled_outputs(tv, s);
+			}
+		}
+		return;
+	}
+
+	// Allocate the cache entries beforehand, with a single task per variable, so that workers write to distinct entries.
+	// Variables partially filled by get_toggled_outputs are simulated again on all test vectors
+	std::vector<Lit> todo;
+	for (Lit l : wire_to_aig_lits_) {
+		int var = l.variable();
+		if (nb_toggled_outputs_.at(var) < nb_test_vectors()) {
+			toggled_outputs_[var].resize(nb_test_vectors());
+			nb_toggled_outputs_[var] = nb_test_vectors();
+			todo.push_back(l);
+		}
+	}
+	// Keep the signals of a fanout-free region together, so that they share a single toggled simulation
+	std::stable_sort(todo.begin(), todo.end(), [&](Lit a, Lit b) {
+		return compact_aig_.getFanoutFreeRoot(a.variable()) < compact_aig_.getFanoutFreeRoot(b.variable());
+	});
+	int nb_threads = resolve_nb_threads(nb_threads_);
+	int nb_words = nb_simulation_words();
+	std::vector<IncrementalSimulation> sims(nb_threads, IncrementalSimulation(compact_aig_, nb_words));
+	const int chunk_size = 64;
+	parallel_run(nb_threads, (GetSize(todo) + chunk_size - 1) / chunk_size, [&](int thread, int c) {
+		IncrementalSimulation &sim = sims[thread];
+		std::vector<Lit> chunk(todo.begin() + c * chunk_size, todo.begin() + std::min(GetSize(todo), (c + 1) * chunk_size));
+		for (int tv = 0; tv < nb_test_vectors(); tv += nb_words) {
+			sim.simulate(get_wide_inputs(tv, nb_words));
+			auto toggles = sim.simulateSingleToggles(chunk);
+			for (int j = 0; j < GetSize(chunk); ++j) {
+				auto &by_tv = toggled_outputs_[chunk[j].variable()];
+				for (int w = 0; w < nb_words && tv + w < nb_test_vectors(); ++w) {
+					extract_word(toggles[j], nb_words, w, by_tv[tv + w]);
+				}
+			}
+		}
+	});
+	for (const IncrementalSimulation &sim : sims) {
+		nb_simulated_nodes_ += sim.nbNodeEvaluations();
+	}
+}
+
+int LogicLockingAnalyzer::nb_simulation_words() const { return std::max(1, std::min(CompactAIG::preferredNbWords(), nb_test_vectors())); }
+
+std::vector<std::uint64_t> LogicLockingAnalyzer::get_wide_inputs(int tv, int nb_words, int stride) const
+{
+	int nb_inputs = GetSize(comb_inputs_);
+	std::vector<std::uint64_t> ret((size_t)nb_inputs * nb_words, 0);
+	std::vector<std::uint64_t> vals(nb_inputs);
+	for (int w = 0; w < nb_words && tv + w * stride < nb_test_vectors(); ++w) {
+		test_vectors_.getBlock(tv + w * stride, vals.data());
+		for (int i = 0; i < nb_inputs; ++i) {
+			ret[(size_t)i * nb_words + w] = vals[i];
+		}
 	}
 	return ret;
 }
 
+void LogicLockingAnalyzer::extract_word(const std::vector<std::uint64_t> &wide, int nb_words, int w, std::vector<std::uint64_t> &ret)
+{
+	ret.resize(wide.size() / nb_words);
+	for (size_t o = 0; o < ret.size(); ++o) {
+		ret[o] = wide[o * nb_words + w];
+	}
+}
+
+bool LogicLockingAnalyzer::check_pairwise_secure(const std::vector<int> &outputs, const std::uint64_t *no_toggle, const std::uint64_t *toggle_a,
+						 const std::uint64_t *toggle_b, const std::uint64_t *toggle_both, int both_stride, bool &same_impact)
+{
+	for (int i : outputs) {
+		std::uint64_t state_none = no_toggle[i];
+		std::uint64_t state_a = toggle_a[i];
+		std::uint64_t state_b = toggle_b[i];
+		std::uint64_t state_both = toggle_both[(size_t)i * both_stride];
+		std::uint64_t sensitive_a = ~(state_none ^ state_a) | ~(state_b ^ state_both);
+		std::uint64_t sensitive_b = ~(state_none ^ state_b) | ~(state_a ^ state_both);
+		if (sensitive_a != sensitive_b) {
+			// Not pairwise secure
+			return false;
+		}
+		if (state_a != state_b) {
+			// The two signals have different impact on the output
+			same_impact = false;
+		}
+	}
+	return true;
+}
+
 bool LogicLockingAnalyzer::is_pairwise_secure(SigBit a, SigBit b)
 {
 	bool same_impact = true;
+	std::vector<int> outputs(comb_outputs_.size());
+	for (int o = 0; o < GetSize(outputs); ++o) {
+		outputs[o] = o;
+	}
 	for (int i = 0; i < nb_test_vectors(); ++i) {
-		auto no_toggle = simulate_aig(i, {});
-		auto toggle_a = simulate_aig(i, {a});
-		auto toggle_b = simulate_aig(i, {b});
+		const auto &no_toggle = get_golden_outputs(i);
+		const auto &toggle_a = get_toggled_outputs(i, a);
+		const auto &toggle_b = get_toggled_outputs(i, b);
 		auto toggle_both = simulate_aig(i, {a, b});
-
-		for (size_t i = 0; i < no_toggle.size(); ++i) {
-			std::uint64_t state_none = no_toggle[i];
-			std::uint64_t state_a = toggle_a[i];
-			std::uint64_t state_b = toggle_b[i];
-			std::uint64_t state_both = toggle_both[i];
-			std::uint64_t sensitive_a = ~(state_none ^ state_a) | ~(state_b ^ state_both);
-			std::uint64_t sensitive_b = ~(state_none ^ state_b) | ~(state_a ^ state_both);
-			if (sensitive_a != sensitive_b) {
-				// Not pairwise secure
-				return false;
-			}
-			if (state_a != state_b) {
-				// The two signals have different impact on the output
-				same_impact = false;
-			}
+		if (!check_pairwise_secure(outputs, no_toggle.data(), toggle_a.data(), toggle_b.data(), toggle_both.data(), 1, same_impact)) {
+			return false;
 		}
 	}
 	return !same_impact;
@@ -697,15 +1000,156 @@ std::vector<std::pair<Cell *, Cell *>> LogicLockingAnalyzer::compute_pairwise_se
 {
 	std::vector<SigBit> signals = get_lockable_signals();
 	std::vector<Cell *> cells = get_lockable_cells();
+	int nb_signals = GetSize(signals);
+	int nb_threads = resolve_nb_threads(nb_threads_);
+	long long nb_pairs = 0;
+	for (int i = 0; i < nb_signals; ++i) {
+		if (in_shard(i)) {
+			nb_pairs += nb_signals - 1 - i;
+		}
+	}
+	if (nb_shards_ > 1) {
+		log_message(stringf("\tSimulating %lld signal pairs of shard %d/%d on %d threads\n", nb_pairs, shard_ + 1, nb_shards_, nb_threads));
+	} else {
+		log_message(stringf("\tSimulating %lld signal pairs on %d threads\n", nb_pairs, nb_threads));
+	}
 
-	std::vector<std::pair<Cell *, Cell *>> ret;
-	for (int i = 0; i < GetSize(signals); ++i) {
-		log("\tSimulating %s (%d/%d)\n", log_id(cells[i]->name), i + 1, GetSize(signals));
-		for (int j = i + 1; j < GetSize(signals); ++j) {
-			if (is_pairwise_secure(signals[i], signals[j])) {
-				ret.emplace_back(cells[i], cells[j]);
-				log_debug("\t\tPairwise secure %s <-> %s\n", log_id(cells[i]->name), log_id(cells[j]->name));
+	// Run all single-toggle simulations beforehand: the workers only read the cache
+	nb_simulated_nodes_ = 0;
+	fill_simulation_cache(signals);
+	const std::vector<Lit> &lits = wire_to_aig_lits_;
+
+	// Staged screening: pairs with disjoint structural support are never pairwise secure. Then, per signal, the outputs
+	// it actually corrupts: on an output outside the support of b, toggling b has no effect, so any corruption by a there
+	// breaks pairwise security; two signals that corrupt nothing have the same impact. Pairs rejected here are never
+	// simulated together, and the remaining ones only need to be checked on their common outputs.
+	int nb_output_words = output_support_.nbOutputWords();
+	std::vector<std::uint64_t> corrupted((size_t)nb_signals * nb_output_words, 0);
+	parallel_run(nb_threads, nb_signals, [&](int, int i) {
+		const auto &toggle = toggled_outputs_[lits[i].variable()];
+		std::uint64_t *corr = corrupted.data() + (size_t)i * nb_output_words;
+		for (int o : output_support_.getOutputs(lits[i].variable())) {
+			for (int tv = 0; tv < nb_test_vectors(); ++tv) {
+				if (toggle[tv][o] != golden_outputs_[tv][o]) {
+					corr[o / 64] |= (std::uint64_t)1 << (o % 64);
+					break;
+				}
+			}
+		}
+	});
+	auto screen = [&](int i, int j) {
+		if (!output_support_.intersects(lits[i].variable(), lits[j].variable())) {
+			return false;
+		}
+		const std::uint64_t *sup_i = output_support_.getSupport(lits[i].variable());
+		const std::uint64_t *sup_j = output_support_.getSupport(lits[j].variable());
+		const std::uint64_t *corr_i = corrupted.data() + (size_t)i * nb_output_words;
+		const std::uint64_t *corr_j = corrupted.data() + (size_t)j * nb_output_words;
+		bool any_corrupted = false;
+		for (int w = 0; w < nb_output_words; ++w) {
+			if ((corr_i[w] & ~sup_j[w]) || (corr_j[w] & ~sup_i[w])) {
+				return false;
 			}
+			any_corrupted |= (corr_i[w] | corr_j[w]) != 0;
+		}
+		return any_corrupted;
+	};
+
+	// Split the (i, j) triangle into square tiles; within a tile, test vectors are the outer loop
+	// so that each worker runs the golden simulation once per tile and batch of test vectors
+	const int tile_size = 64;
+	int nb_blocks = (nb_signals + tile_size - 1) / tile_size;
+	std::vector<std::pair<int, int>> tiles;
+	for (int bi = 0; bi < nb_blocks; ++bi) {
+		for (int bj = bi; bj < nb_blocks; ++bj) {
+			tiles.emplace_back(bi, bj);
+		}
+	}
+	int nb_words = nb_simulation_words();
+	std::vector<std::vector<std::pair<int, int>>> tile_edges(tiles.size());
+	std::vector<long long> tile_screened(tiles.size(), 0);
+	std::vector<IncrementalSimulation> sims(nb_threads, IncrementalSimulation(compact_aig_, nb_words));
+	parallel_run(nb_threads, GetSize(tiles), [&](int thread, int t) {
+		IncrementalSimulation &sim = sims[thread];
+		int i_begin = tiles[t].first * tile_size;
+		int i_end = std::min(i_begin + tile_size, nb_signals);
+		int j_begin = tiles[t].second * tile_size;
+		int j_end = std::min(j_begin + tile_size, nb_signals);
+		// Pair status in the tile, indexed by (i - i_begin) * tile_size + (j - j_begin)
+		std::vector<std::uint8_t> secure(tile_size * tile_size, 0);
+		std::vector<std::uint8_t> same_impact(tile_size * tile_size, 1);
+		std::vector<std::vector<int>> common_outputs(tile_size * tile_size);
+		for (int i = i_begin; i < i_end; ++i) {
+			if (!in_shard(i)) {
+				// Pairs outside the shard stay rejected
+				continue;
+			}
+			for (int j = std::max(j_begin, i + 1); j < j_end; ++j) {
+				int k = (i - i_begin) * tile_size + (j - j_begin);
+				secure[k] = screen(i, j);
+				if (secure[k]) {
+					common_outputs[k] = output_support_.getCommonOutputs(lits[i].variable(), lits[j].variable());
+					++tile_screened[t];
+				}
+			}
+		}
+		// Then simulate one block of test vectors at a time, dropping each pair at its first violation
+		for (int tv = 0; tv < nb_test_vectors(); tv += nb_words) {
+			bool loaded = false;
+			for (int i = i_begin; i < i_end; ++i) {
+				const auto &toggle_a = toggled_outputs_[lits[i].variable()];
+				for (int j = std::max(j_begin, i + 1); j < j_end; ++j) {
+					int k = (i - i_begin) * tile_size + (j - j_begin);
+					if (!secure[k]) {
+						continue;
+					}
+					if (!loaded) {
+						sim.simulate(get_wide_inputs(tv, nb_words));
+						loaded = true;
+					}
+					const auto &toggle_b = toggled_outputs_[lits[j].variable()];
+					auto wide_both = sim.simulateWithToggling({lits[i], lits[j]});
+					bool same = same_impact[k];
+					for (int w = 0; w < nb_words && tv + w < nb_test_vectors() && secure[k]; ++w) {
+						secure[k] = check_pairwise_secure(common_outputs[k], golden_outputs_[tv + w].data(), toggle_a[tv + w].data(),
+										  toggle_b[tv + w].data(), wide_both.data() + w, nb_words, same);
+					}
+					same_impact[k] = same;
+				}
+			}
+		}
+		for (int i = i_begin; i < i_end; ++i) {
+			for (int j = std::max(j_begin, i + 1); j < j_end; ++j) {
+				int k = (i - i_begin) * tile_size + (j - j_begin);
+				if (secure[k] && !same_impact[k]) {
+					tile_edges[t].emplace_back(i, j);
+				}
+			}
+		}
+	});
+
+	long long nb_candidates = 0;
+	for (long long c : tile_screened) {
+		nb_candidates += c;
+	}
+	nb_simulated_pairs_ = nb_candidates;
+	for (const IncrementalSimulation &sim : sims) {
+		nb_simulated_nodes_ += sim.nbNodeEvaluations();
+	}
+	log_message(stringf("\t%lld signal pairs left after structural and single-toggle screening\n", nb_candidates));
+
+	// Merge deterministically, in the same order as a serial traversal
+	std::vector<std::pair<int, int>> edges;
+	for (const auto &e : tile_edges) {
+		edges.insert(edges.end(), e.begin(), e.end());
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<std::pair<Cell *, Cell *>> ret;
+	for (auto e : edges) {
+		ret.emplace_back(cells[e.first], cells[e.second]);
+		if (!log_buffer_) {
+			log_debug("\t\tPairwise secure %s <-> %s\n", log_id(cells[e.first]->name), log_id(cells[e.second]->name));
 		}
 	}
 	dict<Cell *, int> nb_secure;
@@ -720,11 +1164,20 @@ std::vector<std::pair<Cell *, Cell *>> LogicLockingAnalyzer::compute_pairwise_se
 		++nb_secure[p.second];
 	}
 	for (int i = 0; i < GetSize(cells); ++i) {
-		log("\tCell %s: %d pairwise secure\n", log_id(cells[i]->name), nb_secure[cells[i]]);
+		log_message(stringf("\tCell %s: %d pairwise secure\n", RTLIL::unescape_id(cells[i]->name).c_str(), nb_secure[cells[i]]));
 	}
 	return ret;
 }
 
+void LogicLockingAnalyzer::log_message(const std::string &message) const
+{
+	if (log_buffer_) {
+		*log_buffer_ += message;
+	} else {
+		log("%s", message.c_str());
+	}
+}
+
 void LogicLockingAnalyzer::report_output_corruption()
 {
 	std::vector<SigBit> signals = get_lockable_signals();
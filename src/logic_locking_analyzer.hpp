@@ -9,9 +9,14 @@
 #include "kernel/sigtools.h"
 #include "kernel/yosys.h"
 
+#include "corruption_matrix.hpp"
 #include "mini_aig.hpp"
+#include "test_vectors.hpp"
+
+#include <functional>
 
 using Yosys::dict;
+using Yosys::SigMap;
 using Yosys::pool;
 using Yosys::RTLIL::Cell;
 using Yosys::RTLIL::Const;
@@ -55,25 +60,87 @@ using Yosys::RTLIL::State;
  * changes the value of the output with probability p. It is better if the signals chosen
  * for locking have a high output corruption.
  *
+ * By default, flip-flops are cut into free inputs and outputs, and corruption is measured within
+ * a single cycle. With several cycles, the corruption is measured over sequences of cycles: see
+ * set_nb_cycles.
+ *
  */
 class LogicLockingAnalyzer
 {
       public:
 	/**
 	 * @brief Initialize with a module
+	 *
+	 * With strashing, structurally identical logic and constants are merged in the AIG. Each lockable signal
+	 * keeps its own node, so that the analysis results are the same with a smaller AIG.
+	 */
+	LogicLockingAnalyzer(Module *module, bool strashing = false);
+
+	/**
+	 * @brief Number of nodes (and, xor and mux) in the AIG of the module
+	 */
+	int nb_aig_nodes() const { return aig_.nbNodes(); }
+
+	/**
+	 * @brief Number of blocks of 64 test vectors currently registered
+	 */
+	int nb_test_vectors() const { return test_vectors_.nbBlocks(); }
+
+	/**
+	 * @brief Measure output corruption over sequences of clock cycles rather than a single cycle (1, the default)
+	 *
+	 * Each sequence takes nb_cycles consecutive blocks of test vectors, one per cycle: the flip-flop values of the first
+	 * block give the initial state, and the flip-flop values of the next blocks are replaced by the state reached by the
+	 * circuit. The toggled signal is toggled at every cycle, and a (output, test vector) pair is corrupted if it differs
+	 * from the untoggled circuit at any cycle. Flip-flops sample their input every cycle: enables and resets are not modeled.
+	 *
+	 * Only the output corruption analysis is affected. Pairwise security still treats each block as a single cycle.
 	 */
-	LogicLockingAnalyzer(Module *module);
+	void set_nb_cycles(int nb_cycles) { nb_cycles_ = nb_cycles; }
 
 	/**
-	 * @brief Number of test vectors currently registered
+	 * @brief Number of cycles of the output corruption analysis
 	 */
-	int nb_test_vectors() const { return test_vectors_.size(); }
+	int nb_cycles() const { return nb_cycles_; }
+
+	/**
+	 * @brief Number of 64-bit test vector words of the output corruption data: one per block, or one per sequence of blocks
+	 */
+	int nb_corruption_words() const { return nb_test_vectors() / nb_cycles_; }
 
 	/**
 	 * @brief Generate random test vectors
+	 *
+	 * The vectors are not stored: each block is regenerated from the seed and its index when needed.
 	 */
 	void gen_test_vectors(int nb, size_t seed);
 
+	/**
+	 * @brief Read the test vectors from a stimulus file, with one value per combinatorial input in the order of get_comb_inputs
+	 *
+	 * The file is memory-mapped and blocks are parsed when needed. See TestVectorSource::fromFile for the format.
+	 * The column of each input is logged first, so that it is known even if the file is rejected.
+	 */
+	void load_test_vectors(const std::string &filename);
+
+	/**
+	 * @brief Append the messages of the analyses to a buffer instead of logging them (nullptr to log them again)
+	 *
+	 * Used to run the analyses of several modules concurrently, each buffer being logged from the main thread afterwards.
+	 * Debug messages are dropped meanwhile.
+	 */
+	void set_log_buffer(std::string *buffer) { log_buffer_ = buffer; }
+
+	/**
+	 * @brief Number of threads used for the analysis
+	 */
+	int nb_threads() const { return nb_threads_; }
+
+	/**
+	 * @brief Set the number of threads used for the analysis (0 to use all available cores)
+	 */
+	void set_nb_threads(int nb_threads) { nb_threads_ = nb_threads; }
+
 	/**
 	 * @brief Returns a measure of total output corruption for a bit with the given test vectors
 	 *
@@ -96,9 +163,54 @@ class LogicLockingAnalyzer
 	std::vector<std::vector<std::uint64_t>> compute_output_corruption_data(SigBit a);
 
 	/**
-	 * @brief Returns the impact of locking cells (per output per test vector)
+	 * @brief Restrict the analyses to a shard, to split them between processes
+	 *
+	 * Signal i, in the order of get_lockable_cells, belongs to shard i % nb_shards. Only the signals of the shard have
+	 * their output corruption computed, and only the pairs (i, j) with i < j and i in the shard are checked for pairwise security.
+	 */
+	void set_shard(int shard, int nb_shards)
+	{
+		shard_ = shard;
+		nb_shards_ = nb_shards;
+	}
+
+	/**
+	 * @brief Query whether a signal, in the order of get_lockable_cells, belongs to the shard
+	 */
+	bool in_shard(int signal) const { return signal % nb_shards_ == shard_; }
+
+	/**
+	 * @brief Returns the impact of locking cells (per output per test vector), with one row per lockable cell
+	 *
+	 * Signals are simulated in parallel, with the number of threads given by set_nb_threads.
+	 * Rows are in the order of get_lockable_cells. With a shard, only the signals of the shard have a row, consecutively:
+	 * row r is signal shard + r * nb_shards.
+	 * With several cycles, there is one test vector word per sequence.
 	 */
-	dict<Cell *, std::vector<std::vector<std::uint64_t>>> compute_output_corruption_data();
+	CorruptionMatrix compute_output_corruption_data();
+
+	/**
+	 * @brief Compute the impact of locking cells block by block, without storing the whole corruption data
+	 *
+	 * For each block of test vector words and each lockable cell, in the order of get_lockable_cells, the callback
+	 * receives the corruption data of the block (per output per test vector word). Blocks are processed in order.
+	 * The callback is called from worker threads, but never concurrently for the same signal.
+	 *
+	 * If a stopping criterion is given, it is called after each block with the number of test vector words processed so far,
+	 * and the analysis stops as soon as it returns true.
+	 *
+	 * Only the signals of the shard are simulated. With several cycles, test vector words are sequences (see nb_corruption_words).
+	 *
+	 * @param words_per_block Number of test vector words per block, or 0 for the width of the simulation
+	 * @return The number of test vector words processed
+	 */
+	int stream_output_corruption_data(const std::function<void(int signal, int first_word, int nb_words, const std::uint64_t *data)> &callback,
+					  const std::function<bool(int nb_words)> &stop = nullptr, int words_per_block = 0);
+
+	/**
+	 * @brief Store the output corruption data in a memory-mapped file rather than in memory
+	 */
+	void set_corruption_backing_file(const std::string &filename) { corruption_backing_file_ = filename; }
 
 	/**
 	 * @brief Returns whether the two bits are pairwise secure with the given test vectors
@@ -106,10 +218,23 @@ class LogicLockingAnalyzer
 	bool is_pairwise_secure(SigBit a, SigBit b);
 
 	/**
-	 * @brief Returns the list of pairwise-secure signal pairs
+	 * @brief Returns the list of pairwise-secure signal pairs, among the pairs of the shard
+	 *
+	 * The pairs are sorted by signal index, independently of the number of threads.
 	 */
 	std::vector<std::pair<Cell *, Cell *>> compute_pairwise_secure_graph();
 
+	/**
+	 * @brief Number of AIG nodes evaluated by the last bulk analysis (output corruption or pairwise security), each on a
+	 * simulation word of 64 test vectors or more
+	 */
+	long long nb_simulated_nodes() const { return nb_simulated_nodes_; }
+
+	/**
+	 * @brief Number of signal pairs simulated by the last pairwise security analysis, after screening
+	 */
+	long long nb_simulated_pairs() const { return nb_simulated_pairs_; }
+
 	/**
 	 * @brief Report on the output corruption
 	 */
@@ -125,18 +250,51 @@ class LogicLockingAnalyzer
 	 */
 	pool<SigBit> get_comb_outputs() const;
 
+	/**
+	 * @brief Obtain the combinatorial outputs structurally reachable from a bit, as indices in the order of get_comb_outputs
+	 */
+	std::vector<int> get_output_support(SigBit bit) const { return output_support_.getOutputs(get_simulation_lit(bit).variable()); }
+
+	/**
+	 * @brief Query whether two bits structurally reach a common combinatorial output
+	 */
+	bool has_common_output(SigBit a, SigBit b) const
+	{
+		return output_support_.intersects(get_simulation_lit(a).variable(), get_simulation_lit(b).variable());
+	}
+
+	/**
+	 * @brief Update the analysis after locking gates were inserted at the outputs of lockable cells, instead of rebuilding it
+	 *
+	 * The key bits are considered at their correct value, so that each locking gate is the identity and the fan-out cone
+	 * of its output is unchanged: the new output wire of each locked cell takes the literal of the signal it replaces,
+	 * and no cached simulation result is invalidated. The locking gates are not lockable cells.
+	 *
+	 * @param locked_cells Locked cells
+	 * @param gates Xor/Xnor locking gate inserted at the output of each locked cell
+	 */
+	void add_locking_gates(const std::vector<Cell *> &locked_cells, const std::vector<Cell *> &gates);
+
 	/**
 	 * @brief Obtain the lockable signals (outputs of lockable cells)
 	 */
 	std::vector<SigBit> get_lockable_signals() const;
 
 	/**
-	 * @brief Obtain the lockable cells (each output is a lockable signal)
+	 * @brief Obtain the lockable cells (each output is a lockable signal), sorted by name, without the locking gates
 	 */
 	std::vector<Cell *> get_lockable_cells() const;
 
+	/**
+	 * @brief Obtain the lockable cells of a module, sorted by name, without building an analyzer
+	 */
+	static std::vector<Cell *> get_lockable_cells(Module *module);
+
 	/**
 	 * @brief Simulate on a bitset of test vectors and return the module's outputs
+	 *
+	 * Reference simulation on the RTLIL cells, independent of the AIG conversion. Each bit
+	 * holds the values for 64 test vectors.
 	 */
 	std::vector<std::uint64_t> simulate_basic(int tv, const pool<SigBit> &toggled_bits);
 
@@ -145,51 +303,163 @@ class LogicLockingAnalyzer
 	 */
 	std::vector<std::uint64_t> simulate_aig(int tv, const pool<SigBit> &toggled_bits);
 
+	/**
+	 * @brief Return the module's outputs without toggling, cached across calls
+	 */
+	const std::vector<std::uint64_t> &get_golden_outputs(int tv);
+
+	/**
+	 * @brief Return the module's outputs with a single toggled bit, cached across calls
+	 */
+	const std::vector<std::uint64_t> &get_toggled_outputs(int tv, SigBit toggled_bit);
+
       private:
 	/**
-	 * @brief Create wire to consuming cells information
+	 * @brief Evaluate a cell on 64 test vectors at once for the reference simulation
 	 */
-	void init_wire_to_cells();
+	void simulate_cell(Cell *cell, const pool<SigBit> &toggled_bits, dict<SigBit, std::uint64_t> &values) const;
 
 	/**
-	 * @brief Create wire to connected wires (aliases) information
+	 * @brief Build the AIG with a single topological traversal of the combinatorial cells
+	 *
+	 * The traversal order is kept for the reference simulation.
 	 */
-	void init_wire_to_wires();
+	void init_aig();
 
-	void set_input_state(const dict<SigBit, State> &state);
+	/**
+	 * @brief Query whether a bit has a literal in the AIG (constants always do)
+	 */
+	bool has_aig_lit(SigBit bit) const;
 
-	dict<SigBit, State> get_output_state() const;
+	/**
+	 * @brief Obtain the literal of a bit in the AIG, resolving aliases with the SigMap
+	 */
+	Lit get_aig_lit(SigBit bit) const;
 
-	bool has_state(SigSpec b);
+	void set_aig_lit(SigBit bit, Lit lit);
 
-	Const get_state(SigSpec b);
+	/**
+	 * @brief Run the golden simulation for a test vector, if not already done
+	 */
+	void load_test_vector(int tv);
 
-	void set_state(SigSpec b, Const val);
+	/**
+	 * @brief Obtain the literal of a signal in the simulation AIG
+	 */
+	Lit get_simulation_lit(SigBit bit) const { return compact_aig_.getLit(get_aig_lit(bit)); }
 
-	void simulate_cell(Cell *cell);
+	/**
+	 * @brief Clear cached simulation results, when test vectors are modified
+	 */
+	void clear_simulation_cache();
 
-	void init_aig();
+	/**
+	 * @brief Run the golden and single-toggle simulations of the signals on all test vectors, in parallel
+	 *
+	 * Also records the simulation literals of the signals in wire_to_aig_lits_, for lock-free access from worker threads.
+	 */
+	void fill_simulation_cache(const std::vector<SigBit> &signals);
+
+	/**
+	 * @brief Number of 64-bit words simulated together by the bulk simulations, depending on the CPU
+	 */
+	int nb_simulation_words() const;
+
+	/**
+	 * @brief Gather the inputs of test vectors, stride blocks apart, for a simulation with several words per variable
+	 *
+	 * Test vectors past the end are zero.
+	 */
+	std::vector<std::uint64_t> get_wide_inputs(int tv, int nb_words, int stride = 1) const;
+
+	/**
+	 * @brief Streaming output corruption analysis over sequences of cycles, see stream_output_corruption_data
+	 */
+	int stream_sequential_output_corruption_data(const std::function<void(int signal, int first_word, int nb_words, const std::uint64_t *data)> &callback,
+						     const std::function<bool(int nb_words)> &stop, int words_per_block);
+
+	/**
+	 * @brief List the flip-flops as pairs of a combinatorial output (next state) and a combinatorial input (current state), by index
+	 */
+	std::vector<std::pair<int, int>> get_registers() const;
+
+	/**
+	 * @brief Extract the values of a single word from the outputs of a simulation with several words per variable
+	 */
+	static void extract_word(const std::vector<std::uint64_t> &wide, int nb_words, int w, std::vector<std::uint64_t> &ret);
+
+	/**
+	 * @brief Update the pairwise security status of two signals with the simulation of a test vector
+	 *
+	 * Only the given outputs are checked; the values of toggle_both for output o are at toggle_both[o * both_stride].
+	 *
+	 * @return false if the signals are not pairwise secure
+	 */
+	static bool check_pairwise_secure(const std::vector<int> &outputs, const std::uint64_t *no_toggle, const std::uint64_t *toggle_a,
+					  const std::uint64_t *toggle_b, const std::uint64_t *toggle_both, int both_stride, bool &same_impact);
 
 	void cell_to_aig(Cell *cell);
 
+	/**
+	 * @brief Log a message of the analyses, or append it to the log buffer if one is set
+	 */
+	void log_message(const std::string &message) const;
+
+	/**
+	 * @brief Log the input bit that each column of a stimulus file drives
+	 */
+	void log_stimulus_columns(const std::string &filename) const;
+
 	bool has_valid_port(Cell *cell, const IdString &port_name) const;
 
       private:
 	Module *module_;
 	pool<SigBit> comb_inputs_;
 	pool<SigBit> comb_outputs_;
-	std::vector<std::vector<std::uint64_t>> test_vectors_;
-	dict<SigBit, pool<Cell *>> wire_to_cells_;
-	dict<SigBit, pool<SigBit>> wire_to_wires_;
+	TestVectorSource test_vectors_;
+
+	// Canonical bits, and combinatorial cells in topological order
+	SigMap sigmap_;
+	std::vector<Cell *> topo_cells_;
 
-	// State for traversal
-	pool<SigBit> dirty_bits_;
+	// Locking gates added after construction, by locked cell, and correct value of their key bits
+	dict<Cell *, Cell *> locking_gates_;
+	pool<Cell *> locking_gate_set_;
+	dict<SigBit, bool> key_values_;
 
 	MiniAIG aig_;
+	bool strashing_;
+	// AIG literals, by canonical bit
 	dict<SigBit, Lit> wire_to_aig_;
 
-	dict<SigBit, State> state_;
-	pool<SigBit> toggled_bits_;
+	// Frozen AIG for fast simulation, with its own literal numbering
+	CompactAIG compact_aig_;
+	// Outputs reachable from each variable of the frozen AIG
+	OutputSupport output_support_;
+
+	// Incremental simulation, with the golden state of test vector sim_tv_
+	IncrementalSimulation sim_;
+	int sim_tv_;
+
+	// Cached simulation results, by test vector and by simulation variable then test vector
+	std::vector<std::vector<std::uint64_t>> golden_outputs_;
+	std::vector<std::vector<std::vector<std::uint64_t>>> toggled_outputs_;
+	// Number of test vectors with a cached single-toggle result, by simulation variable
+	std::vector<int> nb_toggled_outputs_;
+
+	// Simulation literals of the signals passed to the last fill_simulation_cache call
+	std::vector<Lit> wire_to_aig_lits_;
+
+	int nb_threads_;
+	int nb_cycles_;
+	int shard_;
+	int nb_shards_;
+	std::string corruption_backing_file_;
+
+	// Work done by the last bulk analyses
+	long long nb_simulated_nodes_;
+	long long nb_simulated_pairs_;
+	std::string *log_buffer_;
 };
 
 #endif
\ No newline at end of file
@@ -3,83 +3,252 @@
  */
 
 #include "logic_locking_optimizer.hpp"
+#include "mapped_file.hpp"
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <queue>
 #include <stdexcept>
 #include <unordered_set>
 
-LogicLockingOptimizer::LogicLockingOptimizer(const std::vector<std::vector<int>> &pairwiseInterference) : pairwiseInterference_(pairwiseInterference)
+namespace
 {
-	sortNeighbours();
-	removeSelfLoops();
-	removeDirectedEdges();
-	removeExclusiveEquivalentNodes();
-	cliques_ = listMaximalCliques();
+const char graphMagic[8] = {'M', 'O', 'O', 'S', 'I', 'C', 'G', '1'};
+} // namespace
+
+LogicLockingOptimizer::LogicLockingOptimizer(const std::vector<std::vector<int>> &pairwiseInterference, std::size_t maxCliques)
+    : nbNodes_(pairwiseInterference.size()), offsets_(nullptr), neighbours_(nullptr)
+{
+	ownedOffsets_.reserve(nbNodes_ + 1);
+	ownedOffsets_.push_back(0);
+	for (const std::vector<int> &v : pairwiseInterference) {
+		for (int j : v) {
+			if (j < 0 || j >= nbNodes_) {
+				throw std::runtime_error("Pairwise interference is invalid: some nodes are out of bound");
+			}
+			ownedNeighbours_.push_back(j);
+		}
+		ownedOffsets_.push_back(ownedNeighbours_.size());
+	}
+	cleanup();
+	init(maxCliques);
+}
+
+LogicLockingOptimizer::LogicLockingOptimizer(int nbNodes, const std::uint64_t *offsets, const std::uint32_t *neighbours, std::size_t maxCliques)
+    : LogicLockingOptimizer(nbNodes, offsets, neighbours, nullptr, maxCliques)
+{
+}
+
+LogicLockingOptimizer::LogicLockingOptimizer(int nbNodes, const std::uint64_t *offsets, const std::uint32_t *neighbours,
+					     std::shared_ptr<const void> storage, std::size_t maxCliques)
+    : nbNodes_(nbNodes), offsets_(nullptr), neighbours_(nullptr)
+{
+	if (storage && isClean(nbNodes, offsets, neighbours)) {
+		offsets_ = offsets;
+		neighbours_ = neighbours;
+		storage_ = std::move(storage);
+	} else {
+		for (int i = 0; i <= nbNodes; ++i) {
+			ownedOffsets_.push_back(offsets[i] - offsets[0]);
+		}
+		ownedNeighbours_.assign(neighbours + offsets[0], neighbours + offsets[nbNodes]);
+		for (std::uint32_t j : ownedNeighbours_) {
+			if (j >= (std::uint32_t)nbNodes) {
+				throw std::runtime_error("Pairwise interference is invalid: some nodes are out of bound");
+			}
+		}
+		cleanup();
+	}
+	init(maxCliques);
+}
+
+LogicLockingOptimizer::LogicLockingOptimizer(std::vector<std::uint64_t> offsets, std::vector<std::uint32_t> neighbours, std::size_t maxCliques)
+    : nbNodes_(offsets.empty() ? 0 : offsets.size() - 1), ownedOffsets_(std::move(offsets)), ownedNeighbours_(std::move(neighbours)),
+      offsets_(nullptr), neighbours_(nullptr)
+{
+	if (ownedOffsets_.empty()) {
+		ownedOffsets_.push_back(0);
+	}
+	if (ownedOffsets_.front() != 0 || ownedOffsets_.back() != ownedNeighbours_.size() ||
+	    !std::is_sorted(ownedOffsets_.begin(), ownedOffsets_.end())) {
+		throw std::runtime_error("Pairwise interference is invalid: inconsistent offsets");
+	}
+	for (std::uint32_t j : ownedNeighbours_) {
+		if (j >= (std::uint32_t)nbNodes_) {
+			throw std::runtime_error("Pairwise interference is invalid: some nodes are out of bound");
+		}
+	}
+	cleanup();
+	init(maxCliques);
+}
+
+void LogicLockingOptimizer::init(std::size_t maxCliques)
+{
+	cliquesEnumerated_ = listMaximalCliques(maxCliques, cliques_);
+	if (!cliquesEnumerated_) {
+		cliques_.clear();
+	}
 	check();
 }
 
-void LogicLockingOptimizer::sortNeighbours()
+void LogicLockingOptimizer::cleanup()
+{
+	std::vector<std::uint32_t> length(nbNodes_);
+	for (int i = 0; i < nbNodes_; ++i) {
+		length[i] = ownedOffsets_[i + 1] - ownedOffsets_[i];
+	}
+	sortNeighbours(length);
+	removeSelfLoops(length);
+	removeDirectedEdges(length);
+	removeExclusiveEquivalentNodes(length);
+	// Compact the ranges, which only move towards the start; the unused capacity is not released, as that would need a copy
+	std::uint32_t *data = ownedNeighbours_.data();
+	std::uint64_t pos = 0;
+	for (int i = 0; i < nbNodes_; ++i) {
+		std::uint64_t start = ownedOffsets_[i];
+		ownedOffsets_[i] = pos;
+		std::copy(data + start, data + start + length[i], data + pos);
+		pos += length[i];
+	}
+	ownedOffsets_[nbNodes_] = pos;
+	ownedNeighbours_.resize(pos);
+}
+
+void LogicLockingOptimizer::sortNeighbours(std::vector<std::uint32_t> &length)
 {
-	for (std::vector<int> &v : pairwiseInterference_) {
+	for (int i = 0; i < nbNodes_; ++i) {
+		std::uint32_t *v = ownedNeighbours_.data() + ownedOffsets_[i];
 		// Sort
-		std::sort(v.begin(), v.end());
+		std::sort(v, v + length[i]);
 		// Uniquify
-		v.erase(std::unique(v.begin(), v.end()), v.end());
+		length[i] = std::unique(v, v + length[i]) - v;
 	}
 }
 
-void LogicLockingOptimizer::removeSelfLoops()
+void LogicLockingOptimizer::removeSelfLoops(std::vector<std::uint32_t> &length)
 {
-	for (size_t i = 0; i < pairwiseInterference_.size(); ++i) {
-		std::vector<int> &v = pairwiseInterference_[i];
-		auto it = std::find(v.begin(), v.end(), (int)i);
-		if (it != v.end()) {
-			v.erase(it);
+	for (int i = 0; i < nbNodes_; ++i) {
+		std::uint32_t *v = ownedNeighbours_.data() + ownedOffsets_[i];
+		std::uint32_t *it = std::find(v, v + length[i], (std::uint32_t)i);
+		if (it != v + length[i]) {
+			std::copy(it + 1, v + length[i], it);
+			--length[i];
 		}
 	}
 }
 
-void LogicLockingOptimizer::removeDirectedEdges()
+void LogicLockingOptimizer::removeDirectedEdges(std::vector<std::uint32_t> &length)
 {
-	for (size_t i = 0; i < pairwiseInterference_.size(); ++i) {
-		const std::vector<int> &v = pairwiseInterference_[i];
-		std::vector<int> filtered;
-		for (int j : v) {
-			if (hasEdge(j, (int)i)) {
-				filtered.push_back(j);
+	auto hasEdge = [&](std::uint32_t from, std::uint32_t to) {
+		const std::uint32_t *v = ownedNeighbours_.data() + ownedOffsets_[from];
+		return std::binary_search(v, v + length[from], to);
+	};
+	for (int i = 0; i < nbNodes_; ++i) {
+		std::uint32_t *v = ownedNeighbours_.data() + ownedOffsets_[i];
+		std::uint32_t nbKept = 0;
+		for (std::uint32_t k = 0; k < length[i]; ++k) {
+			if (hasEdge(v[k], i)) {
+				v[nbKept++] = v[k];
 			}
 		}
-		pairwiseInterference_[i] = filtered;
+		length[i] = nbKept;
 	}
 }
 
-void LogicLockingOptimizer::removeExclusiveEquivalentNodes()
+void LogicLockingOptimizer::removeExclusiveEquivalentNodes(std::vector<std::uint32_t> &length)
 {
-	for (int i = 0; i < nbNodes(); ++i) {
-		const std::vector<int> &v = pairwiseInterference_[i];
-		for (int j = i + 1; j < nbNodes(); ++j) {
+	auto row = [&](std::uint32_t i) { return ownedNeighbours_.data() + ownedOffsets_[i]; };
+	for (int i = 0; i < nbNodes_; ++i) {
+		const std::uint32_t *v = row(i);
+		if (length[i] == 0) {
+			// Nodes without edges have nothing to remove
+			continue;
+		}
+		// Equivalent nodes are neighbours of all neighbours of i: only check those of the neighbour of smallest degree
+		std::uint32_t pivot = v[0];
+		for (std::uint32_t k = 0; k < length[i]; ++k) {
+			if (length[v[k]] < length[pivot]) {
+				pivot = v[k];
+			}
+		}
+		std::vector<std::uint32_t> candidates;
+		for (std::uint32_t k = 0; k < length[pivot]; ++k) {
+			if (row(pivot)[k] > (std::uint32_t)i) {
+				candidates.push_back(row(pivot)[k]);
+			}
+		}
+		for (std::uint32_t j : candidates) {
 			// If the nodes are equivalent but not connected
 			// Since the self-loops are ignored, the adjacency lists are different
 			// if the nodes have an edge between them
-			if (pairwiseInterference_[j] == v) {
+			if (length[j] == length[i] && std::equal(v, v + length[i], row(j))) {
 				// Remove all these edges from the other nodes
-				for (int k : pairwiseInterference_[j]) {
+				for (std::uint32_t t = 0; t < length[j]; ++t) {
+					std::uint32_t k = row(j)[t];
 					// No self-loop precondition
-					assert(k != i);
+					assert(k != (std::uint32_t)i);
 					assert(k != j);
-					std::vector<int> &o = pairwiseInterference_[k];
-					auto it = std::find(o.begin(), o.end(), j);
+					std::uint32_t *o = row(k);
+					std::uint32_t *it = std::lower_bound(o, o + length[k], j);
 					// No directed edge precondition
-					assert(it != o.end());
-					o.erase(it);
+					assert(it != o + length[k] && *it == j);
+					std::copy(it + 1, o + length[k], it);
+					--length[k];
 				}
-				pairwiseInterference_[j].clear();
+				length[j] = 0;
+			}
+		}
+	}
+}
+
+bool LogicLockingOptimizer::isClean(int nbNodes, const std::uint64_t *offsets, const std::uint32_t *neighbours)
+{
+	auto begin = [&](int i) { return neighbours + offsets[i]; };
+	auto end = [&](int i) { return neighbours + offsets[i + 1]; };
+	// Sorted without duplicates nor self-loops
+	for (int i = 0; i < nbNodes; ++i) {
+		if (offsets[i] > offsets[i + 1]) {
+			return false;
+		}
+		for (const std::uint32_t *it = begin(i); it != end(i); ++it) {
+			if (*it >= (std::uint32_t)nbNodes || *it == (std::uint32_t)i || (it != begin(i) && it[-1] >= *it)) {
+				return false;
+			}
+		}
+	}
+	// Symmetric
+	for (int i = 0; i < nbNodes; ++i) {
+		for (const std::uint32_t *it = begin(i); it != end(i); ++it) {
+			if (!std::binary_search(begin(*it), end(*it), (std::uint32_t)i)) {
+				return false;
 			}
 		}
 	}
+	// No exclusive equivalent nodes: removeExclusiveEquivalentNodes would not modify the graph
+	for (int i = 0; i < nbNodes; ++i) {
+		if (begin(i) == end(i)) {
+			continue;
+		}
+		std::uint32_t pivot = *begin(i);
+		for (const std::uint32_t *it = begin(i); it != end(i); ++it) {
+			if (end(*it) - begin(*it) < end(pivot) - begin(pivot)) {
+				pivot = *it;
+			}
+		}
+		for (const std::uint32_t *it = begin(pivot); it != end(pivot); ++it) {
+			int j = *it;
+			if (j > i && end(j) - begin(j) == end(i) - begin(i) && std::equal(begin(i), end(i), begin(j))) {
+				return false;
+			}
+		}
+	}
+	return true;
 }
 
 double LogicLockingOptimizer::value(const ExplicitSolution &sol) const
@@ -99,6 +268,30 @@ double LogicLockingOptimizer::value(const ExplicitSolution &sol) const
 	return maxCard + std::log2(sumPow);
 }
 
+std::vector<double> LogicLockingOptimizer::valueCurve(const ExplicitSolution &sol) const
+{
+	check(sol);
+	std::vector<double> ret;
+	// Running sum of 2^(|C| - maxCard)
+	int maxCard = 0;
+	double sumPow = 0.0;
+	for (const auto &c : sol) {
+		for (int j = 1; j <= (int)c.size(); ++j) {
+			if (j > maxCard) {
+				sumPow *= std::exp2(maxCard - j);
+				maxCard = j;
+			}
+			// The clique grows from j - 1 to j nodes
+			sumPow += std::exp2(j - maxCard);
+			if (j > 1) {
+				sumPow -= std::exp2(j - 1 - maxCard);
+			}
+			ret.push_back(maxCard + std::log2(sumPow));
+		}
+	}
+	return ret;
+}
+
 void LogicLockingOptimizer::check(const ExplicitSolution &sol) const
 {
 	std::unordered_set<int> present;
@@ -120,8 +313,8 @@ void LogicLockingOptimizer::check(const ExplicitSolution &sol) const
 
 void LogicLockingOptimizer::check() const
 {
-	for (int i = 0; i < (int)pairwiseInterference_.size(); ++i) {
-		const std::vector<int> &v = pairwiseInterference_[i];
+	for (int i = 0; i < nbNodes(); ++i) {
+		Neighbours v = neighbours(i);
 		for (int j : v) {
 			if (i == j) {
 				throw std::runtime_error("Pairwise interference is invalid: should have no self-loop");
@@ -146,7 +339,7 @@ int LogicLockingOptimizer::nbConnectedNodes() const
 {
 	int ret = 0;
 	for (int i = 0; i + 1 < nbNodes(); ++i) {
-		if (!pairwiseInterference_[i].empty()) {
+		if (!neighbours(i).empty()) {
 			++ret;
 		}
 	}
@@ -157,7 +350,7 @@ int LogicLockingOptimizer::nbEdges() const
 {
 	int ret = 0;
 	for (int i = 0; i + 1 < nbNodes(); ++i) {
-		ret += (int)pairwiseInterference_[i].size();
+		ret += (int)neighbours(i).size();
 	}
 	return ret / 2;
 }
@@ -166,8 +359,8 @@ bool LogicLockingOptimizer::hasEdge(int from, int to) const
 {
 	assert(from >= 0 && from < nbNodes());
 	assert(to >= 0 && to < nbNodes());
-	const auto &v = pairwiseInterference_[from];
-	return std::binary_search(v.begin(), v.end(), to);
+	Neighbours v = neighbours(from);
+	return std::binary_search(v.begin(), v.end(), (std::uint32_t)to);
 }
 
 bool LogicLockingOptimizer::isClique(const std::vector<int> &nodes) const
@@ -182,63 +375,294 @@ bool LogicLockingOptimizer::isClique(const std::vector<int> &nodes) const
 	return true;
 }
 
-std::vector<std::vector<int>> LogicLockingOptimizer::listMaximalCliques() const
+namespace
 {
-	std::vector<int> P;
-	for (int i = 0; i < nbNodes(); ++i) {
-		P.push_back(i);
+/**
+ * @brief Enumeration of maximal cliques with bitsets, within the neighbourhood of a single node
+ *
+ * The neighbours after the node in the degeneracy order (the initial P) are numbered first, then the
+ * neighbours before it (the initial X). P never grows, so that only the rows of P need the whole width:
+ * the other rows only store their intersection with P. With d the degeneracy and n the size of the
+ * neighbourhood, the buffers use O(d * n) bits and the recursion depth is at most d + 1. They are grown
+ * when needed and reused across nodes.
+ */
+class CliqueEnumerator
+{
+      public:
+	CliqueEnumerator(const LogicLockingOptimizer &graph, std::size_t maxCliques)
+	    : graph_(graph), localIndex_(graph.nbNodes(), -1), nbWords_(0), nbPWords_(0), nbP_(0), maxCliques_(maxCliques), aborted_(false)
+	{
 	}
-	std::vector<std::vector<int>> ret;
-	bronKerbosch({}, P, {}, ret);
-	// Ensure the cliques are sorted (although the algorithm should ensure it)
-	for (auto &v : ret) {
-		std::sort(v.begin(), v.end());
+
+	/**
+	 * @brief Query whether the enumeration was abandoned because there were too many cliques
+	 */
+	bool aborted() const { return aborted_; }
+
+	/**
+	 * @brief List the maximal cliques containing v, with no node before v in the order
+	 */
+	void run(int v, const std::vector<int> &position, std::vector<std::vector<int>> &ret)
+	{
+		nodes_.clear();
+		for (int u : graph_.neighbours(v)) {
+			if (position[u] > position[v]) {
+				nodes_.push_back(u);
+			}
+		}
+		nbP_ = nodes_.size();
+		for (int u : graph_.neighbours(v)) {
+			if (position[u] < position[v]) {
+				nodes_.push_back(u);
+			}
+		}
+		int nbLocal = nodes_.size();
+		nbWords_ = (nbLocal + 63) / 64;
+		nbPWords_ = (nbP_ + 63) / 64;
+		for (int i = 0; i < nbLocal; ++i) {
+			localIndex_[nodes_[i]] = i;
+		}
+		std::size_t adjacencySize = (std::size_t)nbP_ * nbWords_ + (std::size_t)(nbLocal - nbP_) * nbPWords_;
+		if (adjacency_.size() < adjacencySize) {
+			adjacency_.resize(adjacencySize);
+		}
+		std::fill(adjacency_.begin(), adjacency_.begin() + adjacencySize, 0);
+		for (int i = 0; i < nbLocal; ++i) {
+			std::uint64_t *row = getAdjacency(i);
+			int width = i < nbP_ ? nbLocal : nbP_;
+			for (int u : graph_.neighbours(nodes_[i])) {
+				int j = localIndex_[u];
+				if (j >= 0 && j < width) {
+					row[j / 64] |= (std::uint64_t)1 << (j % 64);
+				}
+			}
+		}
+		// Each recursion level adds a node of P to the clique: one set of buffers per depth, plus the leaf
+		std::size_t scratchSize = (std::size_t)(nbP_ + 2) * 3 * nbWords_;
+		if (scratch_.size() < scratchSize) {
+			scratch_.resize(scratchSize);
+		}
+		std::uint64_t *P = getP(0);
+		std::uint64_t *X = getX(0);
+		std::fill(P, P + nbWords_, 0);
+		std::fill(X, X + nbWords_, 0);
+		for (int i = 0; i < nbLocal; ++i) {
+			if (i < nbP_) {
+				P[i / 64] |= (std::uint64_t)1 << (i % 64);
+			} else {
+				X[i / 64] |= (std::uint64_t)1 << (i % 64);
+			}
+		}
+		clique_.clear();
+		clique_.push_back(v);
+		expand(0, ret);
+		for (int u : nodes_) {
+			localIndex_[u] = -1;
+		}
 	}
-	return ret;
-}
 
-void LogicLockingOptimizer::bronKerbosch(std::vector<int> R, std::vector<int> P, std::vector<int> X, std::vector<std::vector<int>> &ret) const
-{
-	if (X.empty() && P.empty()) {
-		ret.push_back(R);
-		return;
+      private:
+	std::uint64_t *getP(int depth) { return scratch_.data() + (std::size_t)(3 * depth) * nbWords_; }
+	std::uint64_t *getX(int depth) { return scratch_.data() + (std::size_t)(3 * depth + 1) * nbWords_; }
+	std::uint64_t *getCandidates(int depth) { return scratch_.data() + (std::size_t)(3 * depth + 2) * nbWords_; }
+
+	/**
+	 * @brief Adjacency row of a local node: nbWords_ wide for the nodes of the initial P, nbPWords_ wide for the others
+	 */
+	std::uint64_t *getAdjacency(int i)
+	{
+		if (i < nbP_) {
+			return adjacency_.data() + (std::size_t)i * nbWords_;
+		}
+		return adjacency_.data() + (std::size_t)nbP_ * nbWords_ + (std::size_t)(i - nbP_) * nbPWords_;
 	}
-	int pivot = X.empty() ? P.back() : X.back();
-	std::vector<int> PSaved = P;
-	for (int v : PSaved) {
-		if (hasEdge(pivot, v)) {
-			// No need to check direct neighbours of the pivot
-			continue;
+
+	/**
+	 * @brief Pick the node of P ⋃ X with the most neighbours in P
+	 */
+	int choosePivot(const std::uint64_t *P, const std::uint64_t *X)
+	{
+		int best = -1;
+		int bestCount = -1;
+		for (int w = 0; w < nbWords_; ++w) {
+			std::uint64_t bits = (w < nbPWords_ ? P[w] : 0) | X[w];
+			while (bits) {
+				int u = 64 * w + __builtin_ctzll(bits);
+				bits &= bits - 1;
+				const std::uint64_t *adj = getAdjacency(u);
+				int count = 0;
+				for (int k = 0; k < nbPWords_; ++k) {
+					count += __builtin_popcountll(P[k] & adj[k]);
+				}
+				if (count > bestCount) {
+					best = u;
+					bestCount = count;
+				}
+			}
 		}
-		// R ⋃ {v}
-		std::vector<int> nextR;
-		nextR = R;
-		nextR.push_back(v);
-		// P ⋂ N(v)
-		std::vector<int> nextP;
-		for (int i : P) {
-			if (hasEdge(v, i)) {
-				nextP.push_back(i);
+		return best;
+	}
+
+	/**
+	 * @brief Recursive Bron-Kerbosch call, with P and X stored at the given depth
+	 *
+	 * P only has bits in its first nbPWords_ words; the others are never read.
+	 */
+	void expand(int depth, std::vector<std::vector<int>> &ret)
+	{
+		std::uint64_t *P = getP(depth);
+		std::uint64_t *X = getX(depth);
+		int pivot = choosePivot(P, X);
+		if (pivot < 0) {
+			// P and X are empty: the clique is maximal
+			if (maxCliques_ != 0 && ret.size() >= maxCliques_) {
+				aborted_ = true;
+				return;
 			}
+			ret.push_back(clique_);
+			return;
 		}
-		// X ⋂ N(v)
-		std::vector<int> nextX;
-		for (int i : X) {
-			if (hasEdge(v, i)) {
-				nextX.push_back(i);
+		// No need to check direct neighbours of the pivot
+		std::uint64_t *candidates = getCandidates(depth);
+		const std::uint64_t *pivotAdj = getAdjacency(pivot);
+		for (int k = 0; k < nbPWords_; ++k) {
+			candidates[k] = P[k] & ~pivotAdj[k];
+		}
+		std::uint64_t *nextP = getP(depth + 1);
+		std::uint64_t *nextX = getX(depth + 1);
+		for (int w = 0; w < nbPWords_; ++w) {
+			while (candidates[w]) {
+				int v = 64 * w + __builtin_ctzll(candidates[w]);
+				std::uint64_t bit = (std::uint64_t)1 << (v % 64);
+				candidates[w] &= candidates[w] - 1;
+				// P ⋂ N(v) and X ⋂ N(v), with a full-width row since v is in P
+				const std::uint64_t *adj = getAdjacency(v);
+				for (int k = 0; k < nbPWords_; ++k) {
+					nextP[k] = P[k] & adj[k];
+				}
+				for (int k = 0; k < nbWords_; ++k) {
+					nextX[k] = X[k] & adj[k];
+				}
+				clique_.push_back(nodes_[v]);
+				expand(depth + 1, ret);
+				clique_.pop_back();
+				if (aborted_) {
+					return;
+				}
+				// P := P \ {v}, X := X ⋃ {v}
+				P[w] &= ~bit;
+				X[w] |= bit;
+			}
+		}
+	}
+
+      private:
+	const LogicLockingOptimizer &graph_;
+	// Local index of the nodes in the current neighbourhood, -1 elsewhere
+	std::vector<int> localIndex_;
+	// Nodes of the current neighbourhood: later nodes in the order, then earlier nodes
+	std::vector<int> nodes_;
+	std::vector<int> clique_;
+	int nbWords_;
+	int nbPWords_;
+	int nbP_;
+	// Local adjacency matrix of the current neighbourhood
+	std::vector<std::uint64_t> adjacency_;
+	// P, X and candidates for each recursion depth
+	std::vector<std::uint64_t> scratch_;
+	std::size_t maxCliques_;
+	bool aborted_;
+};
+} // namespace
+
+std::vector<int> LogicLockingOptimizer::degeneracyOrder() const
+{
+	// Bucket sort of the nodes by current degree, updated as nodes are removed
+	int n = nbNodes();
+	int maxDegree = 0;
+	std::vector<int> degree(n);
+	for (int i = 0; i < n; ++i) {
+		degree[i] = neighbours(i).size();
+		maxDegree = std::max(maxDegree, degree[i]);
+	}
+	std::vector<int> binStart(maxDegree + 1, 0);
+	for (int d : degree) {
+		++binStart[d];
+	}
+	int start = 0;
+	for (int d = 0; d <= maxDegree; ++d) {
+		int count = binStart[d];
+		binStart[d] = start;
+		start += count;
+	}
+	std::vector<int> order(n);
+	std::vector<int> position(n);
+	for (int i = 0; i < n; ++i) {
+		position[i] = binStart[degree[i]]++;
+		order[position[i]] = i;
+	}
+	for (int d = maxDegree; d > 0; --d) {
+		binStart[d] = binStart[d - 1];
+	}
+	binStart[0] = 0;
+	for (int i = 0; i < n; ++i) {
+		int v = order[i];
+		for (int u : neighbours(v)) {
+			if (degree[u] > degree[v]) {
+				// Move u to the start of its bin, then shrink the bin
+				int du = degree[u];
+				int pu = position[u];
+				int pw = binStart[du];
+				int w = order[pw];
+				if (u != w) {
+					order[pu] = w;
+					order[pw] = u;
+					position[u] = pw;
+					position[w] = pu;
+				}
+				++binStart[du];
+				--degree[u];
 			}
 		}
-		// Recursive Bron-Kerbosch call
-		bronKerbosch(nextR, nextP, nextX, ret);
-		// P := P \ {v}
-		P.erase(std::find(P.begin(), P.end(), v));
-		// X := X ⋃ {v}
-		X.push_back(v);
 	}
+	return order;
+}
+
+std::vector<std::vector<int>> LogicLockingOptimizer::listMaximalCliques() const
+{
+	std::vector<std::vector<int>> ret;
+	listMaximalCliques(0, ret);
+	return ret;
+}
+
+bool LogicLockingOptimizer::listMaximalCliques(std::size_t maxCliques, std::vector<std::vector<int>> &ret) const
+{
+	std::vector<int> order = degeneracyOrder();
+	std::vector<int> position(nbNodes());
+	for (int i = 0; i < nbNodes(); ++i) {
+		position[order[i]] = i;
+	}
+	ret.clear();
+	CliqueEnumerator enumerator(*this, maxCliques);
+	for (int v : order) {
+		enumerator.run(v, position, ret);
+		if (enumerator.aborted()) {
+			return false;
+		}
+	}
+	// Canonical order, independent of the enumeration
+	for (auto &v : ret) {
+		std::sort(v.begin(), v.end());
+	}
+	std::sort(ret.begin(), ret.end());
+	return true;
 }
 
 LogicLockingOptimizer::ExplicitSolution LogicLockingOptimizer::solveGreedy(int maxNumber) const
 {
+	if (!cliquesEnumerated_) {
+		throw std::runtime_error("The maximal cliques were not enumerated: use the heuristic optimizer");
+	}
 	int currentNumber = 0;
 	auto cliques = cliques_;
 	ExplicitSolution ret;
@@ -274,6 +698,438 @@ LogicLockingOptimizer::ExplicitSolution LogicLockingOptimizer::solveGreedy(int m
 	return ret;
 }
 
+namespace
+{
+/**
+ * @brief Heuristic partition of the nodes into disjoint cliques, on the adjacency lists only
+ *
+ * The solution is kept with an inverted index from each node to its clique. Each local search move
+ * strictly increases sum(2^|C|), so that the search always terminates. Fixed nodes may move between
+ * cliques but are never removed from the solution.
+ */
+class CliquePartitionSearch
+{
+      public:
+	using Clock = std::chrono::steady_clock;
+
+	CliquePartitionSearch(const LogicLockingOptimizer &graph, int maxNumber, double timeLimit)
+	    : graph_(graph), maxNumber_(maxNumber), hasDeadline_(timeLimit > 0.0), nbUsed_(0), cliqueOf_(graph.nbNodes(), -1),
+	      positionInClique_(graph.nbNodes(), -1), fixed_(graph.nbNodes(), 0), inCandidates_(graph.nbNodes(), 0),
+	      candidateCount_(graph.nbNodes(), 0), mark_(graph.nbNodes(), 0), markStamp_(0)
+	{
+		if (hasDeadline_) {
+			deadline_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeLimit));
+		}
+	}
+
+	/**
+	 * @brief Add nodes that must be part of the solution, each to the largest clique it is fully connected to
+	 *
+	 * They are added even beyond the maximum number of nodes.
+	 */
+	void fix(const std::vector<int> &nodes)
+	{
+		for (int v : nodes) {
+			if (cliqueOf_[v] >= 0) {
+				continue;
+			}
+			std::vector<int> touched;
+			for (int u : graph_.neighbours(v)) {
+				int c = cliqueOf_[u];
+				if (c >= 0) {
+					if (cliqueCount_.size() <= (std::size_t)c) {
+						cliqueCount_.resize(cliques_.size(), 0);
+					}
+					if (cliqueCount_[c]++ == 0) {
+						touched.push_back(c);
+					}
+				}
+			}
+			int best = -1;
+			for (int c : touched) {
+				if (cliqueCount_[c] == cliqueSize(c) && (best < 0 || cliqueSize(c) > cliqueSize(best))) {
+					best = c;
+				}
+				cliqueCount_[c] = 0;
+			}
+			fixed_[v] = 1;
+			addToClique(v, best >= 0 ? best : newClique());
+		}
+	}
+
+	/**
+	 * @brief Build an initial solution by growing cliques greedily, largest first
+	 */
+	void construct()
+	{
+		const int nbSeeds = 32;
+		int n = graph_.nbNodes();
+		// Number of free neighbours, with a lazily updated max-heap
+		std::vector<int> freeDegree(n, 0);
+		std::priority_queue<std::pair<int, int>> heap;
+		for (int v = 0; v < n; ++v) {
+			if (cliqueOf_[v] >= 0) {
+				continue;
+			}
+			for (int u : graph_.neighbours(v)) {
+				freeDegree[v] += cliqueOf_[u] < 0;
+			}
+			heap.emplace(freeDegree[v], -v);
+		}
+		std::vector<int> clique;
+		std::vector<int> best;
+		std::vector<int> seeds;
+		while (nbUsed_ < maxNumber_ && !timeout()) {
+			// Try the free nodes of highest degree as seeds
+			seeds.clear();
+			while (!heap.empty() && (int)seeds.size() < nbSeeds) {
+				auto e = heap.top();
+				heap.pop();
+				int v = -e.second;
+				if (cliqueOf_[v] >= 0 || e.first != freeDegree[v]) {
+					continue;
+				}
+				seeds.push_back(v);
+			}
+			if (seeds.empty()) {
+				break;
+			}
+			best.clear();
+			for (int v : seeds) {
+				growClique(v, clique);
+				if (clique.size() > best.size()) {
+					best.swap(clique);
+				}
+			}
+			best.resize(std::min((int)best.size(), maxNumber_ - nbUsed_));
+			int c = newClique();
+			for (int v : best) {
+				addToClique(v, c);
+				for (int u : graph_.neighbours(v)) {
+					if (cliqueOf_[u] < 0) {
+						heap.emplace(--freeDegree[u], -u);
+					}
+				}
+			}
+			for (int v : seeds) {
+				if (cliqueOf_[v] < 0) {
+					heap.emplace(freeDegree[v], -v);
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Improve the solution by local search until no move applies or the time limit is reached
+	 */
+	void improve()
+	{
+		bool improved = true;
+		while (improved) {
+			improved = false;
+			for (int v = 0; v < graph_.nbNodes(); ++v) {
+				if (timeout()) {
+					return;
+				}
+				improved |= tryMove(v);
+			}
+			for (int c = 0; c < (int)cliques_.size(); ++c) {
+				if (timeout()) {
+					return;
+				}
+				improved |= trySwap(c);
+			}
+		}
+	}
+
+	/**
+	 * @brief Obtain the solution, largest cliques first
+	 */
+	LogicLockingOptimizer::ExplicitSolution solution() const
+	{
+		LogicLockingOptimizer::ExplicitSolution ret;
+		for (const auto &c : cliques_) {
+			if (!c.empty()) {
+				ret.push_back(c);
+				std::sort(ret.back().begin(), ret.back().end());
+			}
+		}
+		std::sort(ret.begin(), ret.end(), [](const std::vector<int> &a, const std::vector<int> &b) {
+			return a.size() != b.size() ? a.size() > b.size() : a < b;
+		});
+		return ret;
+	}
+
+      private:
+	bool timeout() const { return hasDeadline_ && Clock::now() >= deadline_; }
+
+	int cliqueSize(int c) const { return cliques_[c].size(); }
+
+	int newClique()
+	{
+		cliques_.emplace_back();
+		nbFixedIn_.push_back(0);
+		return cliques_.size() - 1;
+	}
+
+	void addToClique(int v, int c)
+	{
+		assert(cliqueOf_[v] < 0);
+		cliqueOf_[v] = c;
+		positionInClique_[v] = cliques_[c].size();
+		cliques_[c].push_back(v);
+		nbFixedIn_[c] += fixed_[v];
+		++nbUsed_;
+	}
+
+	void removeFromClique(int v)
+	{
+		nbFixedIn_[cliqueOf_[v]] -= fixed_[v];
+		std::vector<int> &c = cliques_[cliqueOf_[v]];
+		int last = c.back();
+		c[positionInClique_[v]] = last;
+		positionInClique_[last] = positionInClique_[v];
+		c.pop_back();
+		cliqueOf_[v] = -1;
+		positionInClique_[v] = -1;
+		--nbUsed_;
+	}
+
+	/**
+	 * @brief Smallest clique with a node that is not fixed, other than the given one, or -1
+	 */
+	int smallestClique(int exclude) const
+	{
+		int ret = -1;
+		for (int c = 0; c < (int)cliques_.size(); ++c) {
+			if (c != exclude && cliqueSize(c) > nbFixedIn_[c] && (ret < 0 || cliqueSize(c) < cliqueSize(ret))) {
+				ret = c;
+			}
+		}
+		return ret;
+	}
+
+	/**
+	 * @brief Make room for one more node, freeing a node of a clique no larger than maxSize if the budget is exhausted
+	 */
+	bool makeRoom(int exclude, int maxSize)
+	{
+		if (nbUsed_ < maxNumber_) {
+			return true;
+		}
+		int s = smallestClique(exclude);
+		if (s < 0 || cliqueSize(s) > maxSize) {
+			return false;
+		}
+		for (int i = cliqueSize(s) - 1; i >= 0; --i) {
+			int v = cliques_[s][i];
+			if (!fixed_[v]) {
+				removeFromClique(v);
+				break;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Grow a clique from a seed among the free nodes, adding the candidate with the most candidate neighbours first
+	 */
+	void growClique(int seed, std::vector<int> &clique)
+	{
+		clique.assign(1, seed);
+		std::vector<int> candidates;
+		for (int u : graph_.neighbours(seed)) {
+			if (cliqueOf_[u] < 0) {
+				candidates.push_back(u);
+				inCandidates_[u] = 1;
+			}
+		}
+		for (int u : candidates) {
+			for (int w : graph_.neighbours(u)) {
+				candidateCount_[u] += inCandidates_[w];
+			}
+		}
+		std::vector<int> removed;
+		while (!candidates.empty()) {
+			int best = candidates.front();
+			for (int u : candidates) {
+				if (candidateCount_[u] > candidateCount_[best]) {
+					best = u;
+				}
+			}
+			clique.push_back(best);
+			// Keep the candidates adjacent to the new node, and update the counts of the others
+			++markStamp_;
+			for (int u : graph_.neighbours(best)) {
+				mark_[u] = markStamp_;
+			}
+			std::vector<int> kept;
+			removed.clear();
+			for (int u : candidates) {
+				if (mark_[u] == markStamp_) {
+					kept.push_back(u);
+				} else {
+					removed.push_back(u);
+					inCandidates_[u] = 0;
+				}
+			}
+			for (int u : removed) {
+				for (int w : graph_.neighbours(u)) {
+					candidateCount_[w] -= inCandidates_[w];
+				}
+				candidateCount_[u] = 0;
+			}
+			candidates.swap(kept);
+		}
+	}
+
+	/**
+	 * @brief Move a node to the largest clique it is fully connected to, if this improves the solution
+	 */
+	bool tryMove(int v)
+	{
+		// Count the neighbours of v in each clique with the inverted index
+		std::vector<int> touched;
+		for (int u : graph_.neighbours(v)) {
+			int c = cliqueOf_[u];
+			if (c >= 0) {
+				if (cliqueCount_.size() <= (std::size_t)c) {
+					cliqueCount_.resize(cliques_.size(), 0);
+				}
+				if (cliqueCount_[c]++ == 0) {
+					touched.push_back(c);
+				}
+			}
+		}
+		int d = cliqueOf_[v];
+		int best = -1;
+		for (int c : touched) {
+			if (c != d && cliqueCount_[c] == cliqueSize(c) && (best < 0 || cliqueSize(c) > cliqueSize(best))) {
+				best = c;
+			}
+		}
+		for (int c : touched) {
+			cliqueCount_[c] = 0;
+		}
+		if (best < 0) {
+			if (d < 0 && nbUsed_ < maxNumber_) {
+				addToClique(v, newClique());
+				return true;
+			}
+			return false;
+		}
+		if (d >= 0) {
+			// 2^|C| + 2^|D| increases iff |C| >= |D|
+			if (cliqueSize(best) < cliqueSize(d)) {
+				return false;
+			}
+			removeFromClique(v);
+		} else if (!makeRoom(best, cliqueSize(best))) {
+			return false;
+		}
+		addToClique(v, best);
+		return true;
+	}
+
+	/**
+	 * @brief Replace a node of a clique by two free nodes, if there are two adjacent free nodes connected to the rest of the clique
+	 */
+	bool trySwap(int c)
+	{
+		const int maxGroupSize = 64;
+		int k = cliqueSize(c);
+		if (k < 2) {
+			return false;
+		}
+		std::vector<int> touched;
+		for (int u : cliques_[c]) {
+			for (int w : graph_.neighbours(u)) {
+				if (cliqueOf_[w] < 0 && candidateCount_[w]++ == 0) {
+					touched.push_back(w);
+				}
+			}
+		}
+		// Free nodes connected to all but one node of the clique, by missing node
+		std::vector<std::pair<int, int>> oneMissing;
+		for (int w : touched) {
+			if (candidateCount_[w] == k - 1) {
+				++markStamp_;
+				for (int u : graph_.neighbours(w)) {
+					mark_[u] = markStamp_;
+				}
+				for (int u : cliques_[c]) {
+					if (mark_[u] != markStamp_) {
+						if (!fixed_[u]) {
+							oneMissing.emplace_back(u, w);
+						}
+						break;
+					}
+				}
+			}
+		}
+		for (int w : touched) {
+			candidateCount_[w] = 0;
+		}
+		std::sort(oneMissing.begin(), oneMissing.end());
+		for (std::size_t b = 0; b < oneMissing.size();) {
+			std::size_t e = b;
+			while (e < oneMissing.size() && oneMissing[e].first == oneMissing[b].first) {
+				++e;
+			}
+			std::size_t end = std::min(e, b + maxGroupSize);
+			for (std::size_t i = b; i < end; ++i) {
+				int v = oneMissing[i].second;
+				for (std::size_t j = i + 1; j < end; ++j) {
+					int w = oneMissing[j].second;
+					if (!graph_.hasEdge(v, w)) {
+						continue;
+					}
+					// The clique grows by one: 2^|C| is gained, at most 2^(|C| - 1) lost to make room
+					if (!makeRoom(c, k)) {
+						return false;
+					}
+					removeFromClique(oneMissing[i].first);
+					addToClique(v, c);
+					addToClique(w, c);
+					return true;
+				}
+			}
+			b = e;
+		}
+		return false;
+	}
+
+      private:
+	const LogicLockingOptimizer &graph_;
+	int maxNumber_;
+	bool hasDeadline_;
+	Clock::time_point deadline_;
+	int nbUsed_;
+	std::vector<std::vector<int>> cliques_;
+	// Inverted index: clique of each node (-1 if free) and position in the clique
+	std::vector<int> cliqueOf_;
+	std::vector<int> positionInClique_;
+	// Nodes that cannot be removed, and their number in each clique
+	std::vector<std::uint8_t> fixed_;
+	std::vector<int> nbFixedIn_;
+	// Scratch buffers
+	std::vector<std::uint8_t> inCandidates_;
+	std::vector<int> candidateCount_;
+	std::vector<int> cliqueCount_;
+	std::vector<int> mark_;
+	int markStamp_;
+};
+} // namespace
+
+LogicLockingOptimizer::ExplicitSolution LogicLockingOptimizer::solveHeuristic(int maxNumber, const Solution &preLocked, double timeLimit) const
+{
+	CliquePartitionSearch search(*this, maxNumber, timeLimit);
+	search.fix(preLocked);
+	search.construct();
+	search.improve();
+	return search.solution();
+}
+
 LogicLockingOptimizer::Solution LogicLockingOptimizer::flattenSolution(const ExplicitSolution &sol)
 {
 	std::vector<int> ret;
@@ -285,19 +1141,94 @@ LogicLockingOptimizer::Solution LogicLockingOptimizer::flattenSolution(const Exp
 	return ret;
 }
 
-LogicLockingOptimizer LogicLockingOptimizer::fromFile(std::istream &s)
+LogicLockingOptimizer LogicLockingOptimizer::fromFile(std::istream &s, std::size_t maxCliques)
 {
 	int n;
 	s >> n;
 	std::vector<std::vector<int>> ret(n);
-	while (s) {
-		int f, t;
-		s >> f >> t;
+	int f, t;
+	while (s >> f >> t) {
 		if (f < 0 || t < 0 || f >= n || t >= n) {
 			throw std::runtime_error("Invalid node number");
 		}
 		ret[f].push_back(t);
 		ret[t].push_back(f);
 	}
-	return LogicLockingOptimizer(ret);
-}
\ No newline at end of file
+	return LogicLockingOptimizer(ret, maxCliques);
+}
+
+LogicLockingOptimizer LogicLockingOptimizer::fromFile(const std::string &filename, std::size_t maxCliques)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if (!f) {
+		throw std::runtime_error("Could not open " + filename);
+	}
+	char magic[sizeof(graphMagic)] = {};
+	f.read(magic, sizeof(magic));
+	if (f && std::memcmp(magic, graphMagic, sizeof(graphMagic)) == 0) {
+		return fromBinaryFile(filename, maxCliques);
+	}
+	f.clear();
+	f.seekg(0);
+	return fromFile(f, maxCliques);
+}
+
+LogicLockingOptimizer LogicLockingOptimizer::fromBinaryFile(const std::string &filename, std::size_t maxCliques)
+{
+	// Shared with the optimizer, which uses the mapping in place if the graph is clean
+	auto mapping = std::make_shared<MappedFile>(filename);
+	const MappedFile &f = *mapping;
+	if (!f.valid()) {
+		throw std::runtime_error("Could not open " + filename);
+	}
+	std::uint64_t header[3];
+	if (f.size() < sizeof(header)) {
+		throw std::runtime_error("Truncated interference graph file " + filename);
+	}
+	std::memcpy(header, f.data(), sizeof(header));
+	std::uint64_t nbNodes = header[1];
+	std::uint64_t nbNeighbours = header[2];
+	if (std::memcmp(header, graphMagic, sizeof(graphMagic)) != 0 || nbNodes >= (1ull << 31) || nbNeighbours >= (1ull << 60)) {
+		throw std::runtime_error("Invalid interference graph file " + filename);
+	}
+	std::size_t offsetsSize = (nbNodes + 1) * sizeof(std::uint64_t);
+	if (f.size() != sizeof(header) + offsetsSize + nbNeighbours * sizeof(std::uint32_t)) {
+		throw std::runtime_error("Truncated interference graph file " + filename);
+	}
+	// The file data is 8-byte aligned and so is the header size: both arrays are validated and used from the mapping without parsing
+	const std::uint64_t *offsets = reinterpret_cast<const std::uint64_t *>(f.data() + sizeof(header));
+	const std::uint32_t *neighbours = reinterpret_cast<const std::uint32_t *>(f.data() + sizeof(header) + offsetsSize);
+	if (offsets[0] != 0 || offsets[nbNodes] != nbNeighbours) {
+		throw std::runtime_error("Invalid interference graph file " + filename);
+	}
+	for (std::uint64_t i = 0; i < nbNodes; ++i) {
+		if (offsets[i] > offsets[i + 1]) {
+			throw std::runtime_error("Invalid interference graph file " + filename);
+		}
+	}
+	for (std::uint64_t i = 0; i < nbNeighbours; ++i) {
+		if (neighbours[i] >= nbNodes) {
+			throw std::runtime_error("Invalid node number");
+		}
+	}
+	return LogicLockingOptimizer(nbNodes, offsets, neighbours, mapping, maxCliques);
+}
+
+void LogicLockingOptimizer::toBinaryFile(std::ostream &s, const std::vector<std::vector<int>> &pairwiseInterference)
+{
+	std::vector<std::uint64_t> offsets(1, 0);
+	for (const auto &v : pairwiseInterference) {
+		offsets.push_back(offsets.back() + v.size());
+	}
+	std::uint64_t header[3];
+	std::memcpy(header, graphMagic, sizeof(graphMagic));
+	header[1] = pairwiseInterference.size();
+	header[2] = offsets.back();
+	s.write(reinterpret_cast<const char *>(header), sizeof(header));
+	s.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(std::uint64_t));
+	std::vector<std::uint32_t> neighbours;
+	for (const auto &v : pairwiseInterference) {
+		neighbours.assign(v.begin(), v.end());
+		s.write(reinterpret_cast<const char *>(neighbours.data()), neighbours.size() * sizeof(std::uint32_t));
+	}
+}
@@ -5,7 +5,11 @@
 #ifndef MOOSIC_LOGIC_OPTIMIZER_H
 #define MOOSIC_LOGIC_OPTIMIZER_H
 
+#include <cstddef>
+#include <cstdint>
 #include <iosfwd>
+#include <memory>
+#include <string>
 #include <vector>
 
 /**
@@ -26,21 +30,89 @@ class LogicLockingOptimizer
 	 */
 	using ExplicitSolution = std::vector<std::vector<int>>;
 
+	/**
+	 * @brief Neighbours of a node, as a view of its sorted range in the adjacency array
+	 */
+	class Neighbours
+	{
+	      public:
+		Neighbours(const std::uint32_t *begin, const std::uint32_t *end) : begin_(begin), end_(end) {}
+		const std::uint32_t *begin() const { return begin_; }
+		const std::uint32_t *end() const { return end_; }
+		std::size_t size() const { return end_ - begin_; }
+		bool empty() const { return begin_ == end_; }
+		int front() const { return *begin_; }
+
+	      private:
+		const std::uint32_t *begin_;
+		const std::uint32_t *end_;
+	};
+
 	/**
 	 * @brief Read the problem from a simple file format (number of nodes then all
 	 * edges)
 	 */
-	static LogicLockingOptimizer fromFile(std::istream &s);
+	static LogicLockingOptimizer fromFile(std::istream &s, std::size_t maxCliques = 0);
+
+	/**
+	 * @brief Read the problem from a file, in the binary format if it starts with its magic number, in the text format otherwise
+	 */
+	static LogicLockingOptimizer fromFile(const std::string &filename, std::size_t maxCliques = 0);
+
+	/**
+	 * @brief Read the problem from a file in the binary format, memory-mapped
+	 *
+	 * The format is the adjacency of the graph in compressed row format: the magic number "MOOSICG1",
+	 * the number of nodes and of neighbour entries (64-bit), then the nbNodes + 1 offsets (64-bit) and
+	 * the neighbours (32-bit), in native byte order. Each edge appears in both directions.
+	 *
+	 * The file is not parsed: if the graph is already clean (sorted, symmetric, without self-loops or exclusive
+	 * equivalent nodes, as written by toBinaryFile for most graphs), the mapping is used in place without any copy.
+	 * Otherwise, the arrays are copied once and cleaned up.
+	 */
+	static LogicLockingOptimizer fromBinaryFile(const std::string &filename, std::size_t maxCliques = 0);
+
+	/**
+	 * @brief Write an interference graph in the binary format
+	 */
+	static void toBinaryFile(std::ostream &s, const std::vector<std::vector<int>> &pairwiseInterference);
 
 	/**
 	 * @brief Build the optimization problem
+	 *
+	 * @param maxCliques Give up the enumeration of maximal cliques beyond this number (0 for no limit).
+	 * Only solveHeuristic is available in this case.
+	 */
+	LogicLockingOptimizer(const std::vector<std::vector<int>> &pairwiseInterference, std::size_t maxCliques = 0);
+
+	/**
+	 * @brief Build the optimization problem from a graph in compressed row format
+	 *
+	 * The neighbours of node i are neighbours[offsets[i]] to neighbours[offsets[i + 1] - 1]. The arrays are copied
+	 * once and cleaned up in place.
 	 */
-	LogicLockingOptimizer(const std::vector<std::vector<int>> &pairwiseInterference);
+	LogicLockingOptimizer(int nbNodes, const std::uint64_t *offsets, const std::uint32_t *neighbours, std::size_t maxCliques = 0);
+
+	/**
+	 * @brief Build the optimization problem from a graph in compressed row format, used in place if it is already clean
+	 *
+	 * The storage keeps the arrays alive for the lifetime of the optimizer, for example a memory-mapped file.
+	 * If the graph needs a cleanup, the arrays are copied once instead.
+	 */
+	LogicLockingOptimizer(int nbNodes, const std::uint64_t *offsets, const std::uint32_t *neighbours, std::shared_ptr<const void> storage,
+			      std::size_t maxCliques = 0);
+
+	/**
+	 * @brief Build the optimization problem from a graph in compressed row format, taking ownership of the arrays
+	 *
+	 * The arrays are cleaned up in place, without copy.
+	 */
+	LogicLockingOptimizer(std::vector<std::uint64_t> offsets, std::vector<std::uint32_t> neighbours, std::size_t maxCliques = 0);
 
 	/**
 	 * @brief Number of nodes in the interference graph
 	 */
-	int nbNodes() const { return pairwiseInterference_.size(); }
+	int nbNodes() const { return nbNodes_; }
 
 	/**
 	 * @brief Number of nodes with connections in the interference graph
@@ -52,6 +124,16 @@ class LogicLockingOptimizer
 	 */
 	int nbEdges() const;
 
+	/**
+	 * @brief Number of maximal cliques of the interference graph
+	 */
+	int nbCliques() const { return cliques_.size(); }
+
+	/**
+	 * @brief Query whether all maximal cliques were enumerated at construction time, as required by solveGreedy
+	 */
+	bool cliquesEnumerated() const { return cliquesEnumerated_; }
+
 	/**
 	 * @brief Obtain the objective value associated with a solution
 	 *
@@ -59,15 +141,27 @@ class LogicLockingOptimizer
 	 */
 	double value(const ExplicitSolution &sol) const;
 
+	/**
+	 * @brief Obtain the objective value of every prefix of a solution, adding its nodes one at a time
+	 *
+	 * The solution is checked once, and the values are obtained with a running log-sum-exp.
+	 */
+	std::vector<double> valueCurve(const ExplicitSolution &sol) const;
+
 	/**
 	 * @brief Check that a list of disjoint cliques is valid
 	 */
 	void check(const ExplicitSolution &sol) const;
 
 	/**
-	 * Return the node's neighbours in the pairwise interference graph
+	 * Return the node's neighbours in the pairwise interference graph, sorted
 	 */
-	const std::vector<int> &neighbours(int node) const { return pairwiseInterference_[node]; }
+	Neighbours neighbours(int node) const
+	{
+		const std::uint32_t *data = neighbours_ ? neighbours_ : ownedNeighbours_.data();
+		const std::uint64_t *offsets = offsets_ ? offsets_ : ownedOffsets_.data();
+		return Neighbours(data + offsets[node], data + offsets[node + 1]);
+	}
 
 	/**
 	 * @brief Check whether an edge is present
@@ -81,9 +175,19 @@ class LogicLockingOptimizer
 
 	/**
 	 * @brief List all maximal cliques in the pairwise interference graph
+	 *
+	 * Uses Bron-Kerbosch with Tomita pivoting, on bitsets restricted to the neighbourhood of each
+	 * node in degeneracy order. The cliques are sorted, and returned in lexicographic order.
 	 */
 	std::vector<std::vector<int>> listMaximalCliques() const;
 
+	/**
+	 * @brief List the maximal cliques as listMaximalCliques, giving up beyond maxCliques cliques (0 for no limit)
+	 *
+	 * @return false if the enumeration was abandoned
+	 */
+	bool listMaximalCliques(std::size_t maxCliques, std::vector<std::vector<int>> &cliques) const;
+
 	/**
 	 * @brief Transform a list of cliques into a single list of nodes
 	 */
@@ -96,10 +200,22 @@ class LogicLockingOptimizer
 	ExplicitSolution solveGreedy(int maxNumber) const;
 
 	/**
-	 * @brief Obtain a logic locking with a simple heuristic, adding new nodes one
-	 * after the other
+	 * @brief Obtain a logic locking with a heuristic that does not enumerate the cliques
+	 *
+	 * Cliques are grown greedily from the nodes of highest degree, then the solution is improved
+	 * by local search: moving nodes to larger cliques and swapping one node of a clique for two.
+	 * Only the adjacency lists are used, so that it scales to large interference graphs.
+	 *
+	 * @param timeLimit Time limit in seconds (0 for no limit); the best solution found so far is returned
+	 */
+	ExplicitSolution solveHeuristic(int maxNumber, double timeLimit = 0.0) const { return solveHeuristic(maxNumber, Solution(), timeLimit); }
+
+	/**
+	 * @brief Obtain a logic locking with the heuristic, keeping nodes that are already locked
+	 *
+	 * The nodes already locked are part of the solution, and may be regrouped into different cliques.
 	 */
-	ExplicitSolution solveHeuristic(int maxNumber) const;
+	ExplicitSolution solveHeuristic(int maxNumber, const Solution &preLocked, double timeLimit = 0.0) const;
 
 	/**
 	 * @brief Check that the internal datastructures are well-formed
@@ -107,37 +223,63 @@ class LogicLockingOptimizer
 	void check() const;
 
       private:
+	/**
+	 * @brief Enumerate the cliques at construction time, once the graph is clean
+	 */
+	void init(std::size_t maxCliques);
+
+	/**
+	 * @brief Cleanup the owned arrays in place at construction time, then compact them
+	 *
+	 * Each node's neighbours stay within its original range, with the current number of neighbours in length.
+	 */
+	void cleanup();
+
 	/**
 	 * @brief Cleanup at construction time: ensure that all neighbour lists are
 	 * sorted
 	 */
-	void sortNeighbours();
+	void sortNeighbours(std::vector<std::uint32_t> &length);
 
 	/**
 	 * @brief Cleanup at construction time: ensure that there are no (v, v) edges
 	 */
-	void removeSelfLoops();
+	void removeSelfLoops(std::vector<std::uint32_t> &length);
 
 	/**
 	 * @brief Cleanup at construction time: remove edges that are not present in
 	 * both directions
 	 */
-	void removeDirectedEdges();
+	void removeDirectedEdges(std::vector<std::uint32_t> &length);
 
 	/**
 	 * @brief Cleanup at construction time: remove nodes that have no edge between them but
 	 * have otherwise identical connections
 	 */
-	void removeExclusiveEquivalentNodes();
+	void removeExclusiveEquivalentNodes(std::vector<std::uint32_t> &length);
 
 	/**
-	 * @brief Recursive function for the enumeration of maximal cliques
+	 * @brief Query whether a graph in compressed row format needs no cleanup
+	 */
+	static bool isClean(int nbNodes, const std::uint64_t *offsets, const std::uint32_t *neighbours);
+
+	/**
+	 * @brief Order the nodes by repeatedly removing a node of minimum degree
+	 *
+	 * Each node has at most d neighbours later in the order, d being the degeneracy of the graph.
 	 */
-	void bronKerbosch(std::vector<int> R, std::vector<int> P, std::vector<int> X, std::vector<std::vector<int>> &ret) const;
+	std::vector<int> degeneracyOrder() const;
 
       private:
-	std::vector<std::vector<int>> pairwiseInterference_;
+	int nbNodes_;
+	// Adjacency in compressed row format, in the owned arrays, or in the arrays of the caller kept alive by storage_
+	std::vector<std::uint64_t> ownedOffsets_;
+	std::vector<std::uint32_t> ownedNeighbours_;
+	const std::uint64_t *offsets_;
+	const std::uint32_t *neighbours_;
+	std::shared_ptr<const void> storage_;
 	std::vector<std::vector<int>> cliques_;
+	bool cliquesEnumerated_;
 };
 
 #endif
\ No newline at end of file
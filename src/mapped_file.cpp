@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &filename) : data_(nullptr), size_(0), valid_(false), mapped_(false)
+{
+#ifndef _WIN32
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return;
+	}
+	valid_ = true;
+	size_ = st.st_size;
+	if (size_ != 0) {
+		void *ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr != MAP_FAILED) {
+			data_ = static_cast<const char *>(ptr);
+			mapped_ = true;
+		}
+	}
+	close(fd);
+	if (mapped_ || size_ == 0) {
+		return;
+	}
+#endif
+	// Fallback: read the whole file
+	std::ifstream f(filename, std::ios::binary);
+	if (!f) {
+		valid_ = false;
+		return;
+	}
+	buffer_.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	valid_ = true;
+	data_ = buffer_.data();
+	size_ = buffer_.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+	if (mapped_) {
+		munmap(const_cast<char *>(data_), size_);
+	}
+#endif
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#ifndef MOOSIC_MAPPED_FILE_H
+#define MOOSIC_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A read-only view of a whole file, memory-mapped when the platform supports it
+ *
+ * On other platforms, the file is read into memory instead.
+ */
+class MappedFile
+{
+      public:
+	/**
+	 * @brief Map a file; the view is empty if the file cannot be opened
+	 */
+	explicit MappedFile(const std::string &filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	/**
+	 * @brief Query whether the file could be opened
+	 */
+	bool valid() const { return valid_; }
+
+	/**
+	 * @brief Start of the file contents
+	 */
+	const char *data() const { return data_; }
+
+	/**
+	 * @brief Size of the file in bytes
+	 */
+	std::size_t size() const { return size_; }
+
+      private:
+	const char *data_;
+	std::size_t size_;
+	bool valid_;
+	bool mapped_;
+	std::vector<char> buffer_;
+};
+
+#endif
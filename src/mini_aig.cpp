@@ -4,6 +4,10 @@
 
 #include "mini_aig.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
 
 std::vector<std::uint64_t> MiniAIG::simulate(const std::vector<std::uint64_t> &inputVals)
 {
@@ -13,7 +17,7 @@ std::vector<std::uint64_t> MiniAIG::simulate(const std::vector<std::uint64_t> &i
 		state_[i + 1] = inputVals[i];
 	}
 	for (std::size_t i = 0; i < nodes_.size(); ++i) {
-		state_[i + nbInputs_ + 1] = getValue(nodes_[i].a) & getValue(nodes_[i].b);
+		state_[i + nbInputs_ + 1] = evaluate(nodes_[i]);
 	}
 	return getOutputValues();
 }
@@ -39,11 +43,121 @@ std::vector<std::uint64_t> MiniAIG::simulateWithToggling(const std::vector<std::
 		std::uint64_t t = toggles[i + nbInputs_ + 1];
 		t = ~t + 1;
 		assert(t == 0 || t == (std::uint64_t)-1);
-		state_[i + nbInputs_ + 1] = t ^ (getValue(nodes_[i].a) & getValue(nodes_[i].b));
+		state_[i + nbInputs_ + 1] = t ^ evaluate(nodes_[i]);
 	}
 	return getOutputValues();
 }
 
+std::uint64_t MiniAIG::evaluate(const AIGNode &n) const
+{
+	std::uint64_t a = getValue(n.a);
+	std::uint64_t b = getValue(n.b);
+	switch (n.kind) {
+	case XOR_NODE:
+		return a ^ b;
+	case MUX_NODE:
+		return a ^ (getValue(n.s) & (a ^ b));
+	default:
+		return a & b;
+	}
+}
+
+Lit MiniAIG::addStrashedNode(const AIGNode &n)
+{
+	auto it = strash_.find(n);
+	if (it != strash_.end()) {
+		return Lit(it->second << 1);
+	}
+	Lit ret = addRawNode(n);
+	strash_.emplace(n, ret.variable());
+	return ret;
+}
+
+Lit MiniAIG::addStrashedAnd(Lit a, Lit b)
+{
+	if (b.data < a.data) {
+		std::swap(a, b);
+	}
+	// Constants have the smallest literals
+	if (a.data == Lit::zero().data || a.data == b.inv().data) {
+		return Lit::zero();
+	}
+	if (a.data == Lit::one().data || a.data == b.data) {
+		return b;
+	}
+	return addStrashedNode(AIGNode(AND_NODE, a, b));
+}
+
+Lit MiniAIG::addStrashedXor(Lit a, Lit b)
+{
+	bool inv = a.polarity() != b.polarity();
+	a = Lit(a.data & ~1u);
+	b = Lit(b.data & ~1u);
+	if (b.data < a.data) {
+		std::swap(a, b);
+	}
+	Lit ret;
+	if (a.data == b.data) {
+		ret = Lit::zero();
+	} else if (a.data == Lit::zero().data) {
+		ret = b;
+	} else {
+		ret = addStrashedNode(AIGNode(XOR_NODE, a, b));
+	}
+	return inv ? ret.inv() : ret;
+}
+
+Lit MiniAIG::addStrashedMux(Lit s, Lit a, Lit b)
+{
+	if (s.polarity()) {
+		s = s.inv();
+		std::swap(a, b);
+	}
+	if (s.data == Lit::zero().data || a.data == b.data) {
+		return a;
+	}
+	if (a.data == b.inv().data) {
+		return addStrashedXor(s, a);
+	}
+	// Reduce to an and gate when a data input is a constant or the selector itself
+	if (a.data == Lit::zero().data || a.data == s.data) {
+		return addStrashedAnd(s, b);
+	}
+	if (a.data == Lit::one().data || a.data == s.inv().data) {
+		return addStrashedAnd(s, b.inv()).inv();
+	}
+	if (b.data == Lit::zero().data || b.data == s.inv().data) {
+		return addStrashedAnd(s.inv(), a);
+	}
+	if (b.data == Lit::one().data || b.data == s.data) {
+		return addStrashedAnd(s.inv(), a.inv()).inv();
+	}
+	// The first data input is stored without complement
+	if (a.polarity()) {
+		return addStrashedNode(AIGNode(MUX_NODE, a.inv(), b.inv(), s)).inv();
+	}
+	return addStrashedNode(AIGNode(MUX_NODE, a, b, s));
+}
+
+Lit MiniAIG::makePrivate(Lit a, int firstNode)
+{
+	if (!strashing_) {
+		return a;
+	}
+	std::uint32_t firstVar = firstNode + nbInputs_ + 1;
+	if (a.variable() >= firstVar) {
+		auto it = strash_.find(nodes_[a.variable() - nbInputs_ - 1]);
+		if (it != strash_.end() && it->second == a.variable()) {
+			strash_.erase(it);
+			return a;
+		}
+	}
+	// Already shared with another signal, an input or a constant
+	Lit v(a.variable() << 1);
+	Lit ret = addRawAnd(v, v);
+	return a.polarity() ? ret.inv() : ret;
+}
+
 std::vector<std::uint64_t> MiniAIG::getOutputValues() const
 {
 	std::vector<std::uint64_t> ret;
@@ -52,3 +166,644 @@ std::vector<std::uint64_t> MiniAIG::getOutputValues() const
 	}
 	return ret;
 }
+
+CompactAIG::CompactAIG(const MiniAIG &aig) : nbInputs_(aig.nbInputs_)
+{
+	std::uint32_t firstNode = nbInputs_ + 1;
+	std::uint32_t nbVars = firstNode + aig.nodes_.size();
+	const int nbKinds = 3;
+
+	// Compute the topological level of each variable and renumber the nodes by level, then by kind
+	std::vector<std::uint32_t> level(nbVars, 0);
+	std::uint32_t maxLevel = 0;
+	for (std::size_t i = 0; i < aig.nodes_.size(); ++i) {
+		const MiniAIG::AIGNode &n = aig.nodes_[i];
+		std::uint32_t l = 1 + std::max(level[n.a.variable()], level[n.b.variable()]);
+		if (n.kind == MUX_NODE) {
+			l = std::max(l, 1 + level[n.s.variable()]);
+		}
+		level[firstNode + i] = l;
+		maxLevel = std::max(maxLevel, l);
+	}
+	std::vector<std::uint32_t> bucket(aig.nodes_.size());
+	std::vector<std::uint32_t> bucketBegin(nbKinds * (maxLevel + 1) + 1, 0);
+	for (std::size_t i = 0; i < aig.nodes_.size(); ++i) {
+		bucket[i] = nbKinds * level[firstNode + i] + aig.nodes_[i].kind;
+		++bucketBegin[bucket[i] + 1];
+	}
+	for (std::size_t b = 0; b + 1 < bucketBegin.size(); ++b) {
+		if (bucketBegin[b + 1] != 0) {
+			segmentBegin_.push_back(bucketBegin[b]);
+			segmentKind_.push_back((NodeKind)(b % nbKinds));
+		}
+		bucketBegin[b + 1] += bucketBegin[b];
+	}
+	segmentBegin_.push_back(aig.nodes_.size());
+	newVariable_.resize(nbVars);
+	for (std::uint32_t v = 0; v < firstNode; ++v) {
+		newVariable_[v] = v;
+	}
+	for (std::size_t i = 0; i < aig.nodes_.size(); ++i) {
+		newVariable_[firstNode + i] = firstNode + bucketBegin[bucket[i]]++;
+	}
+
+	// Fill the fanin arrays in the new order
+	kind_.resize(aig.nodes_.size());
+	fanin0_.resize(aig.nodes_.size());
+	fanin1_.resize(aig.nodes_.size());
+	selector_.resize(aig.nodes_.size());
+	mask0_.resize(aig.nodes_.size());
+	mask1_.resize(aig.nodes_.size());
+	for (std::size_t i = 0; i < aig.nodes_.size(); ++i) {
+		const MiniAIG::AIGNode &n = aig.nodes_[i];
+		std::uint32_t node = newVariable_[firstNode + i] - firstNode;
+		kind_[node] = n.kind;
+		fanin0_[node] = newVariable_[n.a.variable()];
+		fanin1_[node] = newVariable_[n.b.variable()];
+		selector_[node] = newVariable_[n.s.variable()];
+		mask0_[node] = ~(std::uint64_t)n.a.polarity() + 1;
+		mask1_[node] = ~(std::uint64_t)n.b.polarity() + 1;
+	}
+	for (Lit l : aig.outputs_) {
+		outputVars_.push_back(newVariable_[l.variable()]);
+		outputMasks_.push_back(~(std::uint64_t)l.polarity() + 1);
+	}
+
+	// Build the fanout arrays
+	fanoutBegin_.assign(nbVars + 1, 0);
+	outputUsersBegin_.assign(nbVars + 1, 0);
+	for (std::size_t i = 0; i < fanin0_.size(); ++i) {
+		forEachFanin(i, [&](std::uint32_t v) { ++fanoutBegin_[v + 1]; });
+	}
+	for (std::uint32_t v : outputVars_) {
+		++outputUsersBegin_[v + 1];
+	}
+	for (std::uint32_t v = 0; v < nbVars; ++v) {
+		fanoutBegin_[v + 1] += fanoutBegin_[v];
+		outputUsersBegin_[v + 1] += outputUsersBegin_[v];
+	}
+	fanouts_.resize(fanoutBegin_.back());
+	outputUsers_.resize(outputUsersBegin_.back());
+	std::vector<std::uint32_t> pos(fanoutBegin_.begin(), fanoutBegin_.end() - 1);
+	for (std::size_t i = 0; i < fanin0_.size(); ++i) {
+		std::uint32_t var = i + firstNode;
+		forEachFanin(i, [&](std::uint32_t v) { fanouts_[pos[v]++] = var; });
+	}
+	pos.assign(outputUsersBegin_.begin(), outputUsersBegin_.end() - 1);
+	for (std::size_t i = 0; i < outputVars_.size(); ++i) {
+		outputUsers_[pos[outputVars_[i]]++] = i;
+	}
+
+	// Fanout-free regions, in reverse topological order; a node using the same variable twice is not tracked through
+	ffrRoot_.resize(nbVars);
+	for (std::uint32_t v = nbVars; v-- > 0;) {
+		ffrRoot_[v] = v;
+		if (fanoutBegin_[v + 1] - fanoutBegin_[v] != 1 || outputUsersBegin_[v + 1] != outputUsersBegin_[v]) {
+			continue;
+		}
+		std::uint32_t f = fanouts_[fanoutBegin_[v]];
+		if (nbUses(f - firstNode, v) == 1) {
+			ffrRoot_[v] = ffrRoot_[f];
+		}
+	}
+}
+
+void CompactAIG::evaluateNode(std::uint32_t node, const std::uint64_t *state, int nbWords, std::uint64_t *ret) const
+{
+	const std::uint64_t *a = state + (std::size_t)fanin0_[node] * nbWords;
+	const std::uint64_t *b = state + (std::size_t)fanin1_[node] * nbWords;
+	std::uint64_t ma = mask0_[node];
+	std::uint64_t mb = mask1_[node];
+	switch (kind_[node]) {
+	case XOR_NODE:
+		for (int w = 0; w < nbWords; ++w) {
+			ret[w] = a[w] ^ b[w] ^ ma ^ mb;
+		}
+		break;
+	case MUX_NODE: {
+		const std::uint64_t *s = state + (std::size_t)selector_[node] * nbWords;
+		for (int w = 0; w < nbWords; ++w) {
+			std::uint64_t x = a[w] ^ ma;
+			ret[w] = x ^ (s[w] & (x ^ b[w] ^ mb));
+		}
+		break;
+	}
+	default:
+		for (int w = 0; w < nbWords; ++w) {
+			ret[w] = (a[w] ^ ma) & (b[w] ^ mb);
+		}
+	}
+}
+
+OutputSupport::OutputSupport(const CompactAIG &aig) : nbOutputs_(aig.nbOutputs()), nbOutputWords_((aig.nbOutputs() + 63) / 64)
+{
+	std::size_t nbVars = aig.nbVariables();
+	supportId_.assign(nbVars, 0);
+	// The empty support is always the first one
+	supports_.assign(nbOutputWords_, 0);
+	std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> byHash;
+	std::vector<std::uint64_t> support(nbOutputWords_);
+	// Fanouts have larger variable numbers: process the variables in reverse topological order
+	for (std::size_t v = nbVars; v-- > 0;) {
+		std::fill(support.begin(), support.end(), 0);
+		bool empty = true;
+		for (std::uint32_t i = aig.outputUsersBegin_[v]; i < aig.outputUsersBegin_[v + 1]; ++i) {
+			std::uint32_t o = aig.outputUsers_[i];
+			support[o / 64] |= (std::uint64_t)1 << (o % 64);
+			empty = false;
+		}
+		for (std::uint32_t i = aig.fanoutBegin_[v]; i < aig.fanoutBegin_[v + 1]; ++i) {
+			std::uint32_t id = supportId_[aig.fanouts_[i]];
+			if (id == 0) {
+				continue;
+			}
+			const std::uint64_t *s = supports_.data() + (std::size_t)id * nbOutputWords_;
+			for (int w = 0; w < nbOutputWords_; ++w) {
+				support[w] |= s[w];
+			}
+			empty = false;
+		}
+		if (empty) {
+			continue;
+		}
+		std::uint64_t h = 0;
+		for (std::uint64_t w : support) {
+			h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+			h ^= h >> 29;
+		}
+		std::vector<std::uint32_t> &candidates = byHash[h];
+		std::uint32_t id = 0;
+		for (std::uint32_t c : candidates) {
+			if (std::equal(support.begin(), support.end(), supports_.begin() + (std::size_t)c * nbOutputWords_)) {
+				id = c;
+				break;
+			}
+		}
+		if (id == 0) {
+			id = supports_.size() / nbOutputWords_;
+			supports_.insert(supports_.end(), support.begin(), support.end());
+			candidates.push_back(id);
+		}
+		supportId_[v] = id;
+	}
+}
+
+bool OutputSupport::intersects(std::uint32_t a, std::uint32_t b) const
+{
+	const std::uint64_t *sa = getSupport(a);
+	const std::uint64_t *sb = getSupport(b);
+	for (int w = 0; w < nbOutputWords_; ++w) {
+		if (sa[w] & sb[w]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<int> OutputSupport::getOutputs(std::uint32_t var) const { return getCommonOutputs(var, var); }
+
+std::vector<int> OutputSupport::getCommonOutputs(std::uint32_t a, std::uint32_t b) const
+{
+	std::vector<int> ret;
+	const std::uint64_t *sa = getSupport(a);
+	const std::uint64_t *sb = getSupport(b);
+	for (int w = 0; w < nbOutputWords_; ++w) {
+		std::uint64_t v = sa[w] & sb[w];
+		while (v) {
+			ret.push_back(64 * w + __builtin_ctzll(v));
+			v &= v - 1;
+		}
+	}
+	return ret;
+}
+
+namespace {
+/**
+ * Node arrays of a CompactAIG, passed to the simulation kernels
+ */
+struct NodeArrays {
+	const std::uint32_t *fanin0;
+	const std::uint32_t *fanin1;
+	const std::uint32_t *selector;
+	const std::uint64_t *mask0;
+	const std::uint64_t *mask1;
+	const std::uint32_t *segmentBegin;
+	const NodeKind *segmentKind;
+	std::size_t nbSegments;
+	std::size_t firstNode;
+};
+
+/**
+ * Node simulation kernels for a segment of nodes of the same kind, with a compile-time number of words (W > 0)
+ * so that the inner loop is vectorized
+ */
+template <int W> inline void simulateAnd(const NodeArrays &n, std::size_t begin, std::size_t end, std::uint64_t *state, int nw)
+{
+	std::uint64_t *out = state + (n.firstNode + begin) * nw;
+	for (std::size_t i = begin; i < end; ++i, out += nw) {
+		const std::uint64_t *a = state + (std::size_t)n.fanin0[i] * nw;
+		const std::uint64_t *b = state + (std::size_t)n.fanin1[i] * nw;
+		std::uint64_t ma = n.mask0[i];
+		std::uint64_t mb = n.mask1[i];
+		for (int w = 0; w < (W > 0 ? W : nw); ++w) {
+			out[w] = (a[w] ^ ma) & (b[w] ^ mb);
+		}
+	}
+}
+
+template <int W> inline void simulateXor(const NodeArrays &n, std::size_t begin, std::size_t end, std::uint64_t *state, int nw)
+{
+	std::uint64_t *out = state + (n.firstNode + begin) * nw;
+	for (std::size_t i = begin; i < end; ++i, out += nw) {
+		const std::uint64_t *a = state + (std::size_t)n.fanin0[i] * nw;
+		const std::uint64_t *b = state + (std::size_t)n.fanin1[i] * nw;
+		std::uint64_t m = n.mask0[i] ^ n.mask1[i];
+		for (int w = 0; w < (W > 0 ? W : nw); ++w) {
+			out[w] = a[w] ^ b[w] ^ m;
+		}
+	}
+}
+
+template <int W> inline void simulateMux(const NodeArrays &n, std::size_t begin, std::size_t end, std::uint64_t *state, int nw)
+{
+	std::uint64_t *out = state + (n.firstNode + begin) * nw;
+	for (std::size_t i = begin; i < end; ++i, out += nw) {
+		const std::uint64_t *a = state + (std::size_t)n.fanin0[i] * nw;
+		const std::uint64_t *b = state + (std::size_t)n.fanin1[i] * nw;
+		const std::uint64_t *s = state + (std::size_t)n.selector[i] * nw;
+		std::uint64_t ma = n.mask0[i];
+		std::uint64_t mb = n.mask1[i];
+		for (int w = 0; w < (W > 0 ? W : nw); ++w) {
+			std::uint64_t x = a[w] ^ ma;
+			out[w] = x ^ (s[w] & (x ^ b[w] ^ mb));
+		}
+	}
+}
+
+template <int W> inline void simulateNodes(const NodeArrays &n, std::uint64_t *state, int nbWords = W)
+{
+	const int nw = W > 0 ? W : nbWords;
+	for (std::size_t k = 0; k < n.nbSegments; ++k) {
+		std::size_t begin = n.segmentBegin[k];
+		std::size_t end = n.segmentBegin[k + 1];
+		switch (n.segmentKind[k]) {
+		case XOR_NODE:
+			simulateXor<W>(n, begin, end, state, nw);
+			break;
+		case MUX_NODE:
+			simulateMux<W>(n, begin, end, state, nw);
+			break;
+		default:
+			simulateAnd<W>(n, begin, end, state, nw);
+		}
+	}
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MOOSIC_X86_DISPATCH
+__attribute__((target("avx512f"), flatten)) void simulateNodesAvx512(const NodeArrays &n, std::uint64_t *state) { simulateNodes<8>(n, state); }
+
+__attribute__((target("avx2"), flatten)) void simulateNodesAvx2(const NodeArrays &n, std::uint64_t *state) { simulateNodes<4>(n, state); }
+
+bool hasAvx512()
+{
+	static const bool ret = __builtin_cpu_supports("avx512f");
+	return ret;
+}
+
+bool hasAvx2()
+{
+	static const bool ret = __builtin_cpu_supports("avx2");
+	return ret;
+}
+#endif
+} // namespace
+
+int CompactAIG::preferredNbWords()
+{
+#ifdef MOOSIC_X86_DISPATCH
+	if (hasAvx512()) {
+		return 8;
+	}
+#endif
+	return 4;
+}
+
+void CompactAIG::simulateWords(std::uint64_t *state, int nbWords) const
+{
+	NodeArrays n{fanin0_.data(), fanin1_.data(), selector_.data(), mask0_.data(), mask1_.data(), segmentBegin_.data(), segmentKind_.data(),
+		     segmentKind_.size(), (std::size_t)nbInputs_ + 1};
+#ifdef MOOSIC_X86_DISPATCH
+	if (nbWords == 8 && hasAvx512()) {
+		simulateNodesAvx512(n, state);
+		return;
+	}
+	if (nbWords == 4 && hasAvx2()) {
+		simulateNodesAvx2(n, state);
+		return;
+	}
+#endif
+	if (nbWords == 1) {
+		simulateNodes<1>(n, state);
+	} else if (nbWords == 4) {
+		simulateNodes<4>(n, state);
+	} else if (nbWords == 8) {
+		simulateNodes<8>(n, state);
+	} else {
+		simulateNodes<0>(n, state, nbWords);
+	}
+}
+
+IncrementalSimulation::IncrementalSimulation(const CompactAIG &aig, int nbWords)
+    : aig_(&aig), nbWords_(nbWords), observabilityValid_(false), nbNodeEvaluations_(0)
+{
+	assert(nbWords >= 1);
+	std::size_t nbVars = aig.nbVariables();
+	golden_.assign(nbVars * nbWords, 0);
+	state_.assign(nbVars * nbWords, 0);
+	queued_.assign(nbVars, 0);
+	toggled_.assign(nbVars, 0);
+	value_.assign(nbWords, 0);
+	inputFlips_.assign((std::size_t)(aig.nbInputs() + 1) * nbWords, 0);
+}
+
+void IncrementalSimulation::simulate(const std::vector<std::uint64_t> &inputVals)
+{
+	const CompactAIG &aig = *aig_;
+	assert(inputVals.size() == (std::size_t)aig.nbInputs_ * nbWords_);
+	// Constant value
+	std::fill(state_.begin(), state_.begin() + nbWords_, 0);
+	std::copy(inputVals.begin(), inputVals.end(), state_.begin() + nbWords_);
+	aig.simulateWords(state_.data(), nbWords_);
+	nbNodeEvaluations_ += aig.nbNodes();
+	golden_ = state_;
+	observabilityValid_ = false;
+	goldenOutputs_.resize((std::size_t)aig.nbOutputs() * nbWords_);
+	for (int i = 0; i < aig.nbOutputs(); ++i) {
+		getOutputValue(i, goldenOutputs_.data() + (std::size_t)i * nbWords_);
+	}
+}
+
+void IncrementalSimulation::getOutputValue(int output, std::uint64_t *ret) const
+{
+	const std::uint64_t *s = getWords(aig_->outputVars_[output]);
+	std::uint64_t m = aig_->outputMasks_[output];
+	for (int w = 0; w < nbWords_; ++w) {
+		ret[w] = s[w] ^ m;
+	}
+}
+
+void IncrementalSimulation::queue(std::uint32_t var)
+{
+	if (queued_[var]) {
+		return;
+	}
+	queued_[var] = 1;
+	heap_.push_back(var);
+	std::push_heap(heap_.begin(), heap_.end(), std::greater<std::uint32_t>());
+}
+
+std::vector<std::uint64_t> IncrementalSimulation::simulateWithToggling(const std::vector<Lit> &toggling)
+{
+	return simulateWithToggling(toggling, std::vector<int>(), std::vector<std::uint64_t>());
+}
+
+std::vector<std::uint64_t> IncrementalSimulation::simulateWithToggling(const std::vector<Lit> &toggling, const std::vector<int> &flippedInputs,
+								       const std::vector<std::uint64_t> &flipMasks)
+{
+	const CompactAIG &aig = *aig_;
+	std::uint32_t firstNode = aig.nbInputs_ + 1;
+	for (Lit t : toggling) {
+		// Forbid toggling on constants, or toggling the same variable twice
+		assert(!t.is_constant());
+		assert(!toggled_[t.variable()]);
+		toggled_[t.variable()] = 1;
+		queue(t.variable());
+	}
+	assert(flipMasks.size() == flippedInputs.size() * nbWords_);
+	for (std::size_t i = 0; i < flippedInputs.size(); ++i) {
+		std::uint32_t var = flippedInputs[i] + 1;
+		std::copy(flipMasks.begin() + i * nbWords_, flipMasks.begin() + (i + 1) * nbWords_, inputFlips_.begin() + (std::size_t)var * nbWords_);
+		queue(var);
+	}
+
+	// Variables are numbered in topological order: processing the smallest first guarantees
+	// that all fanins of a node are up-to-date when it is evaluated
+	std::uint64_t *val = value_.data();
+	while (!heap_.empty()) {
+		std::pop_heap(heap_.begin(), heap_.end(), std::greater<std::uint32_t>());
+		std::uint32_t var = heap_.back();
+		heap_.pop_back();
+		queued_[var] = 0;
+		std::uint64_t t = toggled_[var];
+		t = ~t + 1;
+		if (var < firstNode) {
+			const std::uint64_t *g = golden_.data() + (std::size_t)var * nbWords_;
+			const std::uint64_t *f = inputFlips_.data() + (std::size_t)var * nbWords_;
+			for (int w = 0; w < nbWords_; ++w) {
+				val[w] = g[w] ^ f[w] ^ t;
+			}
+		} else {
+			aig.evaluateNode(var - firstNode, state_.data(), nbWords_, val);
+			++nbNodeEvaluations_;
+			for (int w = 0; w < nbWords_; ++w) {
+				val[w] ^= t;
+			}
+		}
+		std::uint64_t *s = state_.data() + (std::size_t)var * nbWords_;
+		if (std::equal(val, val + nbWords_, s)) {
+			continue;
+		}
+		std::copy(val, val + nbWords_, s);
+		touched_.push_back(var);
+		for (std::uint32_t i = aig.fanoutBegin_[var]; i < aig.fanoutBegin_[var + 1]; ++i) {
+			queue(aig.fanouts_[i]);
+		}
+	}
+
+	// Only update the outputs reached by the cone, then restore the golden state
+	std::vector<std::uint64_t> ret = goldenOutputs_;
+	for (std::uint32_t var : touched_) {
+		for (std::uint32_t i = aig.outputUsersBegin_[var]; i < aig.outputUsersBegin_[var + 1]; ++i) {
+			std::uint32_t o = aig.outputUsers_[i];
+			getOutputValue(o, ret.data() + (std::size_t)o * nbWords_);
+		}
+	}
+	for (std::uint32_t var : touched_) {
+		std::size_t offset = (std::size_t)var * nbWords_;
+		std::copy(golden_.begin() + offset, golden_.begin() + offset + nbWords_, state_.begin() + offset);
+	}
+	touched_.clear();
+	for (Lit t : toggling) {
+		toggled_[t.variable()] = 0;
+	}
+	for (int i : flippedInputs) {
+		std::size_t offset = (std::size_t)(i + 1) * nbWords_;
+		std::fill(inputFlips_.begin() + offset, inputFlips_.begin() + offset + nbWords_, 0);
+	}
+	return ret;
+}
+
+void IncrementalSimulation::computeObservability()
+{
+	const CompactAIG &aig = *aig_;
+	std::uint32_t firstNode = aig.nbInputs_ + 1;
+	std::size_t nbVars = aig.nbVariables();
+	observability_.resize(nbVars * nbWords_);
+	// A toggle always propagates through a xor; through an and iff the other fanin is non-controlling;
+	// through a mux iff the data input is selected, or the data inputs differ for the selector
+	for (std::size_t v = nbVars; v-- > 0;) {
+		std::uint64_t *obs = observability_.data() + v * nbWords_;
+		if (aig.ffrRoot_[v] == v) {
+			std::fill(obs, obs + nbWords_, ~(std::uint64_t)0);
+			continue;
+		}
+		std::uint32_t f = aig.fanouts_[aig.fanoutBegin_[v]];
+		std::uint32_t node = f - firstNode;
+		const std::uint64_t *obsF = observability_.data() + (std::size_t)f * nbWords_;
+		const std::uint64_t *a = getWords(aig.fanin0_[node]);
+		const std::uint64_t *b = getWords(aig.fanin1_[node]);
+		std::uint64_t ma = aig.mask0_[node];
+		std::uint64_t mb = aig.mask1_[node];
+		bool first = aig.fanin0_[node] == v;
+		if (aig.kind_[node] == XOR_NODE) {
+			std::copy(obsF, obsF + nbWords_, obs);
+		} else if (aig.kind_[node] == AND_NODE) {
+			const std::uint64_t *side = first ? b : a;
+			std::uint64_t mask = first ? mb : ma;
+			for (int w = 0; w < nbWords_; ++w) {
+				obs[w] = obsF[w] & (side[w] ^ mask);
+			}
+		} else {
+			const std::uint64_t *s = getWords(aig.selector_[node]);
+			bool second = aig.fanin1_[node] == v;
+			for (int w = 0; w < nbWords_; ++w) {
+				std::uint64_t sensitive = first ? ~s[w] : second ? s[w] : a[w] ^ b[w] ^ ma ^ mb;
+				obs[w] = obsF[w] & sensitive;
+			}
+		}
+	}
+	observabilityValid_ = true;
+}
+
+std::vector<std::vector<std::uint64_t>> IncrementalSimulation::simulateSingleToggles(const std::vector<Lit> &toggling)
+{
+	const CompactAIG &aig = *aig_;
+	// Group the nodes by region
+	std::vector<int> order(toggling.size());
+	for (std::size_t i = 0; i < toggling.size(); ++i) {
+		assert(!toggling[i].is_constant());
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b) {
+		std::uint32_t ra = aig.ffrRoot_[toggling[a].variable()];
+		std::uint32_t rb = aig.ffrRoot_[toggling[b].variable()];
+		return ra != rb ? ra < rb : a < b;
+	});
+
+	std::vector<std::vector<std::uint64_t>> ret(toggling.size());
+	std::vector<int> changed;
+	for (std::size_t b = 0; b < order.size();) {
+		std::uint32_t root = aig.ffrRoot_[toggling[order[b]].variable()];
+		std::size_t e = b + 1;
+		while (e < order.size() && aig.ffrRoot_[toggling[order[e]].variable()] == root) {
+			++e;
+		}
+		if (e == b + 1) {
+			// Alone in its region: nothing to share
+			ret[order[b]] = simulateWithToggling({toggling[order[b]]});
+			b = e;
+			continue;
+		}
+		if (!observabilityValid_) {
+			computeObservability();
+		}
+		std::vector<std::uint64_t> toggled = simulateWithToggling({Lit(root << 1)});
+		changed.clear();
+		for (int o = 0; o < aig.nbOutputs(); ++o) {
+			std::size_t offset = (std::size_t)o * nbWords_;
+			if (!std::equal(toggled.begin() + offset, toggled.begin() + offset + nbWords_, goldenOutputs_.begin() + offset)) {
+				changed.push_back(o);
+			}
+		}
+		// The root toggles exactly on the test vectors where the node is observable
+		for (; b < e; ++b) {
+			const std::uint64_t *obs = observability_.data() + (std::size_t)toggling[order[b]].variable() * nbWords_;
+			std::vector<std::uint64_t> values = goldenOutputs_;
+			for (int o : changed) {
+				std::size_t offset = (std::size_t)o * nbWords_;
+				for (int w = 0; w < nbWords_; ++w) {
+					values[offset + w] ^= (values[offset + w] ^ toggled[offset + w]) & obs[w];
+				}
+			}
+			ret[order[b]] = std::move(values);
+		}
+	}
+	return ret;
+}
+
+SequentialSimulation::SequentialSimulation(const CompactAIG &aig, const std::vector<std::pair<int, int>> &registers, int nbWords)
+    : aig_(&aig), nbWords_(nbWords), registers_(registers), pastNodeEvaluations_(0)
+{
+	for (auto r : registers_) {
+		if (r.first < 0 || r.first >= aig.nbOutputs() || r.second < 0 || r.second >= aig.nbInputs()) {
+			throw std::runtime_error("Invalid register for the sequential simulation");
+		}
+	}
+}
+
+void SequentialSimulation::simulate(const std::vector<std::vector<std::uint64_t>> &inputVals)
+{
+	if (cycles_.size() != inputVals.size()) {
+		pastNodeEvaluations_ = nbNodeEvaluations();
+		cycles_.assign(inputVals.size(), IncrementalSimulation(*aig_, nbWords_));
+	}
+	std::vector<std::uint64_t> inputs;
+	for (std::size_t c = 0; c < inputVals.size(); ++c) {
+		inputs = inputVals[c];
+		if (c > 0) {
+			const std::vector<std::uint64_t> &prev = cycles_[c - 1].getOutputValues();
+			for (auto r : registers_) {
+				std::copy(prev.begin() + (std::size_t)r.first * nbWords_, prev.begin() + (std::size_t)(r.first + 1) * nbWords_,
+					  inputs.begin() + (std::size_t)r.second * nbWords_);
+			}
+		}
+		cycles_[c].simulate(inputs);
+	}
+}
+
+std::vector<std::uint64_t> SequentialSimulation::simulateCorruption(Lit toggled)
+{
+	std::size_t nbValues = (std::size_t)aig_->nbOutputs() * nbWords_;
+	std::vector<std::uint64_t> ret(nbValues, 0);
+	// Registers whose state differs from the good machine, with the test vectors where it does
+	std::vector<int> flipped;
+	std::vector<std::uint64_t> masks;
+	for (IncrementalSimulation &sim : cycles_) {
+		std::vector<std::uint64_t> values = sim.simulateWithToggling({toggled}, flipped, masks);
+		const std::vector<std::uint64_t> &golden = sim.getOutputValues();
+		for (std::size_t i = 0; i < nbValues; ++i) {
+			values[i] ^= golden[i];
+			ret[i] |= values[i];
+		}
+		flipped.clear();
+		masks.clear();
+		for (auto r : registers_) {
+			const std::uint64_t *diff = values.data() + (std::size_t)r.first * nbWords_;
+			if (std::any_of(diff, diff + nbWords_, [](std::uint64_t v) { return v != 0; })) {
+				flipped.push_back(r.second);
+				masks.insert(masks.end(), diff, diff + nbWords_);
+			}
+		}
+	}
+	return ret;
+}
+
+std::size_t SequentialSimulation::nbNodeEvaluations() const
+{
+	std::size_t ret = pastNodeEvaluations_;
+	for (const IncrementalSimulation &sim : cycles_) {
+		ret += sim.nbNodeEvaluations();
+	}
+	return ret;
+}
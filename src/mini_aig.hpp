@@ -8,6 +8,8 @@
 #include <cassert>
 #include <cstdint>
 #include <stdexcept>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 /**
@@ -31,17 +33,36 @@ struct Lit {
 	std::uint32_t data;
 	Lit(std::uint32_t a) : data(a) {}
 	friend class MiniAIG;
+	friend class CompactAIG;
+	friend class IncrementalSimulation;
 };
 
+/**
+ * @brief Kind of a node of the AIG
+ *
+ * Xor and mux nodes are native, so that the corresponding gates cost a single node instead of three.
+ */
+enum NodeKind : std::uint8_t { AND_NODE, XOR_NODE, MUX_NODE };
+
 /**
  * @brief A very basic AIG class for simulation
  *
- * The circuit is represented as a network of and gates with inverters
+ * The circuit is represented as a network of and, xor and mux gates with inverters
  */
 class MiniAIG
 {
       public:
-	MiniAIG(int nbInputs = 0) : nbInputs_(nbInputs), state_(nbInputs_ + 1) {}
+	MiniAIG(int nbInputs = 0) : nbInputs_(nbInputs), state_(nbInputs_ + 1), strashing_(false) {}
+
+	/**
+	 * Enable structural hashing and constant propagation for the gates created from now on
+	 */
+	void setStrashing(bool strashing) { strashing_ = strashing; }
+
+	/**
+	 * Query whether structural hashing is enabled
+	 */
+	bool strashing() const { return strashing_; }
 
 	/**
 	 * Query the number of inputs
@@ -63,6 +84,11 @@ class MiniAIG
 	 */
 	void addOutput(Lit lit) { outputs_.push_back(lit); }
 
+	/**
+	 * Query the number of outputs
+	 */
+	int nbOutputs() const { return outputs_.size(); }
+
 	void resetState()
 	{
 		state_.clear();
@@ -74,10 +100,10 @@ class MiniAIG
 	 */
 	Lit addAnd(Lit a, Lit b)
 	{
-		std::uint32_t d = nodes_.size() + nbInputs_ + 1;
-		nodes_.emplace_back(a, b);
-		state_.emplace_back();
-		return Lit(d << 1);
+		if (strashing_) {
+			return addStrashedAnd(a, b);
+		}
+		return addRawAnd(a, b);
 	}
 
 	Lit addNand(Lit a, Lit b) { return addAnd(a, b).inv(); }
@@ -86,11 +112,35 @@ class MiniAIG
 
 	Lit addOr(Lit a, Lit b) { return addNor(a, b).inv(); }
 
-	Lit addXor(Lit a, Lit b) { return addOr(addAnd(a, b.inv()), addAnd(a.inv(), b)); }
+	/**
+	 * Create a new Xor gate and return the corresponding literal
+	 */
+	Lit addXor(Lit a, Lit b)
+	{
+		if (strashing_) {
+			return addStrashedXor(a, b);
+		}
+		// Fanins are stored without complement
+		Lit ret = addRawNode(AIGNode(XOR_NODE, Lit(a.data & ~1u), Lit(b.data & ~1u)));
+		return a.polarity() != b.polarity() ? ret.inv() : ret;
+	}
 
 	Lit addXnor(Lit a, Lit b) { return addXor(a, b).inv(); }
 
-	Lit addMux(Lit s, Lit a, Lit b) { return addOr(addAnd(s.inv(), a), addAnd(s, b)); }
+	/**
+	 * Create a new Mux gate, selecting b if s is set and a otherwise, and return the corresponding literal
+	 */
+	Lit addMux(Lit s, Lit a, Lit b)
+	{
+		if (strashing_) {
+			return addStrashedMux(s, a, b);
+		}
+		// The selector is stored without complement
+		if (s.polarity()) {
+			return addRawNode(AIGNode(MUX_NODE, b, a, s.inv()));
+		}
+		return addRawNode(AIGNode(MUX_NODE, a, b, s));
+	}
 
 	/**
 	 * Create a non-synonymous buffer
@@ -102,6 +152,15 @@ class MiniAIG
 	 */
 	Lit addNot(Lit a) { return addAnd(a, a); }
 
+	/**
+	 * Obtain a literal equal to a, whose node is not shared with any other signal
+	 *
+	 * With strashing, the nodes created since the number of nodes was firstNode may be shared later.
+	 * If a is one of them, it is removed from the hash table; otherwise a new private buffer is created.
+	 * Toggling the returned literal then only affects the signal it was created for.
+	 */
+	Lit makePrivate(Lit a, int firstNode);
+
 	/**
 	 * Query the value of a literal in the current simulation
 	 */
@@ -127,6 +186,7 @@ class MiniAIG
 		for (AIGNode n : nodes_) {
 			assert(n.a.variable() < state_.size());
 			assert(n.b.variable() < state_.size());
+			assert(n.s.variable() < state_.size());
 		}
 		std::vector<std::uint8_t> marked(nbInputs_ + state_.size() + 1);
 		for (int i = 0; i < nbInputs_ + 1; ++i) {
@@ -135,6 +195,7 @@ class MiniAIG
 		for (std::size_t i = 0; i < nodes_.size(); ++i) {
 			assert(marked.at(nodes_[i].a.variable()));
 			assert(marked.at(nodes_[i].b.variable()));
+			assert(marked.at(nodes_[i].s.variable()));
 			marked[i + nbInputs_ + 1] = true;
 		}
 	}
@@ -156,14 +217,389 @@ class MiniAIG
 
       private:
 	struct AIGNode {
+		NodeKind kind;
 		Lit a;
 		Lit b;
-		AIGNode(Lit x, Lit y) : a(x), b(y) {}
+		// Selector of a mux node, constant otherwise
+		Lit s;
+		AIGNode(NodeKind k, Lit x, Lit y, Lit z = Lit()) : kind(k), a(x), b(y), s(z) {}
+
+		bool operator==(const AIGNode &o) const { return kind == o.kind && a.data == o.a.data && b.data == o.b.data && s.data == o.s.data; }
 	};
+
+	struct AIGNodeHash {
+		std::size_t operator()(const AIGNode &n) const
+		{
+			std::uint64_t h = ((std::uint64_t)n.a.data << 32 | n.b.data) * 0x9e3779b97f4a7c15ull;
+			return h ^ (h >> 29) ^ ((std::uint64_t)n.s.data << 2 | n.kind);
+		}
+	};
+
+	Lit addRawNode(const AIGNode &n)
+	{
+		std::uint32_t d = nodes_.size() + nbInputs_ + 1;
+		nodes_.push_back(n);
+		state_.emplace_back();
+		return Lit(d << 1);
+	}
+
+	Lit addRawAnd(Lit a, Lit b) { return addRawNode(AIGNode(AND_NODE, a, b)); }
+
+	Lit addStrashedNode(const AIGNode &n);
+	Lit addStrashedAnd(Lit a, Lit b);
+	Lit addStrashedXor(Lit a, Lit b);
+	Lit addStrashedMux(Lit s, Lit a, Lit b);
+
+	/**
+	 * Value of a node in the current simulation
+	 */
+	std::uint64_t evaluate(const AIGNode &n) const;
+
+      private:
 	std::vector<AIGNode> nodes_;
 	std::vector<Lit> outputs_;
 	int nbInputs_;
 	std::vector<std::uint64_t> state_;
+	bool strashing_;
+	// Variable of the gate for each normalized node
+	std::unordered_map<AIGNode, std::uint32_t, AIGNodeHash> strash_;
+
+	friend class CompactAIG;
+};
+
+/**
+ * @brief Frozen version of a MiniAIG, optimized for simulation
+ *
+ * Fanins are stored in separate arrays with precomputed complement masks, and nodes are
+ * renumbered by topological level for locality. Within a level, nodes are grouped by kind, so that
+ * each segment of nodes of the same kind is simulated by a branch-free loop. Fanout arrays
+ * (in compressed row format) are built at the same time.
+ *
+ * It is never modified after construction, so that many threads can share it.
+ */
+class CompactAIG
+{
+      public:
+	CompactAIG() : nbInputs_(0) {}
+	explicit CompactAIG(const MiniAIG &aig);
+
+	/**
+	 * Query the number of inputs
+	 */
+	int nbInputs() const { return nbInputs_; }
+
+	/**
+	 * Query the number of nodes
+	 */
+	int nbNodes() const { return fanin0_.size(); }
+
+	/**
+	 * Query the number of outputs
+	 */
+	int nbOutputs() const { return outputVars_.size(); }
+
+	/**
+	 * Query the number of variables (constant, inputs and nodes)
+	 */
+	int nbVariables() const { return nbInputs_ + nbNodes() + 1; }
+
+	/**
+	 * Get the literal corresponding to a literal of the original MiniAIG
+	 */
+	Lit getLit(Lit original) const { return Lit((newVariable_[original.variable()] << 1) | original.polarity()); }
+
+	/**
+	 * Get the root of the fanout-free region of a variable
+	 *
+	 * A variable belongs to the region of its single fanout, unless it is also used by an output.
+	 * Toggling a variable can only reach the outputs through the root of its region.
+	 */
+	std::uint32_t getFanoutFreeRoot(std::uint32_t var) const { return ffrRoot_[var]; }
+
+	/**
+	 * Simulate the nodes on a state with several 64-bit words per variable
+	 *
+	 * The state is laid out by variable then word, with constant and inputs already set.
+	 * The kernel is selected at runtime depending on the instruction sets supported by the CPU.
+	 */
+	void simulateWords(std::uint64_t *state, int nbWords) const;
+
+	/**
+	 * Preferred number of 64-bit words simulated together on this CPU (8 with AVX-512, 4 otherwise)
+	 */
+	static int preferredNbWords();
+
+      private:
+	/**
+	 * Evaluate a single node on a state with several 64-bit words per variable
+	 */
+	void evaluateNode(std::uint32_t node, const std::uint64_t *state, int nbWords, std::uint64_t *ret) const;
+
+	/**
+	 * Call a function on each distinct fanin variable of a node
+	 */
+	template <class F> void forEachFanin(std::uint32_t node, F f) const
+	{
+		std::uint32_t a = fanin0_[node];
+		std::uint32_t b = fanin1_[node];
+		f(a);
+		if (b != a) {
+			f(b);
+		}
+		if (kind_[node] == MUX_NODE && selector_[node] != a && selector_[node] != b) {
+			f(selector_[node]);
+		}
+	}
+
+	/**
+	 * Number of fanins of a node that are the given variable
+	 */
+	int nbUses(std::uint32_t node, std::uint32_t var) const
+	{
+		return (fanin0_[node] == var) + (fanin1_[node] == var) + (kind_[node] == MUX_NODE && selector_[node] == var);
+	}
+
+      private:
+	int nbInputs_;
+	// Kind, fanin variables and complement masks, by node; the selector is only used by mux nodes
+	std::vector<NodeKind> kind_;
+	std::vector<std::uint32_t> fanin0_;
+	std::vector<std::uint32_t> fanin1_;
+	std::vector<std::uint32_t> selector_;
+	std::vector<std::uint64_t> mask0_;
+	std::vector<std::uint64_t> mask1_;
+	// Consecutive nodes of the same kind
+	std::vector<std::uint32_t> segmentBegin_;
+	std::vector<NodeKind> segmentKind_;
+	// Output variables and complement masks
+	std::vector<std::uint32_t> outputVars_;
+	std::vector<std::uint64_t> outputMasks_;
+	// Nodes and outputs using each variable
+	std::vector<std::uint32_t> fanoutBegin_;
+	std::vector<std::uint32_t> fanouts_;
+	std::vector<std::uint32_t> outputUsersBegin_;
+	std::vector<std::uint32_t> outputUsers_;
+	// New variable number, by variable of the original MiniAIG
+	std::vector<std::uint32_t> newVariable_;
+	// Root of the fanout-free region, by variable
+	std::vector<std::uint32_t> ffrRoot_;
+
+	friend class IncrementalSimulation;
+	friend class OutputSupport;
+};
+
+/**
+ * @brief Outputs structurally reachable from each variable of a CompactAIG
+ *
+ * Computed in a single reverse-topological pass. Variables that reach the same outputs share a
+ * single bitset: supports are interned, so that the index stays small on large designs.
+ */
+class OutputSupport
+{
+      public:
+	OutputSupport() : nbOutputs_(0), nbOutputWords_(0) {}
+	explicit OutputSupport(const CompactAIG &aig);
+
+	/**
+	 * Query the number of outputs
+	 */
+	int nbOutputs() const { return nbOutputs_; }
+
+	/**
+	 * Query the number of 64-bit words of a support bitset
+	 */
+	int nbOutputWords() const { return nbOutputWords_; }
+
+	/**
+	 * Query the number of distinct supports
+	 */
+	int nbUniqueSupports() const { return nbOutputWords_ == 0 ? 1 : supports_.size() / nbOutputWords_; }
+
+	/**
+	 * Get the support bitset of a variable, with one bit per output
+	 */
+	const std::uint64_t *getSupport(std::uint32_t var) const { return supports_.data() + (std::size_t)supportId_[var] * nbOutputWords_; }
+
+	/**
+	 * Query whether a variable reaches an output
+	 */
+	bool reaches(std::uint32_t var, int output) const { return (getSupport(var)[output / 64] >> (output % 64)) & 1; }
+
+	/**
+	 * Query whether two variables reach a common output
+	 */
+	bool intersects(std::uint32_t a, std::uint32_t b) const;
+
+	/**
+	 * List the outputs reached by a variable, in increasing order
+	 */
+	std::vector<int> getOutputs(std::uint32_t var) const;
+
+	/**
+	 * List the outputs reached by both variables, in increasing order
+	 */
+	std::vector<int> getCommonOutputs(std::uint32_t a, std::uint32_t b) const;
+
+      private:
+	int nbOutputs_;
+	int nbOutputWords_;
+	// Index of the support, by variable
+	std::vector<std::uint32_t> supportId_;
+	// Distinct support bitsets, nbOutputWords_ words each
+	std::vector<std::uint64_t> supports_;
+};
+
+/**
+ * @brief Incremental simulation of a MiniAIG with toggled nodes
+ *
+ * The golden (untoggled) state is simulated once for a batch of test vectors.
+ * Toggled simulations then only reevaluate the fanout cone of the toggled nodes,
+ * in topological order, and only update the outputs reached by the cone.
+ *
+ * Each variable holds nbWords 64-bit words, so that a batch covers 64 * nbWords test vectors.
+ * Input and output values are laid out by input/output then word.
+ *
+ * Literals are those of the CompactAIG. The simulation state is owned by this object,
+ * so that several simulations can share the same CompactAIG.
+ */
+class IncrementalSimulation
+{
+      public:
+	IncrementalSimulation() : aig_(nullptr), nbWords_(1), observabilityValid_(false), nbNodeEvaluations_(0) {}
+	explicit IncrementalSimulation(const CompactAIG &aig, int nbWords = 1);
+
+	/**
+	 * Number of 64-bit words per variable
+	 */
+	int nbWords() const { return nbWords_; }
+
+	/**
+	 * Simulate the golden state on these inputs
+	 */
+	void simulate(const std::vector<std::uint64_t> &inputVals);
+
+	/**
+	 * Query the values of the outputs in the golden state
+	 */
+	const std::vector<std::uint64_t> &getOutputValues() const { return goldenOutputs_; }
+
+	/**
+	 * Simulate the network with some nodes toggled, starting from the golden state
+	 */
+	std::vector<std::uint64_t> simulateWithToggling(const std::vector<Lit> &toggling);
+
+	/**
+	 * Simulate the network with some nodes toggled and some inputs flipped on a subset of the test vectors, starting from the golden state
+	 *
+	 * The flip masks are laid out by flipped input then word.
+	 */
+	std::vector<std::uint64_t> simulateWithToggling(const std::vector<Lit> &toggling, const std::vector<int> &flippedInputs,
+							const std::vector<std::uint64_t> &flipMasks);
+
+	/**
+	 * Simulate the network with each of the nodes toggled separately, starting from the golden state
+	 *
+	 * Returns the same values as one simulateWithToggling call per node. Within a fanout-free region, the effect
+	 * of a toggle on the root is given exactly by the observability of the node (critical path tracing), so that
+	 * a single toggled simulation per region is needed.
+	 */
+	std::vector<std::vector<std::uint64_t>> simulateSingleToggles(const std::vector<Lit> &toggling);
+
+	/**
+	 * Number of nodes evaluated since construction, by golden and toggled simulations, each on nbWords words
+	 */
+	std::size_t nbNodeEvaluations() const { return nbNodeEvaluations_; }
+
+      private:
+	const std::uint64_t *getWords(std::uint32_t var) const { return state_.data() + (std::size_t)var * nbWords_; }
+
+	void getOutputValue(int output, std::uint64_t *ret) const;
+
+	void queue(std::uint32_t var);
+
+	/**
+	 * Compute, for each variable, the test vectors where toggling it toggles the root of its fanout-free region
+	 */
+	void computeObservability();
+
+      private:
+	const CompactAIG *aig_;
+	int nbWords_;
+	std::vector<std::uint64_t> golden_;
+	std::vector<std::uint64_t> goldenOutputs_;
+	std::vector<std::uint64_t> state_;
+	// Observability in the fanout-free region, valid for the current golden state if observabilityValid_
+	std::vector<std::uint64_t> observability_;
+	bool observabilityValid_;
+
+	// Scratch buffers for the cone traversal
+	std::vector<std::uint32_t> heap_;
+	std::vector<std::uint32_t> touched_;
+	std::vector<std::uint8_t> queued_;
+	std::vector<std::uint8_t> toggled_;
+	std::vector<std::uint64_t> value_;
+	// Flip masks of the inputs, by input variable then word; zero outside of a toggled simulation
+	std::vector<std::uint64_t> inputFlips_;
+	std::size_t nbNodeEvaluations_;
+};
+
+/**
+ * @brief Simulation of a sequential circuit over several clock cycles, whose registers are cut into inputs and outputs of a CompactAIG
+ *
+ * Each register is given as an output, its next state, and the input that holds its state. The good machine is simulated once,
+ * with one IncrementalSimulation per cycle. A toggled machine keeps its own register state, as its difference with the good
+ * machine: at each cycle, only the fanout cones of the toggled node and of the registers in a different state are reevaluated.
+ * Both machines are bit-parallel over the test vectors, with nbWords 64-bit words per variable.
+ */
+class SequentialSimulation
+{
+      public:
+	SequentialSimulation() : aig_(nullptr), nbWords_(1), pastNodeEvaluations_(0) {}
+	SequentialSimulation(const CompactAIG &aig, const std::vector<std::pair<int, int>> &registers, int nbWords = 1);
+
+	/**
+	 * Number of 64-bit words per variable
+	 */
+	int nbWords() const { return nbWords_; }
+
+	/**
+	 * Number of cycles of the last simulation
+	 */
+	int nbCycles() const { return cycles_.size(); }
+
+	/**
+	 * Simulate the good machine with the inputs of each cycle, laid out by input then word
+	 *
+	 * The register inputs of the first cycle give the initial state; at later cycles, they are replaced by the next state.
+	 */
+	void simulate(const std::vector<std::vector<std::uint64_t>> &inputVals);
+
+	/**
+	 * Query the values of the outputs of the good machine at a cycle
+	 */
+	const std::vector<std::uint64_t> &getOutputValues(int cycle) const { return cycles_[cycle].getOutputValues(); }
+
+	/**
+	 * Simulate the machine with a node toggled at every cycle, and return the outputs that differ from the good machine at least once
+	 *
+	 * The result is laid out by output then word, like the outputs of an IncrementalSimulation.
+	 */
+	std::vector<std::uint64_t> simulateCorruption(Lit toggled);
+
+	/**
+	 * Number of nodes evaluated since construction over all cycles, each on nbWords words
+	 */
+	std::size_t nbNodeEvaluations() const;
+
+      private:
+	const CompactAIG *aig_;
+	int nbWords_;
+	// Output and input of each register
+	std::vector<std::pair<int, int>> registers_;
+	// Good machine, with the golden state of each cycle
+	std::vector<IncrementalSimulation> cycles_;
+	// Node evaluations of the simulations replaced when the number of cycles changed
+	std::size_t pastNodeEvaluations_;
 };
 
-#endif
\ No newline at end of file
+#endif
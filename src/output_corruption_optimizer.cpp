@@ -4,37 +4,70 @@
 #include <algorithm>
 #include <bitset>
 #include <cassert>
+#include <queue>
 #include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
-OutputCorruptionOptimizer::OutputCorruptionOptimizer(const std::vector<CorruptionData> &data) : outputCorruption_(data)
+OutputCorruptionOptimizer::OutputCorruptionOptimizer(const std::vector<CorruptionData> &data)
 {
-	for (const CorruptionData &d : data) {
-		corruptionRate_.push_back(countSet(d));
+	int nbData = data.empty() ? 0 : data.front().size();
+	for (const auto &d : data) {
+		if ((int)d.size() != nbData) {
+			throw std::runtime_error("Inconsistent output corruption data size");
+		}
+	}
+	auto matrix = std::make_shared<CorruptionMatrix>(data.size(), 1, nbData);
+	for (int i = 0; i < matrix->nbSignals(); ++i) {
+		std::copy(data[i].begin(), data[i].end(), matrix->row(i));
+	}
+	data_ = matrix;
+	nbData_ = nbData;
+	init();
+}
+
+OutputCorruptionOptimizer::OutputCorruptionOptimizer(std::shared_ptr<const CorruptionMatrix> data) : data_(std::move(data))
+{
+	nbData_ = data_->rowSize();
+	init();
+}
+
+OutputCorruptionOptimizer::OutputCorruptionOptimizer(std::shared_ptr<const CorruptionMatrix> data, int nbData)
+    : data_(std::move(data)), nbData_(nbData)
+{
+	if (nbData < 0 || nbData > data_->rowSize()) {
+		throw std::runtime_error("Invalid output corruption data size");
 	}
+	init();
+}
+
+void OutputCorruptionOptimizer::init()
+{
+	for (int i = 0; i < nbNodes(); ++i) {
+		corruptionRate_.push_back(countSet(getData(i), nbData()));
+	}
+	computeEquivalentNodes();
 }
 
 void OutputCorruptionOptimizer::check() const
 {
-	for (const auto &d : outputCorruption_) {
-		if (d.size() != outputCorruption_.front().size()) {
-			throw std::runtime_error("Inconsistent output corruption data size");
-		}
+	if ((int)corruptionRate_.size() != nbNodes() || (int)representative_.size() != nbNodes()) {
+		throw std::runtime_error("Inconsistent output corruption data size");
 	}
 }
 
-int OutputCorruptionOptimizer::countSet(const CorruptionData &data)
+int OutputCorruptionOptimizer::countSet(const std::uint64_t *data, int size)
 {
 	int ret = 0;
-	for (auto d : data) {
-		ret += std::bitset<64>(d).count();
+	for (int i = 0; i < size; ++i) {
+		ret += std::bitset<64>(data[i]).count();
 	}
 	return ret;
 }
 
-int OutputCorruptionOptimizer::additionalCorruption(const CorruptionData &corr, const CorruptionData &data)
+int OutputCorruptionOptimizer::additionalCorruption(const CorruptionData &corr, const std::uint64_t *data)
 {
 	int ret = 0;
-	assert(corr.size() == data.size());
 	for (size_t i = 0; i < corr.size(); ++i) {
 		std::uint64_t added = data[i] & ~corr[i];
 		ret += std::bitset<64>(added).count();
@@ -46,12 +79,12 @@ float OutputCorruptionOptimizer::corruptionCover(const Solution &solution) const
 {
 	CorruptionData corr(nbData());
 	for (int k : solution) {
-		const CorruptionData &data = outputCorruption_[k];
+		const std::uint64_t *data = getData(k);
 		for (int i = 0; i < nbData(); ++i) {
 			corr[i] |= data[i];
 		}
 	}
-	return ((float)countSet(corr)) / (64 * nbData());
+	return ((float)countSet(corr.data(), nbData())) / (64 * nbData());
 }
 
 float OutputCorruptionOptimizer::corruptionRate(const Solution &solution) const
@@ -63,22 +96,75 @@ float OutputCorruptionOptimizer::corruptionRate(const Solution &solution) const
 	return ((float)count) / (64 * nbData());
 }
 
-std::vector<int> OutputCorruptionOptimizer::getUniqueNodes(const std::vector<int> &preLocked) const
+void OutputCorruptionOptimizer::corruptionCurve(const Solution &solution, std::vector<float> &cover, std::vector<float> &rate) const
 {
-	std::vector<int> nodes;
+	cover.clear();
+	rate.clear();
+	CorruptionData corr(nbData());
+	long long covered = 0;
+	long long count = 0;
+	float total = 64 * nbData();
+	for (int k : solution) {
+		const std::uint64_t *data = getData(k);
+		covered += additionalCorruption(corr, data);
+		for (int i = 0; i < nbData(); ++i) {
+			corr[i] |= data[i];
+		}
+		count += corruptionRate_[k];
+		cover.push_back(covered / total);
+		rate.push_back(count / total);
+	}
+}
+
+std::uint64_t OutputCorruptionOptimizer::hashData(const std::uint64_t *data, int size)
+{
+	std::uint64_t h = size;
+	for (int i = 0; i < size; ++i) {
+		// Mixing step from splitmix64
+		h ^= data[i] + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+		h ^= h >> 30;
+		h *= 0xbf58476d1ce4e5b9ull;
+		h ^= h >> 27;
+	}
+	return h;
+}
+
+bool OutputCorruptionOptimizer::sameData(int i, int j) const { return std::equal(getData(i), getData(i) + nbData(), getData(j)); }
+
+void OutputCorruptionOptimizer::computeEquivalentNodes()
+{
+	// Candidate representatives by hash; the data is only compared on hash collisions
+	std::unordered_map<std::uint64_t, std::vector<int>> byHash;
+	representative_.resize(nbNodes());
+	uniqueNodes_.clear();
 	for (int i = 0; i < nbNodes(); ++i) {
-		bool hasEquivalent = false;
-		for (int n : preLocked) {
-			if (outputCorruption_[i] == outputCorruption_[n]) {
-				hasEquivalent = true;
+		std::vector<int> &candidates = byHash[hashData(getData(i), nbData())];
+		representative_[i] = i;
+		for (int j : candidates) {
+			if (sameData(i, j)) {
+				representative_[i] = j;
+				break;
 			}
 		}
-		for (int j = 0; j < i; ++j) {
-			if (outputCorruption_[i] == outputCorruption_[j]) {
-				hasEquivalent = true;
-			}
+		if (representative_[i] == i) {
+			candidates.push_back(i);
+			uniqueNodes_.push_back(i);
 		}
-		if (!hasEquivalent) {
+	}
+}
+
+std::vector<int> OutputCorruptionOptimizer::getUniqueNodes(const std::vector<int> &preLocked) const
+{
+	if (preLocked.empty()) {
+		return uniqueNodes_;
+	}
+	std::unordered_set<int> lockedRepresentatives;
+	for (int n : preLocked) {
+		lockedRepresentatives.insert(representative_[n]);
+	}
+	std::vector<int> nodes;
+	for (int i : uniqueNodes_) {
+		if (!lockedRepresentatives.count(i)) {
 			nodes.push_back(i);
 		}
 	}
@@ -87,32 +173,63 @@ std::vector<int> OutputCorruptionOptimizer::getUniqueNodes(const std::vector<int
 
 OutputCorruptionOptimizer::Solution OutputCorruptionOptimizer::solveGreedy(int maxNumber, const Solution &preLocked) const
 {
-	std::vector<int> remaining = getUniqueNodes(preLocked);
+	// Lazy greedy: the additional coverage of a node can only decrease as the solution grows,
+	// so the coverage in the heap is an upper bound and is only recomputed for the top node.
+	// Nodes are ordered by coverage, then rate, then lowest index, which is the same order as an exhaustive greedy.
+	struct Entry {
+		int cover;
+		int rate;
+		int node;
+		int iteration;
+
+		bool operator<(const Entry &o) const
+		{
+			if (cover != o.cover) {
+				return cover < o.cover;
+			}
+			if (rate != o.rate) {
+				return rate < o.rate;
+			}
+			return node > o.node;
+		}
+	};
 
 	std::vector<int> sol = preLocked;
 	CorruptionData corr(nbData());
-	for (int i = preLocked.size(); i < std::min(nbNodes(), maxNumber); ++i) {
-		if (remaining.empty())
+	for (int k : preLocked) {
+		const std::uint64_t *data = getData(k);
+		for (size_t j = 0; j < corr.size(); ++j) {
+			corr[j] |= data[j];
+		}
+	}
+	int firstIteration = preLocked.size();
+	// With an empty cover, the coverage of a node is its rate; otherwise it is an upper bound, recomputed when on top
+	int initialIteration = preLocked.empty() ? firstIteration : -1;
+	std::vector<Entry> entries;
+	for (int k : getUniqueNodes(preLocked)) {
+		entries.push_back(Entry{corruptionRate_[k], corruptionRate_[k], k, initialIteration});
+	}
+	std::priority_queue<Entry> heap(std::less<Entry>(), std::move(entries));
+
+	for (int i = firstIteration; i < std::min(nbNodes(), maxNumber); ++i) {
+		if (heap.empty())
 			break;
-		// Compute the coverage added by each remaining gate
-		int bestCover = 0;
-		int bestRate = 0;
-		int bestK = remaining.front();
-		for (int k : remaining) {
-			int cover = additionalCorruption(corr, outputCorruption_[k]);
-			int rate = corruptionRate_[k];
-			if (cover > bestCover || (cover == bestCover && rate > bestRate)) {
-				bestCover = cover;
-				bestRate = rate;
-				bestK = k;
-			}
+		// Update the coverage of the top node until it is up-to-date
+		while (heap.top().iteration != i) {
+			Entry e = heap.top();
+			heap.pop();
+			e.cover = additionalCorruption(corr, getData(e.node));
+			e.iteration = i;
+			heap.push(e);
 		}
 		// Pick the best gate and remove it
+		int bestK = heap.top().node;
+		heap.pop();
 		sol.push_back(bestK);
-		remaining.erase(std::remove(remaining.begin(), remaining.end(), bestK), remaining.end());
-		for (size_t i = 0; i < corr.size(); ++i) {
-			corr[i] |= outputCorruption_[bestK][i];
+		const std::uint64_t *data = getData(bestK);
+		for (size_t j = 0; j < corr.size(); ++j) {
+			corr[j] |= data[j];
 		}
 	}
 	return sol;
-}
\ No newline at end of file
+}
@@ -5,7 +5,10 @@
 #ifndef MOOSIC_OUTPUT_CORRUPTION_OPTIMIZER_H
 #define MOOSIC_OUTPUT_CORRUPTION_OPTIMIZER_H
 
+#include "corruption_matrix.hpp"
+
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 class OutputCorruptionOptimizer
@@ -26,19 +29,39 @@ class OutputCorruptionOptimizer
 	 */
 	OutputCorruptionOptimizer(const std::vector<CorruptionData> &data);
 
+	/**
+	 * @brief Initialize the data structure with packed output corruption data, shared without copy
+	 */
+	OutputCorruptionOptimizer(std::shared_ptr<const CorruptionMatrix> data);
+
+	/**
+	 * @brief Initialize the data structure with the first nbData words of each row of packed data, shared without copy
+	 *
+	 * The cost of the construction and of the optimization is proportional to nbData, not to the size of the rows.
+	 */
+	OutputCorruptionOptimizer(std::shared_ptr<const CorruptionMatrix> data, int nbData);
+
 	/**
 	 * @brief Number of lockable signals
 	 */
-	int nbNodes() const { return outputCorruption_.size(); }
+	int nbNodes() const { return data_->nbSignals(); }
 
 	/**
 	 * @brief Number of 64-bit output corruption data
 	 */
-	int nbData() const { return outputCorruption_.empty() ? 0 : outputCorruption_.front().size(); }
+	int nbData() const { return nbData_; }
+
+	/**
+	 * @brief Output corruption data of a signal (nbData words)
+	 */
+	const std::uint64_t *getData(int node) const { return data_->row(node); }
 
 	/**
 	 * @brief Get nodes with unique corruption patterns
 	 *
+	 * Among equivalent nodes, only the one with the lowest index is kept. Equivalences are computed once
+	 * at construction, by hashing the corruption data.
+	 *
 	 * @param preLocked Nodes considered already locked, which will be removed as well as their equivalents
 	 */
 	std::vector<int> getUniqueNodes(const std::vector<int> &preLocked = std::vector<int>()) const;
@@ -53,6 +76,11 @@ class OutputCorruptionOptimizer
 	 */
 	float corruptionRate(const Solution &solution) const;
 
+	/**
+	 * @brief Obtain the corruption cover and rate of every prefix of a solution, in a single pass
+	 */
+	void corruptionCurve(const Solution &solution, std::vector<float> &cover, std::vector<float> &rate) const;
+
 	/**
 	 * @brief Maximize output corruption by picking one best gate to lock at a time
 	 */
@@ -64,11 +92,28 @@ class OutputCorruptionOptimizer
 	void check() const;
 
       private:
-	static int countSet(const CorruptionData &data);
-	static int additionalCorruption(const CorruptionData &corr, const CorruptionData &data);
+	/**
+	 * @brief Compute the corruption rates and equivalent nodes, at construction time
+	 */
+	void init();
+
+	static int countSet(const std::uint64_t *data, int size);
+	static int additionalCorruption(const CorruptionData &corr, const std::uint64_t *data);
+	static std::uint64_t hashData(const std::uint64_t *data, int size);
+	bool sameData(int i, int j) const;
+
+	/**
+	 * @brief Find the nodes with identical corruption data, at construction time
+	 */
+	void computeEquivalentNodes();
 
       private:
-	std::vector<CorruptionData> outputCorruption_;
+	std::shared_ptr<const CorruptionMatrix> data_;
+	int nbData_;
 	std::vector<int> corruptionRate_;
+	// Lowest index of a node with the same corruption data
+	std::vector<int> representative_;
+	// Nodes that are their own representative
+	std::vector<int> uniqueNodes_;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#ifndef MOOSIC_PARALLEL_H
+#define MOOSIC_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Obtain the actual number of threads to use, 0 meaning all available cores
+ */
+inline int resolve_nb_threads(int nb_threads)
+{
+	if (nb_threads > 0) {
+		return nb_threads;
+	}
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Run tasks on a pool of threads
+ *
+ * Tasks are picked dynamically by idle threads in increasing order, so that the load is
+ * balanced even when their costs are very different. The function is called as
+ * func(thread_index, task_index). With a single thread, all tasks run on the calling thread.
+ * The first exception raised by a task is rethrown once all threads are done.
+ */
+template <typename F> void parallel_run(int nb_threads, int nb_tasks, F func)
+{
+	nb_threads = std::min(resolve_nb_threads(nb_threads), std::max(nb_tasks, 1));
+	if (nb_threads <= 1) {
+		for (int i = 0; i < nb_tasks; ++i) {
+			func(0, i);
+		}
+		return;
+	}
+	std::atomic<int> next_task(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto worker = [&](int thread_index) {
+		try {
+			while (true) {
+				int task = next_task++;
+				if (task >= nb_tasks) {
+					break;
+				}
+				func(thread_index, task);
+			}
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if (!error) {
+				error = std::current_exception();
+			}
+			// Stop the other threads as soon as possible
+			next_task = nb_tasks;
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int i = 1; i < nb_threads; ++i) {
+		threads.emplace_back(worker, i);
+	}
+	worker(0);
+	for (std::thread &t : threads) {
+		t.join();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+#endif
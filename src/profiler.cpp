@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#include "profiler.hpp"
+
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+std::string format(const char *fmt, double v)
+{
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), fmt, v);
+	return buf;
+}
+
+std::string jsonString(const std::string &s)
+{
+	std::string ret = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			ret.push_back('\\');
+		}
+		ret.push_back(c);
+	}
+	ret.push_back('"');
+	return ret;
+}
+} // namespace
+
+Profiler::Scope::Scope(Profiler &profiler, const std::string &name) : profiler_(profiler), name_(name), start_(std::chrono::steady_clock::now()) {}
+
+Profiler::Scope::~Scope()
+{
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+	profiler_.stages_.push_back(Stage{name_, seconds, peakMemory(), counts_});
+}
+
+void Profiler::addStages(const Profiler &other, const std::string &prefix)
+{
+	for (Stage s : other.stages_) {
+		s.name = prefix + s.name;
+		stages_.push_back(s);
+	}
+}
+
+double Profiler::totalSeconds() const
+{
+	double total = 0.0;
+	for (const Stage &s : stages_) {
+		total += s.seconds;
+	}
+	return total;
+}
+
+std::string Profiler::toText() const
+{
+	std::string ret;
+	char buf[128];
+	std::snprintf(buf, sizeof(buf), "%-16s %10s %14s  %s\n", "Stage", "Time (s)", "Peak RSS (MB)", "Throughput");
+	ret += buf;
+	for (const Stage &s : stages_) {
+		std::snprintf(buf, sizeof(buf), "%-16s %10.3f %14.1f", s.name.c_str(), s.seconds, s.peakMemory / 1048576.0);
+		ret += buf;
+		for (const auto &c : s.counts) {
+			ret += format("  %.0f ", c.second) + c.first;
+			if (s.seconds > 0.0) {
+				ret += format(" (%.4g/s)", c.second / s.seconds);
+			}
+		}
+		ret += "\n";
+	}
+	std::snprintf(buf, sizeof(buf), "%-16s %10.3f %14.1f\n", "Total", totalSeconds(), peakMemory() / 1048576.0);
+	ret += buf;
+	return ret;
+}
+
+std::string Profiler::toJson() const
+{
+	std::string ret = "{\n  \"stages\": [";
+	for (std::size_t i = 0; i < stages_.size(); ++i) {
+		const Stage &s = stages_[i];
+		ret += i == 0 ? "\n" : ",\n";
+		ret += "    {\"name\": " + jsonString(s.name);
+		ret += format(", \"seconds\": %.6f", s.seconds);
+		ret += ", \"cumulative_peak_rss_bytes\": " + std::to_string(s.peakMemory);
+		ret += ", \"counts\": {";
+		for (std::size_t j = 0; j < s.counts.size(); ++j) {
+			ret += j == 0 ? "" : ", ";
+			ret += jsonString(s.counts[j].first) + format(": %.0f", s.counts[j].second);
+		}
+		ret += "}, \"rates\": {";
+		for (std::size_t j = 0; j < s.counts.size(); ++j) {
+			double rate = s.seconds > 0.0 ? s.counts[j].second / s.seconds : 0.0;
+			ret += j == 0 ? "" : ", ";
+			ret += jsonString(s.counts[j].first + "_per_second") + format(": %.6g", rate);
+		}
+		ret += "}}";
+	}
+	ret += "\n  ],\n";
+	ret += format("  \"total_seconds\": %.6f,\n", totalSeconds());
+	ret += "  \"peak_rss_bytes\": " + std::to_string(peakMemory()) + "\n}\n";
+	return ret;
+}
+
+std::size_t Profiler::peakMemory()
+{
+#ifndef _WIN32
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	// Reported in kilobytes
+	return (std::size_t)usage.ru_maxrss * 1024;
+#endif
+#else
+	return 0;
+#endif
+}
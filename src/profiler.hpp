@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#ifndef MOOSIC_PROFILER_H
+#define MOOSIC_PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Wall time, peak memory and work counts of the successive stages of a run
+ *
+ * The memory is the peak resident set size of the process, which the operating system only reports since
+ * the start of the process.
+ */
+class Profiler
+{
+      public:
+	/**
+	 * @brief Measurements of a single stage
+	 */
+	struct Stage {
+		std::string name;
+		double seconds;
+		// Peak resident memory of the process from its start to the end of the stage, in bytes: it is cumulative over
+		// the stages, and only shows the stages that raise the peak
+		std::size_t peakMemory;
+		// Amount of work done, by unit (e.g. nodes or pairs)
+		std::vector<std::pair<std::string, double>> counts;
+	};
+
+	/**
+	 * @brief Measure a stage for the lifetime of the object
+	 */
+	class Scope
+	{
+	      public:
+		Scope(Profiler &profiler, const std::string &name);
+		~Scope();
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+		/**
+		 * @brief Record an amount of work done in the stage, reported as a rate
+		 */
+		void addCount(const std::string &unit, double count) { counts_.emplace_back(unit, count); }
+
+	      private:
+		Profiler &profiler_;
+		std::string name_;
+		std::chrono::steady_clock::time_point start_;
+		std::vector<std::pair<std::string, double>> counts_;
+	};
+
+	/**
+	 * @brief Stages measured so far, in the order they finished
+	 */
+	const std::vector<Stage> &stages() const { return stages_; }
+
+	/**
+	 * @brief Append the stages of another profiler, with a prefix added to their names
+	 */
+	void addStages(const Profiler &other, const std::string &prefix);
+
+	/**
+	 * @brief Total time of all stages
+	 */
+	double totalSeconds() const;
+
+	/**
+	 * @brief Format the measurements as a table
+	 */
+	std::string toText() const;
+
+	/**
+	 * @brief Format the measurements as a JSON document
+	 */
+	std::string toJson() const;
+
+	/**
+	 * @brief Peak resident memory of the process so far, in bytes (0 if unavailable)
+	 */
+	static std::size_t peakMemory();
+
+      private:
+	std::vector<Stage> stages_;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#include "test_vectors.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+/**
+ * @brief Philox-2x64-10 block: 128 random bits from a 128-bit counter and a 64-bit key
+ */
+void philox(std::uint64_t &c0, std::uint64_t &c1, std::uint64_t key)
+{
+	const std::uint64_t multiplier = 0xD2B74407B1CE6E93ull;
+	const std::uint64_t weyl = 0x9E3779B97F4A7C15ull;
+	for (int round = 0; round < 10; ++round) {
+		unsigned __int128 product = (unsigned __int128)multiplier * c0;
+		std::uint64_t hi = product >> 64;
+		std::uint64_t lo = product;
+		c0 = hi ^ key ^ c1;
+		c1 = lo;
+		key += weyl;
+	}
+}
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+/**
+ * @brief Query whether a line holds a test vector; the line ends at the next newline or at the end of the file
+ */
+bool isVectorLine(const char *begin, const char *end)
+{
+	const char *p = begin;
+	while (p != end && *p != '\n' && isSpace(*p)) {
+		++p;
+	}
+	return p != end && *p != '\n' && *p != '#';
+}
+
+const char *nextLine(const char *p, const char *end)
+{
+	const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+	return eol == nullptr ? end : eol + 1;
+}
+} // namespace
+
+TestVectorSource::TestVectorSource() : nbInputs_(0), nbVectors_(0), seed_(0) {}
+
+TestVectorSource TestVectorSource::random(int nbInputs, int nbVectors, std::uint64_t seed)
+{
+	TestVectorSource ret;
+	ret.nbInputs_ = nbInputs;
+	ret.nbVectors_ = nbVectors;
+	ret.seed_ = seed;
+	return ret;
+}
+
+TestVectorSource TestVectorSource::fromFile(const std::string &filename, int nbInputs)
+{
+	auto file = std::make_shared<const MappedFile>(filename);
+	if (!file->valid()) {
+		throw std::runtime_error("Could not open the stimulus file " + filename);
+	}
+	TestVectorSource ret;
+	ret.nbInputs_ = nbInputs;
+	const char *begin = file->data();
+	const char *end = begin + file->size();
+	int lineNumber = 1;
+	for (const char *p = begin; p != end; p = nextLine(p, end), ++lineNumber) {
+		if (!isVectorLine(p, end)) {
+			continue;
+		}
+		int nbValues = 0;
+		for (const char *q = p; q != end && *q != '\n'; ++q) {
+			if (*q == '0' || *q == '1') {
+				++nbValues;
+			} else if (!isSpace(*q)) {
+				throw std::runtime_error("Invalid character in the stimulus file " + filename + " at line " + std::to_string(lineNumber));
+			}
+		}
+		if (nbValues != nbInputs) {
+			throw std::runtime_error("Expected " + std::to_string(nbInputs) + " values in the stimulus file " + filename + " at line " +
+						 std::to_string(lineNumber) + ", got " + std::to_string(nbValues));
+		}
+		if (ret.nbVectors_ % 64 == 0) {
+			ret.blockOffsets_.push_back(p - begin);
+		}
+		++ret.nbVectors_;
+	}
+	ret.file_ = file;
+	return ret;
+}
+
+void TestVectorSource::getBlock(int block, std::uint64_t *values) const
+{
+	if (block < 0 || block >= nbBlocks()) {
+		throw std::runtime_error("Test vector block out of range");
+	}
+	if (file_) {
+		getFileBlock(block, values);
+	} else {
+		getRandomBlock(block, values);
+	}
+}
+
+std::vector<std::uint64_t> TestVectorSource::getBlock(int block) const
+{
+	std::vector<std::uint64_t> ret(nbInputs_);
+	getBlock(block, ret.data());
+	return ret;
+}
+
+void TestVectorSource::getRandomBlock(int block, std::uint64_t *values) const
+{
+	std::uint64_t mask = ~(std::uint64_t)0;
+	if (nbVectors_ - 64 * block < 64) {
+		mask = (((std::uint64_t)1) << (nbVectors_ - 64 * block)) - 1;
+	}
+	// Each counter (block, pair of inputs) gives the values of two inputs
+	for (int i = 0; i < nbInputs_; i += 2) {
+		std::uint64_t c0 = block;
+		std::uint64_t c1 = i / 2;
+		philox(c0, c1, seed_);
+		values[i] = c0 & mask;
+		if (i + 1 < nbInputs_) {
+			values[i + 1] = c1 & mask;
+		}
+	}
+}
+
+void TestVectorSource::getFileBlock(int block, std::uint64_t *values) const
+{
+	std::memset(values, 0, nbInputs_ * sizeof(std::uint64_t));
+	const char *end = file_->data() + file_->size();
+	const char *p = file_->data() + blockOffsets_[block];
+	int nbVectors = std::min(64, nbVectors_ - 64 * block);
+	// The file was checked when indexed: only the lines with test vectors need to be told apart
+	for (int tv = 0; tv < nbVectors; p = nextLine(p, end)) {
+		if (!isVectorLine(p, end)) {
+			continue;
+		}
+		int i = 0;
+		for (const char *q = p; q != end && *q != '\n'; ++q) {
+			if (*q == '1') {
+				values[i] |= ((std::uint64_t)1) << tv;
+			}
+			if (*q == '0' || *q == '1') {
+				++i;
+			}
+		}
+		++tv;
+	}
+}
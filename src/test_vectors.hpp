@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2023 Gabriel Gouvine
+ */
+
+#ifndef MOOSIC_TEST_VECTORS_H
+#define MOOSIC_TEST_VECTORS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+/**
+ * @brief Source of the test vectors of the analysis, by blocks of 64
+ *
+ * Blocks are not stored but produced on demand, with one 64-bit word per input. Random blocks come from a
+ * counter-based generator (Philox-2x64-10), so that each block only depends on the seed and its index.
+ * Stimulus files are memory-mapped and a block is only parsed when requested.
+ *
+ * Blocks can be obtained concurrently from several threads, in any order.
+ */
+class TestVectorSource
+{
+      public:
+	/**
+	 * @brief Create an empty source
+	 */
+	TestVectorSource();
+
+	/**
+	 * @brief Create a source of random test vectors
+	 */
+	static TestVectorSource random(int nbInputs, int nbVectors, std::uint64_t seed);
+
+	/**
+	 * @brief Create a source reading test vectors from a stimulus file
+	 *
+	 * The file has one test vector per line, with one 0 or 1 character per input, the first character driving
+	 * input 0; whitespace is ignored, as well as empty lines and lines starting with #.
+	 * The file is scanned once to check it and index the blocks.
+	 */
+	static TestVectorSource fromFile(const std::string &filename, int nbInputs);
+
+	/**
+	 * @brief Number of inputs
+	 */
+	int nbInputs() const { return nbInputs_; }
+
+	/**
+	 * @brief Number of test vectors
+	 */
+	int nbVectors() const { return nbVectors_; }
+
+	/**
+	 * @brief Number of blocks of 64 test vectors; vectors past the end of the last block are zero
+	 */
+	int nbBlocks() const { return (nbVectors_ + 63) / 64; }
+
+	/**
+	 * @brief Obtain the values of the inputs for a block of test vectors
+	 *
+	 * @param values Output array of nbInputs words
+	 */
+	void getBlock(int block, std::uint64_t *values) const;
+
+	/**
+	 * @brief Obtain the values of the inputs for a block of test vectors
+	 */
+	std::vector<std::uint64_t> getBlock(int block) const;
+
+      private:
+	void getRandomBlock(int block, std::uint64_t *values) const;
+	void getFileBlock(int block, std::uint64_t *values) const;
+
+      private:
+	int nbInputs_;
+	int nbVectors_;
+	std::uint64_t seed_;
+	// Stimulus file and offset of the first line of each block, if the vectors come from a file
+	std::shared_ptr<const MappedFile> file_;
+	std::vector<std::size_t> blockOffsets_;
+};
+
+#endif
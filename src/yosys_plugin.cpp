@@ -7,12 +7,22 @@
 #include "kernel/sigtools.h"
 #include "kernel/yosys.h"
 
+#include "analysis_cache.hpp"
+#include "corruption_sketch.hpp"
 #include "gate_insertion.hpp"
 #include "logic_locking_analyzer.hpp"
 #include "logic_locking_optimizer.hpp"
 #include "mini_aig.hpp"
 #include "output_corruption_optimizer.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
 #include <random>
 
 USING_YOSYS_NAMESPACE
@@ -20,7 +30,20 @@ PRIVATE_NAMESPACE_BEGIN
 
 enum OptimizationTarget { PAIRWISE_SECURITY, OUTPUT_CORRUPTION, HYBRID };
 
-LogicLockingOptimizer make_optimizer(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairwise_security)
+/**
+ * @brief Settings of the pairwise security optimization
+ */
+struct PairwiseSettings {
+	// Maximal cliques enumerated before falling back to the heuristic (0 for no limit)
+	std::size_t max_cliques = 100000;
+	// Time limit of the heuristic in seconds (0 for no limit)
+	double time_limit = 0.0;
+};
+
+/**
+ * @brief Build the interference graph, with nodes in the order of the cells
+ */
+std::vector<std::vector<int>> make_interference_graph(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairwise_security)
 {
 	pool<Cell *> cell_set(cells.begin(), cells.end());
 	for (auto p : pairwise_security) {
@@ -39,81 +62,169 @@ LogicLockingOptimizer make_optimizer(const std::vector<Cell *> &cells, const std
 		gr[i].push_back(j);
 		gr[j].push_back(i);
 	}
+	return gr;
+}
+
+LogicLockingOptimizer make_optimizer(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairwise_security,
+				     const PairwiseSettings &settings)
+{
+	return LogicLockingOptimizer(make_interference_graph(cells, pairwise_security), settings.max_cliques);
+}
 
-	return LogicLockingOptimizer(gr);
+OutputCorruptionOptimizer make_optimizer(const std::vector<Cell *> &cells, const std::shared_ptr<const CorruptionMatrix> &data)
+{
+	log_assert(data->nbSignals() == GetSize(cells));
+	return OutputCorruptionOptimizer(data);
 }
 
-OutputCorruptionOptimizer make_optimizer(const std::vector<Cell *> &cells, const dict<Cell *, std::vector<std::vector<std::uint64_t>>> &data)
+SketchCorruptionOptimizer make_optimizer(const std::vector<Cell *> &cells, const std::shared_ptr<const CorruptionSketch> &data)
 {
-	std::vector<std::vector<std::uint64_t>> corruptionData;
-	for (Cell *c : cells) {
-		std::vector<std::uint64_t> cellCorruption;
-		for (const auto &v : data.at(c)) {
-			for (std::uint64_t d : v) {
-				cellCorruption.push_back(d);
-			}
-		}
-		corruptionData.push_back(cellCorruption);
+	log_assert(data->nbSignals() == GetSize(cells));
+	return SketchCorruptionOptimizer(data);
+}
+
+/**
+ * @brief Build the interference graph optimizer, which enumerates the maximal cliques, as a profiled stage
+ */
+LogicLockingOptimizer make_profiled_optimizer(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairwise_security,
+					      const PairwiseSettings &settings, Profiler &profiler)
+{
+	Profiler::Scope stage(profiler, "cliques");
+	auto opt = make_optimizer(cells, pairwise_security, settings);
+	if (opt.cliquesEnumerated()) {
+		stage.addCount("cliques", opt.nbCliques());
+	} else {
+		log("The interference graph has more than %zu maximal cliques: using the heuristic optimizer.\n", settings.max_cliques);
+	}
+	return opt;
+}
+
+/**
+ * @brief Optimize pairwise security, with the heuristic if the maximal cliques were not enumerated
+ *
+ * The heuristic keeps the cells already locked in its solution. The greedy solutions of increasing sizes are nested, so that
+ * the cells already locked by a smaller greedy solution are part of it.
+ */
+LogicLockingOptimizer::ExplicitSolution solve_pairwise_security(const LogicLockingOptimizer &opt, int maxNumber, const PairwiseSettings &settings,
+								const std::vector<int> &preLocked = std::vector<int>())
+{
+	if (opt.cliquesEnumerated()) {
+		return opt.solveGreedy(maxNumber);
 	}
-	return OutputCorruptionOptimizer(corruptionData);
+	return opt.solveHeuristic(maxNumber, preLocked, settings.time_limit);
 }
 
+/**
+ * @brief Optimize pairwise security, and return the cells to lock in addition to those already locked
+ *
+ * The estimated security is reported for the cells actually locked, already locked cells included.
+ */
 std::vector<Cell *> optimize_pairwise_security(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairwise_security,
-					       int maxNumber)
+					       int maxNumber, const std::vector<int> &preLocked, const PairwiseSettings &settings, Profiler &profiler)
 {
-	auto opt = make_optimizer(cells, pairwise_security);
+	auto opt = make_profiled_optimizer(cells, pairwise_security, settings, profiler);
 
 	log("Running optimization on the interference graph with %d non-trivial nodes out of %d and %d edges.\n", opt.nbConnectedNodes(),
 	    opt.nbNodes(), opt.nbEdges());
-	auto sol = opt.solveGreedy(maxNumber);
+	Profiler::Scope stage(profiler, opt.cliquesEnumerated() ? "greedy" : "heuristic");
+	auto sol = solve_pairwise_security(opt, maxNumber, settings, preLocked);
 
+	pool<int> locked;
+	for (int c : preLocked) {
+		locked.insert(c);
+	}
 	std::vector<Cell *> ret;
 	for (const auto &clique : sol) {
 		for (int c : clique) {
-			ret.push_back(cells[c]);
+			if (!locked.count(c) && GetSize(locked) < maxNumber) {
+				locked.insert(c);
+				ret.push_back(cells[c]);
+			}
 		}
 	}
 
-	double security = opt.value(sol);
-	log("Locking solution with %d cliques, %d locked wires and %.2f estimated security.\n", (int)sol.size(), (int)ret.size(), security);
+	// The cliques restricted to the locked cells, and the locked cells outside of the solution on their own
+	LogicLockingOptimizer::ExplicitSolution locked_sol;
+	pool<int> in_sol;
+	for (const auto &clique : sol) {
+		std::vector<int> kept;
+		for (int c : clique) {
+			if (locked.count(c)) {
+				kept.push_back(c);
+				in_sol.insert(c);
+			}
+		}
+		if (!kept.empty()) {
+			locked_sol.push_back(kept);
+		}
+	}
+	for (int c : preLocked) {
+		if (!in_sol.count(c)) {
+			locked_sol.push_back({c});
+			in_sol.insert(c);
+		}
+	}
+	double security = opt.value(locked_sol);
+	log("Locking solution with %d cliques, %d locked wires and %.2f estimated security.\n", GetSize(locked_sol), GetSize(locked), security);
 	return ret;
 }
 
-std::vector<Cell *> optimize_output_corruption(const std::vector<Cell *> &cells, const dict<Cell *, std::vector<std::vector<std::uint64_t>>> &data,
-					       int maxNumber)
+/**
+ * @brief Optimize output corruption, and return the cells to lock in addition to those already locked
+ */
+template <typename CorruptionData>
+std::vector<Cell *> optimize_output_corruption(const std::vector<Cell *> &cells, const CorruptionData &data, int maxNumber,
+					       const std::vector<int> &preLocked, Profiler &profiler)
 {
+	Profiler::Scope stage(profiler, "greedy");
 	auto opt = make_optimizer(cells, data);
 
-	log("Running corruption optimization with %d unique nodes out of %d.\n", (int)opt.getUniqueNodes().size(), opt.nbNodes());
-	std::vector<int> sol = opt.solveGreedy(maxNumber, std::vector<int>());
+	log("Running corruption optimization with %d unique nodes out of %d.\n", (int)opt.getUniqueNodes(preLocked).size(), opt.nbNodes());
+	std::vector<int> sol = opt.solveGreedy(maxNumber, preLocked);
 	float cover = 100.0 * opt.corruptionCover(sol);
 	float rate = 100.0 * opt.corruptionRate(sol);
 
 	log("Locking solution with %d locked wires, %.2f%% corruption cover and %.2f%% corruption rate.\n", (int)sol.size(), cover, rate);
 
 	std::vector<Cell *> ret;
-	for (int c : sol) {
-		ret.push_back(cells[c]);
+	for (int i = preLocked.size(); i < GetSize(sol); ++i) {
+		ret.push_back(cells[sol[i]]);
 	}
 	return ret;
 }
 
+/**
+ * @brief Lock the largest clique of the interference graph then optimize output corruption, and return the cells to
+ * lock in addition to those already locked
+ *
+ * If some cells are already locked, they include the largest clique and only output corruption is optimized.
+ */
+template <typename CorruptionData>
 std::vector<Cell *> optimize_hybrid(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairwise_security,
-				    const dict<Cell *, std::vector<std::vector<std::uint64_t>>> &data, int maxNumber)
+				    const CorruptionData &data, int maxNumber, const std::vector<int> &preLocked, const PairwiseSettings &settings,
+				    Profiler &profiler)
 {
-	auto pairw = make_optimizer(cells, pairwise_security);
-	auto corr = make_optimizer(cells, data);
-
-	log("Running hybrid optimization\n");
-	log("Interference graph with %d non-trivial nodes out of %d and %d edges.\n", pairw.nbConnectedNodes(), pairw.nbNodes(), pairw.nbEdges());
-	log("Corruption data with %d unique nodes out of %d.\n", (int)corr.getUniqueNodes().size(), corr.nbNodes());
-	auto pairwSol = pairw.solveGreedy(maxNumber);
 	std::vector<int> largestClique;
-	if (!pairwSol.empty() && pairwSol.front().size() > 1) {
-		largestClique = pairwSol.front();
+	std::vector<int> initial = preLocked;
+	if (preLocked.empty()) {
+		auto pairw = make_profiled_optimizer(cells, pairwise_security, settings, profiler);
+		Profiler::Scope stage(profiler, pairw.cliquesEnumerated() ? "greedy" : "heuristic");
+		log("Running hybrid optimization\n");
+		log("Interference graph with %d non-trivial nodes out of %d and %d edges.\n", pairw.nbConnectedNodes(), pairw.nbNodes(),
+		    pairw.nbEdges());
+		auto pairwSol = solve_pairwise_security(pairw, maxNumber, settings);
+		if (!pairwSol.empty() && pairwSol.front().size() > 1) {
+			largestClique = pairwSol.front();
+		}
+		initial = largestClique;
+	} else {
+		log("Running hybrid optimization with %d cells already locked\n", GetSize(preLocked));
 	}
+	Profiler::Scope stage(profiler, "greedy");
+	auto corr = make_optimizer(cells, data);
+	log("Corruption data with %d unique nodes out of %d.\n", (int)corr.getUniqueNodes().size(), corr.nbNodes());
 
-	std::vector<int> sol = corr.solveGreedy(maxNumber, largestClique);
+	std::vector<int> sol = corr.solveGreedy(maxNumber, initial);
 	float cover = 100.0 * corr.corruptionCover(sol);
 	float rate = 100.0 * corr.corruptionRate(sol);
 
@@ -121,82 +232,996 @@ std::vector<Cell *> optimize_hybrid(const std::vector<Cell *> &cells, const std:
 	    (int)sol.size(), (int)largestClique.size(), cover, rate);
 
 	std::vector<Cell *> ret;
-	for (int c : sol) {
-		ret.push_back(cells[c]);
+	for (int i = preLocked.size(); i < GetSize(sol); ++i) {
+		ret.push_back(cells[sol[i]]);
 	}
 	return ret;
 }
 
-void report_tradeoff(const std::vector<Cell *> &cells, const dict<Cell *, std::vector<std::vector<std::uint64_t>>> &data)
+/**
+ * @brief Tradeoff curves of a module, indexed by number of locked cells minus one
+ */
+struct TradeoffCurves {
+	// Output corruption cover and rate, in percent
+	std::vector<float> cover;
+	std::vector<float> rate;
+	std::vector<double> security;
+};
+
+template <typename CorruptionData> void report_tradeoff(const std::vector<Cell *> &cells, const CorruptionData &data, TradeoffCurves &curves)
 {
 	log("Reporting output corruption by number of cells locked\n");
 	auto opt = make_optimizer(cells, data);
 	auto order = opt.solveGreedy(opt.nbNodes(), std::vector<int>());
+	opt.corruptionCurve(order, curves.cover, curves.rate);
 	log("Locked\tCover\tRate\n");
-	for (int i = 1; i <= GetSize(order); ++i) {
-		std::vector<int> sol = order;
-		sol.resize(i);
-		double cover = 100.0 * opt.corruptionCover(sol);
-		double rate = 100.0 * opt.corruptionRate(sol);
-		log("%d\t%.2f\t%.2f\n", i, cover, rate);
+	for (int i = 0; i < GetSize(order); ++i) {
+		curves.cover[i] *= 100.0f;
+		curves.rate[i] *= 100.0f;
+		log("%d\t%.2f\t%.2f\n", i + 1, curves.cover[i], curves.rate[i]);
 	}
 	log("\n\n");
 }
 
-void report_tradeoff(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairwise_security)
+void report_tradeoff(const std::vector<Cell *> &cells, const std::vector<std::pair<Cell *, Cell *>> &pairwise_security,
+		     const PairwiseSettings &settings, TradeoffCurves &curves)
 {
 	log("Reporting pairwise security by number of cells locked\n");
-	auto opt = make_optimizer(cells, pairwise_security);
-	auto all_cliques = opt.solveGreedy(opt.nbNodes());
+	auto opt = make_optimizer(cells, pairwise_security, settings);
+	auto all_cliques = solve_pairwise_security(opt, opt.nbNodes(), settings);
+	curves.security = opt.valueCurve(all_cliques);
 	log("Locked\tSecurity\n");
-	int nbLocked = 0;
-	for (int i = 0; i < GetSize(all_cliques); ++i) {
-		std::vector<int> clique = all_cliques[i];
-		for (int j = 1; j <= GetSize(clique); ++j) {
-			std::vector<std::vector<int>> sol = all_cliques;
-			sol.resize(i + 1);
-			sol.back().resize(j);
-			double security = opt.value(sol);
-			log("%d\t%.2f\n", nbLocked + j, security);
-		}
-		nbLocked += GetSize(clique);
+	for (int i = 0; i < GetSize(curves.security); ++i) {
+		log("%d\t%.2f\n", i + 1, curves.security[i]);
 	}
 	log("\n\n");
 }
 
-void report_logic_locking(RTLIL::Module *module, int nb_test_vectors)
+/**
+ * @brief Write the tradeoff curves of a module as CSV rows, leaving the values missing from a curve empty
+ */
+void write_tradeoff_csv(std::ostream &f, const std::string &module, const TradeoffCurves &curves)
 {
-	LogicLockingAnalyzer pw(module);
-	pw.gen_test_vectors(nb_test_vectors, 1);
-
-	std::vector<Cell *> lockable_cells = pw.get_lockable_cells();
-	auto corruption_data = pw.compute_output_corruption_data();
-	auto pairwise_security = pw.compute_pairwise_secure_graph();
-	report_tradeoff(lockable_cells, corruption_data);
-	report_tradeoff(lockable_cells, pairwise_security);
+	int nb_rows = std::max(GetSize(curves.cover), GetSize(curves.security));
+	for (int i = 0; i < nb_rows; ++i) {
+		f << module << "," << i + 1 << ",";
+		if (i < GetSize(curves.cover)) {
+			f << stringf("%.4f,%.4f", curves.cover[i], curves.rate[i]);
+		} else {
+			f << ",";
+		}
+		f << ",";
+		if (i < GetSize(curves.security)) {
+			f << stringf("%.4f", curves.security[i]);
+		}
+		f << "\n";
+	}
 }
 
-std::vector<Cell *> run_logic_locking(RTLIL::Module *module, int nb_test_vectors, int nb_locked, OptimizationTarget target)
+/**
+ * @brief Stopping criterion of the adaptive output corruption analysis
+ *
+ * The analysis has converged once the ranking of the top cells picked by the corruption optimizer has not changed
+ * for several consecutive checks, and the 95% confidence intervals of the corruption rates of all cells are narrower
+ * than the tolerance. The outputs of a test vector are correlated: the intervals are computed on the rate averaged
+ * over the outputs, whose variance is bounded as if each test vector were a single sample. Each check only reads the
+ * test vectors simulated so far, and checks become sparser as their number grows, so that their total cost stays
+ * proportional to the last one.
+ */
+class ConvergenceCheck
+{
+      public:
+	ConvergenceCheck(double tolerance, int top_k) : tolerance_(tolerance), top_k_(top_k), next_check_(1), nb_stable_(0) {}
+
+	int top_k() const { return top_k_; }
+
+	/**
+	 * @brief Query whether convergence should be checked after this number of test vector words
+	 */
+	bool should_check(int nb_words) const { return nb_words >= next_check_; }
+
+	/**
+	 * @brief Check convergence given the current ranking and the number of corrupted (output, test vector) pairs of each cell
+	 */
+	bool converged(int nb_words, const std::vector<int> &ranking, const std::vector<long long> &counts, int nb_outputs)
+	{
+		next_check_ = nb_words + std::max(1, nb_words / 8);
+		nb_stable_ = !ranking_.empty() && ranking == ranking_ ? nb_stable_ + 1 : 0;
+		ranking_ = ranking;
+		if (nb_stable_ < min_stable_checks) {
+			return false;
+		}
+		// Agresti-Coull interval, which does not collapse for cells that are never or always corrupting
+		double n = 64.0 * nb_words + 4.0;
+		for (long long c : counts) {
+			double p = ((double)c / std::max(nb_outputs, 1) + 2.0) / n;
+			if (2 * 1.96 * std::sqrt(p * (1.0 - p) / n) >= tolerance_) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+      private:
+	// Number of consecutive checks with the same ranking
+	static const int min_stable_checks = 3;
+
+	double tolerance_;
+	int top_k_;
+	int next_check_;
+	int nb_stable_;
+	std::vector<int> ranking_;
+};
+
+/**
+ * @brief Analysis results of a module, computed on demand or loaded from the cache directory
+ *
+ * The analyzer is only built if some results are missing from the cache.
+ */
+class ModuleAnalysis
+{
+      public:
+	/**
+	 * @brief Analyze a module with random test vectors, or with the test vectors of a stimulus file if given
+	 *
+	 * With several cycles, output corruption is measured over sequences of cycles (see LogicLockingAnalyzer::set_nb_cycles),
+	 * and the number of random test vectors is the number of sequences.
+	 */
+	ModuleAnalysis(Module *module, int nb_test_vectors, int nb_cycles, int nb_threads, const std::string &cache_dir, const std::string &stimulus_file)
+	    : module_(module), nb_test_vectors_(nb_test_vectors), nb_cycles_(nb_cycles), nb_threads_(nb_threads), stimulus_file_(stimulus_file),
+	      sketch_size_(0), strashing_(false), adaptive_(false), adaptive_tolerance_(0.0), adaptive_top_k_(0), shard_(0), nb_shards_(1),
+	      pairwise_computed_(false), pending_pairwise_(false), pending_corruption_(false), defer_log_(false)
+	{
+		lockable_cells_ = LogicLockingAnalyzer::get_lockable_cells(module);
+		if (!cache_dir.empty()) {
+			cache_.reset(new AnalysisCache(cache_dir, module, nb_test_vectors, test_vector_seed, stimulus_file, nb_cycles));
+		}
+	}
+
+	const std::vector<Cell *> &lockable_cells() const { return lockable_cells_; }
+
+	std::string module_name() const { return log_id(module_->name); }
+
+	int nb_threads() const { return resolve_nb_threads(nb_threads_); }
+
+	/**
+	 * @brief Time and memory usage of the analysis stages
+	 */
+	Profiler &profiler() { return profiler_; }
+
+	/**
+	 * @brief Store the output corruption data in a memory-mapped file rather than in memory
+	 */
+	void set_corruption_file(const std::string &filename) { corruption_file_ = filename; }
+
+	/**
+	 * @brief Obtain the output corruption data, computed once
+	 */
+	std::shared_ptr<const CorruptionMatrix> compute_output_corruption_data()
+	{
+		if (!corruption_) {
+			corruption_ = adaptive_ ? compute_output_corruption_data_adaptive() : compute_output_corruption_data_uncached();
+		}
+		return corruption_;
+	}
+
+	/**
+	 * @brief Use streaming analysis and sketches of the given size for output corruption (0 to disable)
+	 */
+	void set_sketch_size(int sketch_size) { sketch_size_ = sketch_size; }
+
+	bool use_sketch() const { return sketch_size_ > 0; }
+
+	/**
+	 * @brief Merge structurally identical logic in the AIG of the analyzer
+	 */
+	void set_strashing(bool strashing) { strashing_ = strashing; }
+
+	/**
+	 * @brief Simulate the output corruption by blocks of test vectors until it converges, up to the number of test vectors
+	 *
+	 * See ConvergenceCheck for the stopping criterion. The pairwise security analysis still uses all test vectors.
+	 */
+	void set_adaptive(double tolerance, int top_k)
+	{
+		adaptive_ = true;
+		adaptive_tolerance_ = tolerance;
+		adaptive_top_k_ = top_k;
+	}
+
+	/**
+	 * @brief Obtain the output corruption sketch, computed once
+	 */
+	std::shared_ptr<const CorruptionSketch> compute_output_corruption_sketch()
+	{
+		if (!corruption_sketch_) {
+			corruption_sketch_ = compute_output_corruption_sketch_uncached();
+		}
+		return corruption_sketch_;
+	}
+
+	/**
+	 * @brief Restrict the analyses to a shard (see LogicLockingAnalyzer::set_shard); the cache is not used
+	 */
+	void set_shard(int shard, int nb_shards)
+	{
+		shard_ = shard;
+		nb_shards_ = nb_shards;
+		cache_.reset();
+	}
+
+	/**
+	 * @brief Run the analyses of the shard and write their partial results
+	 */
+	void save_shard(const std::string &filename, bool pairwise, bool corruption)
+	{
+		ShardResults results;
+		results.shard = shard_;
+		results.nb_shards = nb_shards_;
+		results.has_pairwise = pairwise;
+		results.has_corruption = corruption;
+		if (pairwise) {
+			results.pairwise = compute_pairwise_secure_graph();
+		}
+		if (corruption) {
+			results.corruption = compute_output_corruption_data();
+		}
+		AnalysisCache::save_shard(filename, key(), lockable_cells_, results);
+	}
+
+	/**
+	 * @brief Obtain the analysis results by merging the partial results of all shards, instead of computing them
+	 */
+	void merge_shards(const std::vector<std::string> &filenames)
+	{
+		Profiler::Scope stage(profiler_, "merge");
+		int nb_shards = 0;
+		std::vector<bool> found;
+		bool has_pairwise = false;
+		bool has_corruption = false;
+		std::shared_ptr<CorruptionMatrix> corruption;
+		pairwise_.clear();
+		for (const std::string &filename : filenames) {
+			ShardResults results;
+			if (!AnalysisCache::load_shard(filename, key(), lockable_cells_, results)) {
+				log_error("Could not read shard %s, or it was computed on another design or with other test vectors\n", filename.c_str());
+			}
+			if (found.empty()) {
+				nb_shards = results.nb_shards;
+				found.assign(nb_shards, false);
+				has_pairwise = results.has_pairwise;
+				has_corruption = results.has_corruption;
+				if (has_corruption) {
+					const CorruptionMatrix &data = *results.corruption;
+					int nb_signals = GetSize(lockable_cells_);
+					if (corruption_file_.empty()) {
+						corruption = std::make_shared<CorruptionMatrix>(nb_signals, data.nbOutputs(), data.nbWords());
+					} else {
+						corruption = std::make_shared<CorruptionMatrix>(nb_signals, data.nbOutputs(), data.nbWords(), corruption_file_);
+					}
+				}
+			}
+			if (results.nb_shards != nb_shards || results.has_pairwise != has_pairwise || results.has_corruption != has_corruption) {
+				log_error("Shard %s was computed with other sharding or analysis options\n", filename.c_str());
+			}
+			if (found[results.shard]) {
+				log_error("Shard %d/%d is given twice\n", results.shard + 1, nb_shards);
+			}
+			found[results.shard] = true;
+			pairwise_.insert(pairwise_.end(), results.pairwise.begin(), results.pairwise.end());
+			if (has_corruption) {
+				// The shard only holds the rows of its cells
+				const CorruptionMatrix &data = *results.corruption;
+				if (data.nbOutputs() != corruption->nbOutputs() || data.nbWords() != corruption->nbWords()) {
+					log_error("Shard %s was computed with other test vectors\n", filename.c_str());
+				}
+				for (int r = 0; r < data.nbSignals(); ++r) {
+					std::memcpy(corruption->row(results.shard + r * nb_shards), data.row(r), data.rowSize() * sizeof(std::uint64_t));
+				}
+			}
+			log("Read shard %d/%d from %s\n", results.shard + 1, nb_shards, filename.c_str());
+		}
+		for (int k = 0; k < nb_shards; ++k) {
+			if (!found[k]) {
+				log_error("Shard %d/%d is missing\n", k + 1, nb_shards);
+			}
+		}
+		stage.addCount("shards", nb_shards);
+		if (has_pairwise) {
+			// Same order as a single analysis, by cell index
+			dict<Cell *, int> cell_to_ind;
+			for (int i = 0; i < GetSize(lockable_cells_); ++i) {
+				cell_to_ind[lockable_cells_[i]] = i;
+			}
+			std::sort(pairwise_.begin(), pairwise_.end(), [&](const std::pair<Cell *, Cell *> &a, const std::pair<Cell *, Cell *> &b) {
+				return std::make_pair(cell_to_ind.at(a.first), cell_to_ind.at(a.second)) <
+				       std::make_pair(cell_to_ind.at(b.first), cell_to_ind.at(b.second));
+			});
+			pairwise_computed_ = true;
+		}
+		corruption_ = corruption;
+	}
+
+	/**
+	 * @brief Query whether the pairwise security graph was obtained from shards
+	 */
+	bool has_merged_pairwise() const { return pairwise_computed_; }
+
+	/**
+	 * @brief Query whether the output corruption data was obtained from shards
+	 */
+	bool has_merged_corruption() const { return corruption_ != nullptr; }
+
+	const std::vector<std::pair<Cell *, Cell *>> &compute_pairwise_secure_graph()
+	{
+		if (pairwise_computed_) {
+			return pairwise_;
+		}
+		pairwise_ = compute_pairwise_secure_graph_uncached();
+		pairwise_computed_ = true;
+		return pairwise_;
+	}
+
+	/**
+	 * @brief Update the analysis after locking gates were inserted at the outputs of some lockable cells
+	 *
+	 * With the key bits at their correct value, the locked module has the same function: the results computed so far
+	 * remain valid for the original lockable cells and are kept, and the analyzer is patched rather than rebuilt
+	 * (see LogicLockingAnalyzer::add_locking_gates). The locking gates do not become lockable cells.
+	 */
+	void add_locking_gates(const std::vector<Cell *> &locked_cells, const std::vector<Cell *> &gates)
+	{
+		if (analyzer_) {
+			analyzer_->add_locking_gates(locked_cells, gates);
+		}
+	}
+
+	/**
+	 * @brief Prepare the analyses needed by the optimization to run from a worker thread, concurrently with other modules
+	 *
+	 * Cached results are loaded and the analyzer is built on the calling thread, as Yosys data structures are not thread-safe.
+	 * The analyzer is then restricted to a single thread, and its messages are kept until finish_concurrent_analysis.
+	 *
+	 * @return Whether some results still need to be simulated by run_concurrent_analysis
+	 */
+	bool prepare_concurrent_analysis(bool pairwise, bool corruption)
+	{
+		pending_pairwise_ = pairwise && !pairwise_computed_;
+		if (pending_pairwise_ && cache_ && cache_->load_pairwise_secure_graph(lockable_cells_, pairwise_)) {
+			pairwise_computed_ = true;
+			pending_pairwise_ = false;
+		}
+		if (use_sketch()) {
+			pending_corruption_ = corruption && !corruption_sketch_;
+		} else {
+			pending_corruption_ = corruption && !corruption_;
+			if (pending_corruption_ && !adaptive_) {
+				corruption_ = load_cached_output_corruption_data();
+				pending_corruption_ = !corruption_;
+			}
+		}
+		if (!pending_pairwise_ && !pending_corruption_) {
+			return false;
+		}
+		LogicLockingAnalyzer &pw = analyzer();
+		pw.set_nb_threads(1);
+		pw.set_log_buffer(&log_buffer_);
+		defer_log_ = true;
+		return true;
+	}
+
+	/**
+	 * @brief Simulate the results left by prepare_concurrent_analysis; safe to call from a worker thread
+	 */
+	void run_concurrent_analysis()
+	{
+		if (pending_pairwise_) {
+			pairwise_ = simulate_pairwise_secure_graph();
+			pairwise_computed_ = true;
+		}
+		if (pending_corruption_) {
+			if (use_sketch()) {
+				corruption_sketch_ = compute_output_corruption_sketch_uncached();
+			} else if (adaptive_) {
+				corruption_ = compute_output_corruption_data_adaptive();
+			} else {
+				corruption_ = simulate_output_corruption_data();
+			}
+		}
+	}
+
+	/**
+	 * @brief After run_concurrent_analysis, log its messages, save its results to the cache and restore the number of threads
+	 */
+	void finish_concurrent_analysis()
+	{
+		defer_log_ = false;
+		analyzer_->set_log_buffer(nullptr);
+		analyzer_->set_nb_threads(nb_threads_);
+		log("%s", log_buffer_.c_str());
+		log_buffer_.clear();
+		if (cache_ && pending_pairwise_) {
+			cache_->save_pairwise_secure_graph(lockable_cells_, pairwise_);
+		}
+		if (cache_ && pending_corruption_ && !use_sketch() && !adaptive_) {
+			cache_->save_output_corruption_data(lockable_cells_, *corruption_);
+		}
+		pending_pairwise_ = false;
+		pending_corruption_ = false;
+	}
+
+      private:
+	std::shared_ptr<const CorruptionMatrix> compute_output_corruption_data_uncached()
+	{
+		auto data = load_cached_output_corruption_data();
+		if (data) {
+			return data;
+		}
+		data = simulate_output_corruption_data();
+		if (cache_) {
+			cache_->save_output_corruption_data(lockable_cells_, *data);
+		}
+		return data;
+	}
+
+	/**
+	 * @brief Load the output corruption data from the cache, or return null
+	 */
+	std::shared_ptr<const CorruptionMatrix> load_cached_output_corruption_data()
+	{
+		auto data = std::make_shared<CorruptionMatrix>();
+		if (cache_ && cache_->load_output_corruption_data(lockable_cells_, corruption_file_, *data)) {
+			return data;
+		}
+		return nullptr;
+	}
+
+	std::shared_ptr<const CorruptionMatrix> simulate_output_corruption_data()
+	{
+		LogicLockingAnalyzer &pw = analyzer();
+		pw.set_corruption_backing_file(corruption_file_);
+		Profiler::Scope stage(profiler_, "corruption");
+		auto data = std::make_shared<CorruptionMatrix>(pw.compute_output_corruption_data());
+		stage.addCount("nodes", pw.nb_simulated_nodes());
+		return data;
+	}
+
+	std::shared_ptr<const CorruptionSketch> compute_output_corruption_sketch_uncached()
+	{
+		LogicLockingAnalyzer &pw = analyzer();
+		auto sketch = std::make_shared<CorruptionSketch>(GetSize(lockable_cells_), GetSize(pw.get_comb_outputs()), sketch_size_);
+		Profiler::Scope stage(profiler_, "corruption");
+		ConvergenceCheck check(adaptive_tolerance_, adaptive_top_k_);
+		auto stop = [&](int nb_words) {
+			if (!check.should_check(nb_words)) {
+				return false;
+			}
+			// The sketch is only sorted when finished: sort it in place for the check, then put it back in heaps
+			sketch->finish(nb_words);
+			std::vector<long long> counts;
+			for (int i = 0; i < sketch->nbSignals(); ++i) {
+				counts.push_back(sketch->count(i));
+			}
+			SketchCorruptionOptimizer opt(sketch);
+			bool converged = check.converged(nb_words, opt.solveGreedy(check.top_k(), {}), counts, sketch->nbOutputs());
+			if (!converged) {
+				sketch->resume();
+			}
+			return converged;
+		};
+		int nb_words = pw.stream_output_corruption_data(
+		  [&](int signal, int first_word, int nb_words, const std::uint64_t *data) { sketch->addRow(signal, first_word, nb_words, data); },
+		  adaptive_ ? stop : std::function<bool(int)>());
+		sketch->finish(nb_words);
+		stage.addCount("nodes", pw.nb_simulated_nodes());
+		if (adaptive_) {
+			report_convergence(nb_words, stage);
+		}
+		return sketch;
+	}
+
+	/**
+	 * @brief Compute the output corruption data by blocks until it converges; the results are not cached
+	 */
+	std::shared_ptr<const CorruptionMatrix> compute_output_corruption_data_adaptive()
+	{
+		LogicLockingAnalyzer &pw = analyzer();
+		int nb_outputs = GetSize(pw.get_comb_outputs());
+		int nb_signals = GetSize(lockable_cells_);
+		Profiler::Scope stage(profiler_, "corruption");
+		// Room for all test vectors, indexed by word then output in each row so that the simulated prefix is contiguous
+		int max_words = pw.nb_corruption_words();
+		std::shared_ptr<CorruptionMatrix> all;
+		if (corruption_file_.empty()) {
+			all = std::make_shared<CorruptionMatrix>(nb_signals, 1, max_words * nb_outputs);
+		} else {
+			all = std::make_shared<CorruptionMatrix>(nb_signals, 1, max_words * nb_outputs, corruption_file_ + ".adaptive");
+		}
+		// Running corruption counts, updated by the workers: each signal is only handled by one worker at a time
+		std::vector<long long> counts(nb_signals, 0);
+		ConvergenceCheck check(adaptive_tolerance_, adaptive_top_k_);
+		int nb_words = pw.stream_output_corruption_data(
+		  [&](int signal, int first_word, int nb_words, const std::uint64_t *data) {
+			  std::uint64_t *row = all->row(signal) + (size_t)first_word * nb_outputs;
+			  for (int o = 0; o < nb_outputs; ++o) {
+				  for (int w = 0; w < nb_words; ++w) {
+					  row[(size_t)w * nb_outputs + o] = data[(size_t)o * nb_words + w];
+				  }
+			  }
+			  for (size_t k = 0; k < (size_t)nb_outputs * nb_words; ++k) {
+				  counts[signal] += __builtin_popcountll(data[k]);
+			  }
+		  },
+		  [&](int nb_words) {
+			  if (!check.should_check(nb_words)) {
+				  return false;
+			  }
+			  // The corruption cover does not depend on the order of the words: the check only reads the simulated prefix
+			  OutputCorruptionOptimizer opt(all, nb_words * nb_outputs);
+			  return check.converged(nb_words, opt.solveGreedy(check.top_k(), {}), counts, nb_outputs);
+		  });
+		stage.addCount("nodes", pw.nb_simulated_nodes());
+		report_convergence(nb_words, stage);
+		std::shared_ptr<CorruptionMatrix> data;
+		if (corruption_file_.empty()) {
+			data = std::make_shared<CorruptionMatrix>(nb_signals, nb_outputs, nb_words);
+		} else {
+			data = std::make_shared<CorruptionMatrix>(nb_signals, nb_outputs, nb_words, corruption_file_);
+		}
+		for (int i = 0; i < nb_signals; ++i) {
+			const std::uint64_t *row = all->row(i);
+			for (int o = 0; o < nb_outputs; ++o) {
+				std::uint64_t *dest = data->get(i, o);
+				for (int w = 0; w < nb_words; ++w) {
+					dest[w] = row[(size_t)w * nb_outputs + o];
+				}
+			}
+		}
+		return data;
+	}
+
+	void report_convergence(int nb_words, Profiler::Scope &stage)
+	{
+		LogicLockingAnalyzer &pw = analyzer();
+		if (nb_words < pw.nb_corruption_words()) {
+			message(stringf("Output corruption converged after %d blocks of 64 test vectors out of %d.\n", nb_words, pw.nb_corruption_words()));
+		} else {
+			message(stringf("Output corruption did not converge within %d blocks of 64 test vectors.\n", nb_words));
+		}
+		stage.addCount("vectors", 64.0 * nb_words);
+	}
+
+	std::vector<std::pair<Cell *, Cell *>> compute_pairwise_secure_graph_uncached()
+	{
+		std::vector<std::pair<Cell *, Cell *>> pairs;
+		if (cache_ && cache_->load_pairwise_secure_graph(lockable_cells_, pairs)) {
+			return pairs;
+		}
+		pairs = simulate_pairwise_secure_graph();
+		if (cache_) {
+			cache_->save_pairwise_secure_graph(lockable_cells_, pairs);
+		}
+		return pairs;
+	}
+
+	std::vector<std::pair<Cell *, Cell *>> simulate_pairwise_secure_graph()
+	{
+		LogicLockingAnalyzer &pw = analyzer();
+		Profiler::Scope stage(profiler_, "pairwise");
+		auto pairs = pw.compute_pairwise_secure_graph();
+		stage.addCount("nodes", pw.nb_simulated_nodes());
+		stage.addCount("pairs", pw.nb_simulated_pairs());
+		return pairs;
+	}
+
+	/**
+	 * @brief Log a message, or keep it for finish_concurrent_analysis during a concurrent analysis
+	 */
+	void message(const std::string &msg)
+	{
+		if (defer_log_) {
+			log_buffer_ += msg;
+		} else {
+			log("%s", msg.c_str());
+		}
+	}
+
+	/**
+	 * @brief Key identifying the module and the test vectors, shared by all shards of an analysis
+	 */
+	std::uint64_t key() const { return AnalysisCache::compute_key(module_, nb_test_vectors_, test_vector_seed, stimulus_file_, nb_cycles_); }
+
+	LogicLockingAnalyzer &analyzer()
+	{
+		if (!analyzer_) {
+			{
+				Profiler::Scope stage(profiler_, "aig");
+				analyzer_.reset(new LogicLockingAnalyzer(module_, strashing_));
+				stage.addCount("cells", GetSize(module_->cells_));
+				stage.addCount("nodes", analyzer_->nb_aig_nodes());
+			}
+			analyzer_->set_nb_threads(nb_threads_);
+			analyzer_->set_nb_cycles(nb_cycles_);
+			analyzer_->set_shard(shard_, nb_shards_);
+			Profiler::Scope stage(profiler_, "test_vectors");
+			if (stimulus_file_.empty()) {
+				// One block per cycle of each sequence
+				int nb_vectors = nb_cycles_ == 1 ? nb_test_vectors_ : (nb_test_vectors_ + 63) / 64 * 64 * nb_cycles_;
+				analyzer_->gen_test_vectors(nb_vectors, test_vector_seed);
+			} else {
+				analyzer_->load_test_vectors(stimulus_file_);
+				log("Read %d blocks of 64 test vectors from %s\n", analyzer_->nb_test_vectors(), stimulus_file_.c_str());
+			}
+			if (analyzer_->nb_corruption_words() == 0) {
+				log_error("There are fewer blocks of 64 test vectors than the %d cycles of a sequence\n", nb_cycles_);
+			}
+			stage.addCount("vectors", 64.0 * analyzer_->nb_test_vectors());
+		}
+		return *analyzer_;
+	}
+
+	static const std::size_t test_vector_seed = 1;
+
+	Module *module_;
+	int nb_test_vectors_;
+	int nb_cycles_;
+	int nb_threads_;
+	std::string stimulus_file_;
+	int sketch_size_;
+	bool strashing_;
+	bool adaptive_;
+	double adaptive_tolerance_;
+	int adaptive_top_k_;
+	int shard_;
+	int nb_shards_;
+	std::string corruption_file_;
+	std::vector<Cell *> lockable_cells_;
+	bool pairwise_computed_;
+	std::vector<std::pair<Cell *, Cell *>> pairwise_;
+	std::shared_ptr<const CorruptionMatrix> corruption_;
+	std::shared_ptr<const CorruptionSketch> corruption_sketch_;
+	std::unique_ptr<LogicLockingAnalyzer> analyzer_;
+	std::unique_ptr<AnalysisCache> cache_;
+	Profiler profiler_;
+	// State of a concurrent analysis
+	bool pending_pairwise_;
+	bool pending_corruption_;
+	bool defer_log_;
+	std::string log_buffer_;
+};
+
+/**
+ * @brief Report the tradeoff curves of a module, and write them to a CSV file if given
+ */
+void report_logic_locking(ModuleAnalysis &analysis, const PairwiseSettings &settings, std::ostream *csv)
 {
-	LogicLockingAnalyzer pw(module);
-	pw.gen_test_vectors(nb_test_vectors, 1);
+	const std::vector<Cell *> &lockable_cells = analysis.lockable_cells();
+	TradeoffCurves curves;
+	// Run the analyses first, in their own stages, so that the report stage only times the tradeoff curves
+	std::shared_ptr<const CorruptionSketch> sketch;
+	std::shared_ptr<const CorruptionMatrix> data;
+	if (analysis.use_sketch()) {
+		sketch = analysis.compute_output_corruption_sketch();
+	} else {
+		data = analysis.compute_output_corruption_data();
+	}
+	auto pairwise_security = analysis.compute_pairwise_secure_graph();
+	{
+		Profiler::Scope stage(analysis.profiler(), "report");
+		if (sketch) {
+			report_tradeoff(lockable_cells, sketch, curves);
+		} else {
+			report_tradeoff(lockable_cells, data, curves);
+		}
+		report_tradeoff(lockable_cells, pairwise_security, settings, curves);
+	}
+	if (csv) {
+		write_tradeoff_csv(*csv, analysis.module_name(), curves);
+	}
+}
 
-	std::vector<Cell *> lockable_cells = pw.get_lockable_cells();
+/**
+ * @brief Select the cells to lock so that nb_locked cells are locked in total, and return those not already locked
+ */
+std::vector<Cell *> run_logic_locking(ModuleAnalysis &analysis, int nb_locked, OptimizationTarget target, const PairwiseSettings &settings,
+				      const std::vector<Cell *> &already_locked)
+{
+	const std::vector<Cell *> &lockable_cells = analysis.lockable_cells();
+	dict<Cell *, int> cell_to_ind;
+	for (int i = 0; i < GetSize(lockable_cells); ++i) {
+		cell_to_ind[lockable_cells[i]] = i;
+	}
+	std::vector<int> pre_locked;
+	for (Cell *cell : already_locked) {
+		pre_locked.push_back(cell_to_ind.at(cell));
+	}
 	std::vector<Cell *> locked_gates;
+	Profiler &profiler = analysis.profiler();
 	if (target == PAIRWISE_SECURITY) {
-		auto pairwise_security = pw.compute_pairwise_secure_graph();
-		locked_gates = optimize_pairwise_security(lockable_cells, pairwise_security, nb_locked);
+		auto pairwise_security = analysis.compute_pairwise_secure_graph();
+		locked_gates = optimize_pairwise_security(lockable_cells, pairwise_security, nb_locked, pre_locked, settings, profiler);
 	} else if (target == OUTPUT_CORRUPTION) {
-		auto corruption_data = pw.compute_output_corruption_data();
-		locked_gates = optimize_output_corruption(lockable_cells, corruption_data, nb_locked);
+		if (analysis.use_sketch()) {
+			locked_gates =
+			  optimize_output_corruption(lockable_cells, analysis.compute_output_corruption_sketch(), nb_locked, pre_locked, profiler);
+		} else {
+			locked_gates = optimize_output_corruption(lockable_cells, analysis.compute_output_corruption_data(), nb_locked, pre_locked, profiler);
+		}
 	} else if (target == HYBRID) {
-		auto pairwise_security = pw.compute_pairwise_secure_graph();
-		auto corruption_data = pw.compute_output_corruption_data();
-		locked_gates = optimize_hybrid(lockable_cells, pairwise_security, corruption_data, nb_locked);
+		auto pairwise_security = analysis.compute_pairwise_secure_graph();
+		if (analysis.use_sketch()) {
+			locked_gates = optimize_hybrid(lockable_cells, pairwise_security, analysis.compute_output_corruption_sketch(), nb_locked, pre_locked,
+						       settings, profiler);
+		} else {
+			locked_gates = optimize_hybrid(lockable_cells, pairwise_security, analysis.compute_output_corruption_data(), nb_locked, pre_locked,
+						       settings, profiler);
+		}
 	}
 	return locked_gates;
 }
 
+/**
+ * @brief Lock a module for increasing key sizes, each step locking more cells in addition to those of the previous one
+ *
+ * The analysis is run once: after each step, it is patched for the inserted gates rather than rebuilt. The first bits of
+ * the key lock the cells of each step, so that the locking for a key size of the list is given by a prefix of the key.
+ *
+ * @param key_bits Key values available to the module
+ * @return The number of cells locked
+ */
+int lock_module(ModuleAnalysis &analysis, Module *mod, const std::vector<int> &key_sizes, OptimizationTarget target,
+		const PairwiseSettings &settings, const std::vector<bool> &key_bits)
+{
+	std::vector<Cell *> locked;
+	RTLIL::Wire *w = nullptr;
+	for (int key_size : key_sizes) {
+		if (GetSize(key_sizes) > 1) {
+			log("Locking step with key size %d\n", key_size);
+		}
+		auto locked_gates = run_logic_locking(analysis, key_size, target, settings, locked);
+		Profiler::Scope stage(analysis.profiler(), "gate_insertion");
+		if (!w) {
+			// Room for the largest key size; unused bits are removed at the end
+			int width = GetSize(key_sizes) > 1 ? std::min(key_sizes.back(), GetSize(analysis.lockable_cells())) : GetSize(locked_gates);
+			w = add_key_input(mod, width);
+		}
+		int offset = locked.size();
+		int nb_new = locked_gates.size();
+		std::vector<bool> step_key(key_bits.begin() + offset, key_bits.begin() + offset + nb_new);
+		auto gates = lock_gates(mod, locked_gates, SigSpec(w, offset, nb_new), step_key);
+		analysis.add_locking_gates(locked_gates, gates);
+		locked.insert(locked.end(), locked_gates.begin(), locked_gates.end());
+		stage.addCount("gates", nb_new);
+		if (GetSize(key_sizes) > 1) {
+			log("Key size %d: %d cells locked by bits 0 to %d of lock_key\n", key_size, GetSize(locked), GetSize(locked) - 1);
+		}
+	}
+	if (w && w->width > GetSize(locked)) {
+		w->width = GetSize(locked);
+		mod->fixup_ports();
+	}
+	return locked.size();
+}
+
+/**
+ * @brief Split the key bits between modules, proportionally to their number of lockable cells
+ *
+ * Uses the largest remainder method, with ties broken by module order, so that the split is deterministic
+ * and no module gets more bits than it has lockable cells.
+ */
+std::vector<int> split_key_budget(const std::vector<int> &nb_lockable, int nb_locked)
+{
+	long long total = 0;
+	for (int n : nb_lockable) {
+		total += n;
+	}
+	std::vector<int> budgets(nb_lockable.size(), 0);
+	if (total == 0) {
+		return budgets;
+	}
+	nb_locked = std::min((long long)nb_locked, total);
+	std::vector<std::pair<long long, int>> remainders;
+	int allocated = 0;
+	for (int m = 0; m < GetSize(nb_lockable); ++m) {
+		long long share = (long long)nb_locked * nb_lockable[m];
+		budgets[m] = share / total;
+		allocated += budgets[m];
+		remainders.emplace_back(-(share % total), m);
+	}
+	std::sort(remainders.begin(), remainders.end());
+	for (int i = 0; allocated < nb_locked; ++i) {
+		++budgets[remainders[i].second];
+		++allocated;
+	}
+	return budgets;
+}
+
+/**
+ * @brief Drive the lock_key inputs of the locked submodules from the lock_key of the modules that instantiate them
+ *
+ * Each module is locked with its own lock_key input, holding its bits of the global key in key_ranges (offset, size).
+ * A module that instantiates locked modules gets a lock_key input that concatenates the bits of itself and of all the
+ * locked modules below it, in module order, and routes their slices to the instances; its own key is renamed lock_key_local.
+ * A top module whose hierarchy contains all the locked modules then has the global key as its lock_key.
+ */
+void route_key_inputs(Design *design, const std::vector<Module *> &modules, const std::vector<std::pair<int, int>> &key_ranges)
+{
+	int nb_modules = GetSize(modules);
+	dict<IdString, int> module_index;
+	for (int m = 0; m < nb_modules; ++m) {
+		module_index[modules[m]->name] = m;
+	}
+	std::vector<std::vector<int>> children(nb_modules);
+	for (int m = 0; m < nb_modules; ++m) {
+		for (Cell *cell : modules[m]->cells()) {
+			auto it = module_index.find(cell->type);
+			if (it != module_index.end() && std::find(children[m].begin(), children[m].end(), it->second) == children[m].end()) {
+				children[m].push_back(it->second);
+			}
+		}
+	}
+	for (auto &it_mod : design->modules_) {
+		Module *mod = it_mod.second;
+		if (module_index.count(mod->name)) {
+			continue;
+		}
+		for (Cell *cell : mod->cells()) {
+			auto it = module_index.find(cell->type);
+			if (it != module_index.end() && key_ranges[it->second].second > 0) {
+				log_warning("Instance %s of locked module %s is in unselected module %s: its lock_key is left undriven\n",
+					    log_id(cell->name), log_id(cell->type), log_id(mod->name));
+			}
+		}
+	}
+
+	// Locked modules in the hierarchy of each module, itself included, in module order
+	std::vector<std::vector<int>> layout(nb_modules);
+	for (int m = 0; m < nb_modules; ++m) {
+		std::vector<bool> visited(nb_modules, false);
+		std::vector<int> stack = {m};
+		visited[m] = true;
+		while (!stack.empty()) {
+			int cur = stack.back();
+			stack.pop_back();
+			for (int c : children[cur]) {
+				if (!visited[c]) {
+					visited[c] = true;
+					stack.push_back(c);
+				}
+			}
+		}
+		for (int x = 0; x < nb_modules; ++x) {
+			if (visited[x] && key_ranges[x].second > 0) {
+				layout[m].push_back(x);
+			}
+		}
+	}
+
+	// Position of each module's bits in the lock_key of the modules above it
+	std::vector<dict<int, int>> position(nb_modules);
+	std::vector<int> width(nb_modules, 0);
+	for (int m = 0; m < nb_modules; ++m) {
+		for (int x : layout[m]) {
+			position[m][x] = width[m];
+			width[m] += key_ranges[x].second;
+		}
+	}
+
+	std::vector<Wire *> keys(nb_modules, nullptr);
+	for (int m = 0; m < nb_modules; ++m) {
+		Module *mod = modules[m];
+		int own_size = key_ranges[m].second;
+		if (width[m] == own_size) {
+			keys[m] = own_size > 0 ? mod->wire(RTLIL::escape_id("lock_key")) : nullptr;
+			continue;
+		}
+		if (own_size > 0) {
+			Wire *own = mod->wire(RTLIL::escape_id("lock_key"));
+			if (mod->wire(RTLIL::escape_id("lock_key_local"))) {
+				log_error("Wire lock_key_local is already present in module %s\n", log_id(mod->name));
+			}
+			mod->rename(own, RTLIL::escape_id("lock_key_local"));
+			own->port_input = false;
+		}
+		keys[m] = add_key_input(mod, width[m]);
+		if (own_size > 0) {
+			mod->connect(SigSpec(mod->wire(RTLIL::escape_id("lock_key_local"))), SigSpec(keys[m], position[m][m], own_size));
+		}
+	}
+
+	for (int m = 0; m < nb_modules; ++m) {
+		for (Cell *cell : modules[m]->cells()) {
+			auto it = module_index.find(cell->type);
+			if (it == module_index.end() || width[it->second] == 0) {
+				continue;
+			}
+			SigSpec sig;
+			for (int x : layout[it->second]) {
+				sig.append(SigSpec(keys[m], position[m][x], key_ranges[x].second));
+			}
+			cell->setPort(RTLIL::escape_id("lock_key"), sig);
+		}
+	}
+
+	for (int m = 0; m < nb_modules; ++m) {
+		if (width[m] == 0 || width[m] == key_ranges[m].second) {
+			continue;
+		}
+		std::string mapping;
+		for (int x : layout[m]) {
+			mapping += stringf("%s%s bits %d to %d", mapping.empty() ? "" : ", ", log_id(modules[x]->name), key_ranges[x].first,
+					   key_ranges[x].first + key_ranges[x].second - 1);
+		}
+		log("Module %s: lock_key of %d bits routed to its submodules: %s\n", log_id(modules[m]->name), width[m], mapping.c_str());
+	}
+}
+
+/**
+ * @brief Run the simulations of the modules too small to use all the threads concurrently, one thread each
+ *
+ * The analyzers are built and the results cached or logged on this thread, as Yosys data structures are not thread-safe.
+ */
+void analyze_small_modules(std::vector<std::unique_ptr<ModuleAnalysis>> &analyses, const std::vector<int> &nb_lockable,
+			   const std::vector<int> &module_budgets, bool report, bool pairwise, bool corruption)
+{
+	int nb_threads = analyses.front()->nb_threads();
+	if (nb_threads <= 1) {
+		return;
+	}
+	std::vector<ModuleAnalysis *> small;
+	for (int m = 0; m < GetSize(analyses); ++m) {
+		// Below one block of 64 signals per thread, a module does not keep the thread pool busy by itself
+		if ((report || module_budgets[m] > 0) && nb_lockable[m] < 64 * nb_threads) {
+			small.push_back(analyses[m].get());
+		}
+	}
+	if (GetSize(small) < 2) {
+		return;
+	}
+	std::vector<ModuleAnalysis *> pending;
+	for (ModuleAnalysis *analysis : small) {
+		if (analysis->prepare_concurrent_analysis(pairwise, corruption)) {
+			pending.push_back(analysis);
+		}
+	}
+	log("Analyzing %d small modules concurrently\n", GetSize(pending));
+	parallel_run(nb_threads, GetSize(pending), [&](int, int i) { pending[i]->run_concurrent_analysis(); });
+	for (ModuleAnalysis *analysis : pending) {
+		log("Module %s:\n", analysis->module_name().c_str());
+		analysis->finish_concurrent_analysis();
+	}
+}
+
+/**
+ * @brief Write the interference graph in the binary format of LogicLockingOptimizer, with nodes in the order of the lockable cells
+ */
+void dump_interference_graph(ModuleAnalysis &analysis, const std::string &filename)
+{
+	auto gr = make_interference_graph(analysis.lockable_cells(), analysis.compute_pairwise_secure_graph());
+	std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+	LogicLockingOptimizer::toBinaryFile(f, gr);
+	if (!f) {
+		log_error("Could not write the interference graph to %s\n", filename.c_str());
+	}
+	log("Wrote the interference graph with %d nodes to %s\n", GetSize(gr), filename.c_str());
+}
+
+/**
+ * @brief Log the profiling results, and write them as JSON if a file is given
+ */
+void report_profile(const Profiler &profiler, const std::string &json_file)
+{
+	log("\nProfiling results:\n%s\n", profiler.toText().c_str());
+	if (json_file.empty()) {
+		return;
+	}
+	std::ofstream f(json_file);
+	f << profiler.toJson();
+	if (!f) {
+		log_warning("Could not write profiling results to %s\n", json_file.c_str());
+	}
+}
+
 /**
  * @brief Parse a boolean value
  */
@@ -280,8 +1305,27 @@ struct LogicLockingPass : public Pass {
 		OptimizationTarget target = PAIRWISE_SECURITY;
 		double percent_locked = 5.0f;
 		int key_size = -1;
+		std::vector<int> key_sizes;
 		int nb_test_vectors = 64;
+		int nb_cycles = 1;
+		int nb_threads = 1;
+		std::string cache_dir;
+		std::string corruption_file;
+		std::string stimulus_file;
+		int shard = 0;
+		int nb_shards = 0;
+		std::string shard_file;
+		std::vector<std::string> merge_files;
+		int sketch_size = 0;
+		bool strash = false;
+		bool adaptive = false;
+		double adaptive_tolerance = 0.01;
+		PairwiseSettings pairwise_settings;
 		bool report = false;
+		std::string report_csv;
+		bool profile = false;
+		std::string profile_json;
+		std::string dump_graph;
 		std::vector<IdString> gates_to_lock;
 		std::string key;
 		std::vector<std::pair<IdString, IdString>> gates_to_mix;
@@ -314,12 +1358,104 @@ struct LogicLockingPass : public Pass {
 				key_size = std::atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (arg == "-key-sizes") {
+				if (argidx + 1 >= args.size())
+					break;
+				for (const std::string &tok : split_tokens(args[++argidx], ",")) {
+					key_sizes.push_back(std::atoi(tok.c_str()));
+				}
+				continue;
+			}
 			if (arg == "-nb-test-vectors") {
 				if (argidx + 1 >= args.size())
 					break;
 				nb_test_vectors = std::atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (arg == "-cycles") {
+				if (argidx + 1 >= args.size())
+					break;
+				nb_cycles = std::atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-threads") {
+				if (argidx + 1 >= args.size())
+					break;
+				nb_threads = std::atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-cache-dir") {
+				if (argidx + 1 >= args.size())
+					break;
+				cache_dir = args[++argidx];
+				continue;
+			}
+			if (arg == "-corruption-file") {
+				if (argidx + 1 >= args.size())
+					break;
+				corruption_file = args[++argidx];
+				continue;
+			}
+			if (arg == "-sketch-size") {
+				if (argidx + 1 >= args.size())
+					break;
+				sketch_size = std::atoi(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-time-limit") {
+				if (argidx + 1 >= args.size())
+					break;
+				pairwise_settings.time_limit = std::atof(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-max-cliques") {
+				if (argidx + 1 >= args.size())
+					break;
+				pairwise_settings.max_cliques = std::atoll(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-shard") {
+				if (argidx + 1 >= args.size())
+					break;
+				if (std::sscanf(args[++argidx].c_str(), "%d/%d", &shard, &nb_shards) != 2 || shard < 1 || shard > nb_shards) {
+					log_error("Invalid shard %s, expected <k>/<N> with 1 <= k <= N\n", args[argidx].c_str());
+				}
+				--shard;
+				continue;
+			}
+			if (arg == "-shard-file") {
+				if (argidx + 1 >= args.size())
+					break;
+				shard_file = args[++argidx];
+				continue;
+			}
+			if (arg == "-merge") {
+				if (argidx + 1 >= args.size())
+					break;
+				merge_files.push_back(args[++argidx]);
+				continue;
+			}
+			if (arg == "-stimulus") {
+				if (argidx + 1 >= args.size())
+					break;
+				stimulus_file = args[++argidx];
+				continue;
+			}
+			if (arg == "-adaptive") {
+				adaptive = true;
+				continue;
+			}
+			if (arg == "-adaptive-tolerance") {
+				if (argidx + 1 >= args.size())
+					break;
+				adaptive = true;
+				adaptive_tolerance = std::atof(args[++argidx].c_str());
+				continue;
+			}
+			if (arg == "-strash") {
+				strash = true;
+				continue;
+			}
 			if (arg == "-target") {
 				if (argidx + 1 >= args.size())
 					break;
@@ -345,11 +1481,59 @@ struct LogicLockingPass : public Pass {
 				report = true;
 				continue;
 			}
+			if (arg == "-report-csv") {
+				if (argidx + 1 >= args.size())
+					break;
+				report = true;
+				report_csv = args[++argidx];
+				continue;
+			}
+			if (arg == "-dump-graph") {
+				if (argidx + 1 >= args.size())
+					break;
+				dump_graph = args[++argidx];
+				continue;
+			}
+			if (arg == "-profile") {
+				profile = true;
+				continue;
+			}
+			if (arg == "-profile-json") {
+				if (argidx + 1 >= args.size())
+					break;
+				profile = true;
+				profile_json = args[++argidx];
+				continue;
+			}
 			break;
 		}
 
 		log_assert(percent_locked >= 0.0f);
 		log_assert(percent_locked <= 100.0f);
+		log_assert(nb_threads >= 0);
+		if (nb_cycles < 1) {
+			log_error("The number of cycles must be at least 1\n");
+		}
+		log_assert(sketch_size == 0 || sketch_size >= 2);
+		bool sharded = nb_shards > 0;
+		if (sharded && shard_file.empty()) {
+			log_error("Option -shard requires -shard-file\n");
+		}
+		if (sharded && !merge_files.empty()) {
+			log_error("Options -shard and -merge cannot be used together\n");
+		}
+		if ((sharded || !merge_files.empty()) && (sketch_size != 0 || adaptive)) {
+			log_error("Sharded analysis is not supported with -sketch-size or -adaptive\n");
+		}
+
+		std::sort(key_sizes.begin(), key_sizes.end());
+		key_sizes.erase(std::unique(key_sizes.begin(), key_sizes.end()), key_sizes.end());
+		if (!key_sizes.empty() && key_sizes.front() <= 0) {
+			log_error("Key sizes given to -key-sizes must be positive\n");
+		}
+		if (!key_sizes.empty() && report) {
+			log_error("Options -key-sizes and -report cannot be used together: the report already covers all key sizes\n");
+		}
 
 		// handle extra options (e.g. selection)
 		extra_args(args, argidx, design);
@@ -360,23 +1544,32 @@ struct LogicLockingPass : public Pass {
 				modules_to_run.push_back(it.second);
 			}
 		}
-		if (modules_to_run.size() >= 2) {
-			log_error("Multiple modules are selected. Please run logic locking on a single module to avoid duplicate keys.\n");
-		}
 		if (modules_to_run.empty()) {
 			return;
 		}
-
-		RTLIL::Module *mod = modules_to_run.front();
+		// The key is split between modules in name order, independently of the hashing of the design
+		std::sort(modules_to_run.begin(), modules_to_run.end(), [](Module *a, Module *b) { return a->name.str() < b->name.str(); });
 
 		bool explicit_locking = !gates_to_lock.empty() || !gates_to_mix.empty();
+		if (modules_to_run.size() >= 2 && (explicit_locking || sharded || !merge_files.empty() || !dump_graph.empty() || !key_sizes.empty())) {
+			log_error("Multiple modules are selected. Explicit locking, sharding, -key-sizes and -dump-graph require a single module.\n");
+		}
+		if (explicit_locking && !key_sizes.empty()) {
+			log_error("Options -key-sizes, -lock-gate and -mix-gate cannot be used together\n");
+		}
+		int nb_cells = 0;
+		for (Module *mod : modules_to_run) {
+			nb_cells += GetSize(mod->cells_);
+		}
 		int nb_locked;
 		if (explicit_locking) {
 			nb_locked = gates_to_lock.size() + gates_to_mix.size();
+		} else if (!key_sizes.empty()) {
+			nb_locked = key_sizes.back();
 		} else if (key_size >= 0) {
 			nb_locked = key_size;
 		} else {
-			nb_locked = static_cast<int>(0.01 * GetSize(mod->cells_) * percent_locked);
+			nb_locked = static_cast<int>(0.01 * nb_cells * percent_locked);
 		}
 
 		std::vector<bool> key_values;
@@ -402,6 +1595,7 @@ struct LogicLockingPass : public Pass {
 		 * right now.
 		 */
 		if (explicit_locking) {
+			RTLIL::Module *mod = modules_to_run.front();
 			log("Explicit logic locking solution: %zu xor locks and %zu mux locks, key %s\n", gates_to_lock.size(), gates_to_mix.size(),
 			    key_check.c_str());
 			RTLIL::Wire *w = add_key_input(mod, nb_locked);
@@ -411,16 +1605,108 @@ struct LogicLockingPass : public Pass {
 			std::vector<bool> mix_key(key_values.begin() + gates_to_lock.size(), key_values.begin() + nb_locked);
 			mix_gates(mod, gates_to_mix, SigSpec(w, nb_xor_gates, nb_locked), mix_key);
 			return;
-		} else if (report) {
-			report_logic_locking(mod, nb_test_vectors);
-		} else {
-			log("Running logic locking with %d test vectors, locking %d cells out of %d, key %s.\n", nb_test_vectors, nb_locked,
-			    GetSize(mod->cells_), key_check.c_str());
-			auto locked_gates = run_logic_locking(mod, nb_test_vectors, nb_locked, target);
-			nb_locked = locked_gates.size();
-			RTLIL::Wire *w = add_key_input(mod, nb_locked);
-			key_values.erase(key_values.begin() + nb_locked, key_values.end());
-			lock_gates(mod, locked_gates, SigSpec(w), key_values);
+		}
+
+		bool multiple_modules = modules_to_run.size() >= 2;
+		std::vector<int> nb_lockable;
+		for (Module *mod : modules_to_run) {
+			nb_lockable.push_back(GetSize(LogicLockingAnalyzer::get_lockable_cells(mod)));
+		}
+		std::vector<int> module_budgets = split_key_budget(nb_lockable, nb_locked);
+		bool need_pairwise = report || target != OUTPUT_CORRUPTION;
+		bool need_corruption = report || target != PAIRWISE_SECURITY;
+		std::string test_vectors = stimulus_file.empty() ? stringf("%d test vectors", nb_test_vectors) : "test vectors from " + stimulus_file;
+		if (nb_cycles > 1) {
+			test_vectors += stringf(" over %d cycles", nb_cycles);
+		}
+		if (!report) {
+			log("Running logic locking with %s, locking %d cells out of %d, key %s.\n", test_vectors.c_str(), nb_locked, nb_cells,
+			    key_check.c_str());
+		}
+		std::unique_ptr<std::ofstream> csv;
+		if (!report_csv.empty()) {
+			csv.reset(new std::ofstream(report_csv));
+			*csv << "module,locked,cover,rate,security\n";
+		}
+		Profiler profiler;
+		std::vector<std::unique_ptr<ModuleAnalysis>> analyses;
+		for (int m = 0; m < GetSize(modules_to_run); ++m) {
+			analyses.emplace_back(new ModuleAnalysis(modules_to_run[m], nb_test_vectors, nb_cycles, nb_threads, cache_dir, stimulus_file));
+			ModuleAnalysis &analysis = *analyses.back();
+			analysis.set_corruption_file(corruption_file);
+			analysis.set_sketch_size(sketch_size);
+			analysis.set_strashing(strash);
+			if (adaptive) {
+				analysis.set_adaptive(adaptive_tolerance, module_budgets[m]);
+			}
+		}
+		if (multiple_modules && corruption_file.empty()) {
+			analyze_small_modules(analyses, nb_lockable, module_budgets, report, need_pairwise, need_corruption);
+		}
+		// Key bits used so far, allocated to the modules in order, as (offset, size) for each module
+		int key_offset = 0;
+		std::vector<std::pair<int, int>> key_ranges(modules_to_run.size(), std::make_pair(0, 0));
+		for (int m = 0; m < GetSize(modules_to_run); ++m) {
+			RTLIL::Module *mod = modules_to_run[m];
+			int module_locked = module_budgets[m];
+			std::unique_ptr<ModuleAnalysis> analysis_ptr = std::move(analyses[m]);
+			ModuleAnalysis &analysis = *analysis_ptr;
+			if (multiple_modules) {
+				if (!report && module_locked == 0) {
+					log("Module %s: no cell to lock\n", log_id(mod->name));
+					continue;
+				}
+				log("Module %s: %d lockable cells, locking %d\n", log_id(mod->name), nb_lockable[m], module_locked);
+			}
+			if (sharded) {
+				log("Running the analysis of shard %d/%d\n", shard + 1, nb_shards);
+				analysis.set_shard(shard, nb_shards);
+				analysis.save_shard(shard_file, need_pairwise, need_corruption);
+				if (profile) {
+					report_profile(analysis.profiler(), profile_json);
+				}
+				return;
+			}
+			if (!merge_files.empty()) {
+				analysis.merge_shards(merge_files);
+				if (need_pairwise && !analysis.has_merged_pairwise()) {
+					log_error("The shards do not include the pairwise security analysis\n");
+				}
+				if (need_corruption && !analysis.has_merged_corruption()) {
+					log_error("The shards do not include the output corruption analysis\n");
+				}
+			}
+			if (!dump_graph.empty()) {
+				dump_interference_graph(analysis, dump_graph);
+			}
+			if (report) {
+				report_logic_locking(analysis, pairwise_settings, csv.get());
+			} else {
+				std::vector<int> module_key_sizes = key_sizes.empty() ? std::vector<int>{module_locked} : key_sizes;
+				std::vector<bool> module_key(key_values.begin() + key_offset, key_values.end());
+				int nb_module_locked = lock_module(analysis, mod, module_key_sizes, target, pairwise_settings, module_key);
+				if (multiple_modules) {
+					log("Module %s: key bits %d to %d\n", log_id(mod->name), key_offset, key_offset + nb_module_locked - 1);
+				}
+				key_ranges[m] = std::make_pair(key_offset, nb_module_locked);
+				key_offset += nb_module_locked;
+			}
+			profiler.addStages(analysis.profiler(), multiple_modules ? mod->name.str() + "." : std::string());
+		}
+		if (csv) {
+			csv->flush();
+			if (!*csv) {
+				log_error("Could not write the tradeoff curves to %s\n", report_csv.c_str());
+			}
+			log("Wrote the tradeoff curves to %s\n", report_csv.c_str());
+		}
+		if (multiple_modules && !report) {
+			route_key_inputs(design, modules_to_run, key_ranges);
+			key_values.erase(key_values.begin() + key_offset, key_values.end());
+			log("Locked %d cells in %d modules, key %s\n", key_offset, GetSize(modules_to_run), create_hex_string(key_values).c_str());
+		}
+		if (profile) {
+			report_profile(profiler, profile_json);
 		}
 	}
 
@@ -434,6 +1720,13 @@ struct LogicLockingPass : public Pass {
 		log("By default, it runs simulations and optimizes the subset of signals that \n");
 		log("are locked, making it difficult to recover the original design.\n");
 		log("\n");
+		log("When several modules are selected, each of them is locked with its own lock_key\n");
+		log("input. The key is split between modules in name order, proportionally to their\n");
+		log("number of lockable cells. A module that instantiates locked modules gets a\n");
+		log("lock_key input with the key bits of its whole hierarchy, routed to the instances;\n");
+		log("its own key is renamed lock_key_local. Modules too small to use all threads are\n");
+		log("simulated concurrently, one thread each.\n");
+		log("\n");
 		log("    -key <value>\n");
 		log("        the locking key (hexadecimal)\n");
 		log("\n");
@@ -443,15 +1736,106 @@ struct LogicLockingPass : public Pass {
 		log("    -key-percent <value>\n");
 		log("        specify the size of the key as a percentage of the number of gates in the design (default=5)\n");
 		log("\n");
+		log("    -key-sizes <value>,<value>,...\n");
+		log("        lock for several key sizes in one run, the largest one giving the size of the key.\n");
+		log("        Each size locks more cells in addition to those of the previous one, reusing the\n");
+		log("        analysis, so that the first bits of the key give the locking for each size. The\n");
+		log("        other key bits are then left at their correct value\n");
+		log("\n");
 		log("    -target {pairwise|corruption|hybrid}\n");
 		log("        specify the optimization target for locking (default=pairwise)\n");
 		log("\n");
 		log("    -nb-test-vectors <value>\n");
 		log("        specify the number of test vectors used for analysis (default=64)\n");
 		log("\n");
+		log("    -stimulus <file>\n");
+		log("        use the test vectors of this file instead of random ones, for example from a\n");
+		log("        simulation of a realistic workload. Each line holds one test vector, with one\n");
+		log("        0 or 1 per combinatorial input: the bits of the input ports and the outputs of\n");
+		log("        flip-flops and submodule instances, ordered by wire name, then bit index. The\n");
+		log("        column of each bit is logged when the file is read, even if it is rejected.\n");
+		log("        Whitespace is ignored, as well as lines starting with #. The file is read on\n");
+		log("        demand rather than loaded in memory\n");
+		log("\n");
+		log("    -adaptive\n");
+		log("        simulate the output corruption by blocks of test vectors, and stop once the\n");
+		log("        ranking of the best cells is stable and the corruption rates are accurate enough.\n");
+		log("        The number of test vectors becomes a maximum. Pairwise security still uses all\n");
+		log("        test vectors\n");
+		log("\n");
+		log("    -adaptive-tolerance <value>\n");
+		log("        same as -adaptive, with the maximum width of the 95%% confidence intervals of the\n");
+		log("        corruption rates (default=0.01)\n");
+		log("\n");
+		log("    -cycles <value>\n");
+		log("        measure output corruption over sequences of this many clock cycles instead of a\n");
+		log("        single one, with flip-flops keeping their state between cycles. The number of\n");
+		log("        test vectors becomes the number of sequences. With -stimulus, each group of\n");
+		log("        consecutive blocks of 64 lines holds 64 sequences, with one block per cycle.\n");
+		log("        Enables and resets of flip-flops are not modeled, and pairwise security still\n");
+		log("        uses single cycles (default=1)\n");
+		log("\n");
+		log("    -threads <value>\n");
+		log("        specify the number of threads used for analysis, 0 to use all cores (default=1)\n");
+		log("\n");
+		log("    -cache-dir <directory>\n");
+		log("        store analysis results in this directory, and reuse them in later runs on the\n");
+		log("        same design with the same number of test vectors\n");
+		log("\n");
+		log("    -corruption-file <file>\n");
+		log("        keep the output corruption data in a memory-mapped temporary file rather\n");
+		log("        than in memory, for large designs\n");
+		log("\n");
+		log("    -sketch-size <value>\n");
+		log("        stream the output corruption analysis by blocks of test vectors, and optimize\n");
+		log("        on sketches of this size per signal. Memory usage no longer depends on the\n");
+		log("        number of test vectors, but corruption cover is estimated (default=0, disabled)\n");
+		log("\n");
+		log("    -max-cliques <value>\n");
+		log("        maximum number of cliques of the interference graph enumerated for the pairwise\n");
+		log("        optimization. Beyond it, a heuristic is used instead, which scales to larger\n");
+		log("        designs (default=100000, 0 for no limit)\n");
+		log("\n");
+		log("    -time-limit <seconds>\n");
+		log("        time limit of the pairwise heuristic, which returns its best solution so far\n");
+		log("        (default=0, no limit)\n");
+		log("\n");
+		log("    -strash\n");
+		log("        merge structurally identical logic and propagate constants when building\n");
+		log("        the AIG used for analysis. Results are unchanged, with faster simulation\n");
+		log("\n");
+		log("    -shard <k>/<N>\n");
+		log("        only run the part k of the analysis split in N parts, to distribute it between\n");
+		log("        processes or machines, and write its results to the file given by -shard-file\n");
+		log("        without modifying the circuit\n");
+		log("\n");
+		log("    -shard-file <file>\n");
+		log("        file where the results of the shard are written\n");
+		log("\n");
+		log("    -merge <file>\n");
+		log("        use the results of a shard instead of running the analysis. This option is\n");
+		log("        given once per shard, and all shards must have been run on the same design\n");
+		log("        with the same target and test vector options\n");
+		log("\n");
 		log("    -report\n");
 		log("        print statistics but do not modify the circuit\n");
 		log("\n");
+		log("    -report-csv <file>\n");
+		log("        same as -report, and also write the tradeoff curves to a CSV file, with the\n");
+		log("        columns module, locked, cover, rate (in percent) and security\n");
+		log("\n");
+		log("    -dump-graph <file>\n");
+		log("        write the pairwise security graph in a binary format, with nodes in the\n");
+		log("        order of the lockable cells, for offline tuning of the optimizer\n");
+		log("\n");
+		log("    -profile\n");
+		log("        report the wall time, peak memory and throughput of each stage of the run.\n");
+		log("        The memory is the peak resident memory of the process up to the end of the\n");
+		log("        stage, so it never decreases from one stage to the next\n");
+		log("\n");
+		log("    -profile-json <file>\n");
+		log("        same as -profile, and also write the results to a JSON file\n");
+		log("\n");
 		log("\n");
 		log("The following options control locking manually, locking the corresponding \n");
 		log("gate outputs directly without any optimization. They can be mixed and repeated.\n");